@@ -0,0 +1,26 @@
+#pragma once
+#include <functional>
+#include "TaskHandle.h"
+
+namespace imp
+{
+    /// <summary> A task marked as blocking (on disk, network or locks). Runs like any other task, but
+    /// <c>BlockingUnitGroup::RouteBlockingTasks</c> moves it off CPU-bound units onto the group's units.
+    /// Stored in the task list as the task's <c>std::function</c>. Copyable. </summary>
+    struct BlockingTask
+    {
+        std::function<void()> Task;
+
+        void operator()() const
+        {
+            Task();
+        }
+    };
+
+    /// <summary> Returns true if the task was pushed as a blocking task (looking through an identity). </summary>
+    [[nodiscard]]
+    inline bool IsBlockingTask(const std::function<void()>& task) noexcept
+    {
+        return UnwrapTaskIdentity(task).target<BlockingTask>() != nullptr;
+    }
+}
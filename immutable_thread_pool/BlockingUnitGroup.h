@@ -0,0 +1,233 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "BlockingTask.h"
+#include "DispatchOptions.h"
+#include "ThreadTaskSource.h"
+#include "ThreadUnitPlusPlus.h"
+#include "UnitBroadcast.h"
+
+namespace imp
+{
+    /// <summary> An elastically sized group of units for blocking tasks (pushed with <c>PushBlockingTaskBack</c>),
+    /// keeping CPU-bound units free of blocking calls. <c>RouteBlockingTasks</c> moves the blocking tasks out of a
+    /// task source onto the group, and returns the rest for the CPU-bound unit. </summary>
+    /// <remarks> The group grows a unit at a time, placing each task on the least loaded unit with fewer than
+    /// <c>TasksPerUnit</c> tasks, so a blocked task stalls at most that many others. Up to <c>MaxUnits</c> units,
+    /// by default more than the hardware threads (blocked threads do not use a core), after that tasks are spread
+    /// over the least loaded units. <c>RemoveBlockingTasks</c> and <c>Shrink</c> retire the units no longer needed
+    /// at <c>TasksPerUnit</c>, down to <c>MinUnits</c>. Units run below normal priority by default. Only the units
+    /// given new tasks are restarted. Set <c>StateEvents</c> in the unit options to watch the whole group through one eventfd.
+    /// Like a unit, controlled from one thread. Non-copyable, Movable. </remarks>
+    class BlockingUnitGroup
+    {
+    public:
+        using TaskInfo = ThreadTaskSource::TaskInfo;
+        static constexpr std::size_t DefaultTasksPerUnit{ 2 };
+        static constexpr std::size_t DefaultUnitsPerHardwareThread{ 4 };
+    private:
+        std::deque<ThreadUnitPlusPlus> m_units{};
+        std::size_t m_tasksPerUnit{};
+        std::size_t m_maxUnits{};
+        DispatchOptions m_unitOptions{};
+        std::size_t m_minUnits{};
+    public:
+        /// <summary> Ctor. </summary>
+        /// <param name="tasksPerUnit"> Tasks placed on a unit before another unit is added. </param>
+        /// <param name="maxUnits"> Most units in the group, zero for <c>DefaultUnitsPerHardwareThread</c> per hardware thread. </param>
+        /// <param name="unitOptions"> Dispatch options of the group's units. </param>
+        /// <param name="minUnits"> Fewest units the group shrinks to, units are still only added for tasks. </param>
+        explicit BlockingUnitGroup(const std::size_t tasksPerUnit = DefaultTasksPerUnit, const std::size_t maxUnits = 0,
+            const DispatchOptions unitOptions = MakeDefaultUnitOptions(), const std::size_t minUnits = 0)
+            : m_tasksPerUnit(std::max<std::size_t>(tasksPerUnit, 1)),
+            m_maxUnits(maxUnits > 0 ? maxUnits : DefaultUnitsPerHardwareThread * std::max(std::thread::hardware_concurrency(), 1u)),
+            m_unitOptions(unitOptions),
+            m_minUnits(std::min(minUnits, m_maxUnits))
+        {
+        }
+        BlockingUnitGroup(const BlockingUnitGroup&) = delete;
+        BlockingUnitGroup& operator=(const BlockingUnitGroup&) = delete;
+        BlockingUnitGroup(BlockingUnitGroup&&) = default;
+        BlockingUnitGroup& operator=(BlockingUnitGroup&&) = default;
+    public:
+        /// <summary> Default options of the group's units, below normal priority. </summary>
+        [[nodiscard]]
+        static DispatchOptions MakeDefaultUnitOptions()
+        {
+            DispatchOptions unitOptions{};
+            unitOptions.IsLowPriority = true;
+            return unitOptions;
+        }
+
+        /// <summary> Moves the blocking tasks of <c>taskSource</c>'s task list onto the group's units. </summary>
+        /// <returns> The task source without its blocking tasks, for the CPU-bound unit. </returns>
+        [[nodiscard]]
+        ThreadTaskSource RouteBlockingTasks(ThreadTaskSource taskSource)
+        {
+            std::vector<TaskInfo> blockingTasks;
+            std::erase_if(taskSource.TaskList, [&blockingTasks](const TaskInfo& task)
+                {
+                    if (!IsBlockingTask(task))
+                        return false;
+                    blockingTasks.emplace_back(task);
+                    return true;
+                });
+            AddBlockingTasks(blockingTasks);
+            return taskSource;
+        }
+
+        /// <summary> Places the tasks onto the group's units, adding units as needed. </summary>
+        void AddBlockingTasks(const std::vector<TaskInfo>& blockingTasks)
+        {
+            if (blockingTasks.empty())
+                return;
+            // Work on copies of the task sources, then restart each changed unit once.
+            std::vector<ThreadTaskSource> unitTasks;
+            for (const auto& unit : m_units)
+                unitTasks.emplace_back(unit.GetTaskSource());
+            const std::size_t existingUnits = unitTasks.size();
+            std::vector<bool> isUnitChanged(existingUnits, false);
+            for (const auto& task : blockingTasks)
+            {
+                const auto leastLoadedIt = std::ranges::min_element(unitTasks, {}, [](const ThreadTaskSource& tasks) { return tasks.TaskList.size(); });
+                std::size_t unitIndex = static_cast<std::size_t>(leastLoadedIt - unitTasks.begin());
+                if (unitTasks.empty() || (leastLoadedIt->TaskList.size() >= m_tasksPerUnit && unitTasks.size() < m_maxUnits))
+                {
+                    unitIndex = unitTasks.size();
+                    unitTasks.emplace_back();
+                    isUnitChanged.emplace_back(true);
+                }
+                unitTasks[unitIndex].TaskList.emplace_back(task);
+                isUnitChanged[unitIndex] = true;
+            }
+            for (std::size_t i = 0; i < unitTasks.size(); i++)
+            {
+                if (i >= existingUnits)
+                    m_units.emplace_back(unitTasks[i], m_unitOptions);
+                else if (isUnitChanged[i])
+                    m_units[i].SetTaskSource(unitTasks[i]);
+            }
+        }
+
+        /// <summary> Removes the tasks matching <c>isRemoved</c> from the group's units, then retires the units no
+        /// longer needed, as <c>Shrink</c> does. </summary>
+        /// <returns> The number of tasks removed. </returns>
+        std::size_t RemoveBlockingTasks(const std::function<bool(const TaskInfo&)>& isRemoved)
+        {
+            return repack(isRemoved);
+        }
+
+        /// <summary> Retires units down to the fewest that hold the group's tasks at <c>TasksPerUnit</c> each, and no
+        /// fewer than <c>MinUnits</c>. The last units are stopped first, then their tasks restart on the least loaded
+        /// remaining units, so no task runs on two threads at once. </summary>
+        void Shrink()
+        {
+            repack({});
+        }
+
+        /// <summary> Stops and removes every unit of the group, and their tasks. </summary>
+        void Clear()
+        {
+            for (auto& unit : m_units)
+                unit.DestroyThread();
+            m_units.clear();
+        }
+
+        /// <summary> Runs <c>broadcastFn</c> once on every unit's work thread, see <c>BroadcastToUnits</c>. </summary>
+        [[nodiscard]]
+        std::future<void> Broadcast(std::function<void()> broadcastFn)
+        {
+            return BroadcastToUnits(m_units, std::move(broadcastFn));
+        }
+
+        /// <summary> Sets the ordered pause value of every unit of the group. </summary>
+        void SetPauseValueOrdered(const bool enablePause)
+        {
+            for (auto& unit : m_units)
+                unit.SetPauseValueOrdered(enablePause);
+        }
+
+        /// <summary> Sets the unordered pause value of every unit of the group. </summary>
+        void SetPauseValueUnordered(const bool enablePause)
+        {
+            for (auto& unit : m_units)
+                unit.SetPauseValueUnordered(enablePause);
+        }
+
+        /// <summary> Waits for the pause of every unit of the group to complete. </summary>
+        void WaitForPauseCompleted()
+        {
+            for (auto& unit : m_units)
+                unit.WaitForPauseCompleted();
+        }
+
+        [[nodiscard]] std::size_t GetUnitCount() const { return m_units.size(); }
+        [[nodiscard]] std::size_t GetMaxUnits() const { return m_maxUnits; }
+        [[nodiscard]] std::size_t GetMinUnits() const { return m_minUnits; }
+        [[nodiscard]] std::size_t GetTasksPerUnit() const { return m_tasksPerUnit; }
+        /// <summary> Returns the dispatch options of the group's units, e.g. their shared <c>StateEvents</c>. </summary>
+        [[nodiscard]] const DispatchOptions& GetUnitOptions() const { return m_unitOptions; }
+
+        /// <summary> Returns the number of tasks on the group's units. </summary>
+        [[nodiscard]]
+        std::size_t GetNumberOfTasks() const
+        {
+            std::size_t taskCount = 0;
+            for (const auto& unit : m_units)
+                taskCount += unit.GetNumberOfTasks();
+            return taskCount;
+        }
+
+        /// <summary> Returns the group's units, e.g. to control them individually. </summary>
+        [[nodiscard]] std::deque<ThreadUnitPlusPlus>& GetUnits() { return m_units; }
+    private:
+        /// <summary> Removes the tasks matching <c>isRemoved</c> (if set), and moves the tasks of the units to retire
+        /// onto the rest. Each unit is restarted at most once. </summary>
+        std::size_t repack(const std::function<bool(const TaskInfo&)>& isRemoved)
+        {
+            std::vector<ThreadTaskSource> unitTasks;
+            std::vector<bool> isUnitChanged(m_units.size(), false);
+            std::size_t removedCount = 0;
+            std::size_t taskCount = 0;
+            for (std::size_t i = 0; i < m_units.size(); i++)
+            {
+                unitTasks.emplace_back(m_units[i].GetTaskSource());
+                if (isRemoved)
+                {
+                    const auto unitRemovedCount = std::erase_if(unitTasks[i].TaskList, isRemoved);
+                    isUnitChanged[i] = unitRemovedCount > 0;
+                    removedCount += unitRemovedCount;
+                }
+                taskCount += unitTasks[i].TaskList.size();
+            }
+            const std::size_t keptUnits = std::min(m_units.size(), std::max(m_minUnits, (taskCount + m_tasksPerUnit - 1) / m_tasksPerUnit));
+            for (std::size_t i = keptUnits; i < unitTasks.size(); i++)
+            {
+                for (const auto& task : unitTasks[i].TaskList)
+                {
+                    const auto leastLoadedIt = std::ranges::min_element(unitTasks.begin(), unitTasks.begin() + keptUnits, {},
+                        [](const ThreadTaskSource& tasks) { return tasks.TaskList.size(); });
+                    leastLoadedIt->TaskList.emplace_back(task);
+                    isUnitChanged[static_cast<std::size_t>(leastLoadedIt - unitTasks.begin())] = true;
+                }
+            }
+            while (m_units.size() > keptUnits)
+            {
+                m_units.back().DestroyThread();
+                m_units.pop_back();
+            }
+            for (std::size_t i = 0; i < keptUnits; i++)
+            {
+                if (isUnitChanged[i])
+                    m_units[i].SetTaskSource(unitTasks[i]);
+            }
+            return removedCount;
+        }
+    };
+}
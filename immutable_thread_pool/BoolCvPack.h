@@ -1,6 +1,8 @@
 #pragma once
 #include <mutex>
 #include <atomic>
+#include <condition_variable>
+#include <stop_token>
 #include <thread>
 #include <functional>
 
@@ -96,6 +98,16 @@ namespace imp
             }
             task_running_cv.notify_all();
         }
+        /// <summary> Notifies all waiting threads to wake up and perform their wait check, e.g. after a stop request.
+        /// The mutex is taken first, so a waiter that checked the condition before the change is already waiting
+        /// and gets the notify, instead of missing it and blocking. </summary>
+        void NotifyAll()
+        {
+            {
+                SetterLock_t setter_lock{ running_mutex };
+            }
+            task_running_cv.notify_all();
+        }
         /// <summary> Returns the value of the atomic bool SharedData.
         /// It is not necessary to follow the <c>condition_variable</c> procedure just to
         /// check this value, nor lock the mutex since it's an atomic. </summary>
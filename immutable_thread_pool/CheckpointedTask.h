@@ -0,0 +1,39 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+#include "TaskHandle.h"
+
+namespace imp
+{
+    /// <summary> A task with checkpoint hooks, so the state it builds up (e.g. an in-memory cache) survives a restart:
+    /// <c>Save</c> serializes the state into a checkpoint written by the unit (see <c>DispatchOptions::CheckpointPath</c>),
+    /// and <c>Restore</c> is given the saved bytes of the same <c>Key</c> when a unit is next made with the task.
+    /// Runs like any other task. Stored in the task list as the task's <c>std::function</c>. Copyable. </summary>
+    /// <remarks> The hooks and the task share the state (e.g. capture the same shared_ptr), as the unit's copies of the
+    /// task are separate std::function objects. <c>Save</c> is called on the work thread between tasks, <c>Restore</c>
+    /// before the work thread starts, and its view of the bytes is only valid during the call. </remarks>
+    struct CheckpointedTask
+    {
+        using SaveFn_t = std::function<std::string()>;
+        using RestoreFn_t = std::function<void(std::string_view)>;
+
+        std::function<void()> Task;
+        std::string Key;
+        SaveFn_t Save;
+        RestoreFn_t Restore;
+
+        void operator()() const
+        {
+            Task();
+        }
+    };
+
+    /// <summary> Returns the checkpoint hooks of a task pushed as a checkpointed task (looking through an identity),
+    /// nullptr for other tasks. </summary>
+    [[nodiscard]]
+    inline const CheckpointedTask* GetTaskCheckpoint(const std::function<void()>& task) noexcept
+    {
+        return UnwrapTaskIdentity(task).target<CheckpointedTask>();
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ThreadTaskSource.h"
+
+namespace imp
+{
+    /// <summary> Assembles a large <c>ThreadTaskSource</c> from many threads at once. Each thread takes its own segment
+    /// with <c>AddSegment</c>, a <c>ThreadTaskSource</c> it pushes into without any locking, and <c>Build</c> then
+    /// moves every segment's tasks into one task source in a single pass. </summary>
+    /// <remarks> With ordered building, segments are concatenated by their order key (then by the order they were added),
+    /// each keeping its push order, so the result does not depend on thread timing: e.g. key each segment by the index
+    /// of the chunk of input it was built from. Otherwise they are concatenated in the order they were added.
+    /// <c>AddSegment</c> is thread-safe, a segment must only be used by one thread at a time, and <c>Build</c> must
+    /// only be called once the appending threads are done with their segments (e.g. joined). Non-copyable. </remarks>
+    class ConcurrentTaskListBuilder
+    {
+        struct SegmentEntry
+        {
+            std::uint64_t OrderKey;
+            ThreadTaskSource Segment;
+        };
+    public:
+        /// <summary> Default tasks per thread below which <c>Build</c> merges the task lists on the calling thread alone. </summary>
+        static constexpr std::size_t ParallelMergeTasksPerThread{ 64 * 1024 };
+    private:
+        std::mutex m_segmentsMutex{};
+        // A deque, so a segment handed out stays in place as others are added.
+        std::deque<SegmentEntry> m_segments{};
+        std::size_t m_maxMergeThreads{};
+        std::size_t m_mergeTasksPerThread{};
+        std::size_t m_lastMergeThreads{};
+    public:
+        /// <summary> Ctor. </summary>
+        /// <param name="maxMergeThreads"> Most threads <c>Build</c> merges the task lists with, zero for the hardware
+        /// concurrency. </param>
+        /// <param name="mergeTasksPerThread"> Tasks per merge thread, <c>Build</c> uses fewer threads for fewer tasks, and
+        /// merges on the calling thread alone below twice this many. </param>
+        explicit ConcurrentTaskListBuilder(const std::size_t maxMergeThreads = 0, const std::size_t mergeTasksPerThread = ParallelMergeTasksPerThread)
+            : m_maxMergeThreads(maxMergeThreads > 0 ? maxMergeThreads : std::max(std::thread::hardware_concurrency(), 1u)),
+            m_mergeTasksPerThread(std::max<std::size_t>(mergeTasksPerThread, 1))
+        {
+        }
+        ConcurrentTaskListBuilder(const ConcurrentTaskListBuilder&) = delete;
+        ConcurrentTaskListBuilder& operator=(const ConcurrentTaskListBuilder&) = delete;
+    public:
+        /// <summary> Adds a segment for the calling thread to push tasks into, with any of the task source's push functions. </summary>
+        /// <param name="orderKey"> Position of the segment in an ordered build, segments with equal keys keep the order they were added in. </param>
+        /// <returns> The segment, valid until <c>Build</c> is called. </returns>
+        ThreadTaskSource& AddSegment(const std::uint64_t orderKey = 0)
+        {
+            std::lock_guard segmentsLock{ m_segmentsMutex };
+            return m_segments.emplace_back(SegmentEntry{ orderKey, {} }).Segment;
+        }
+
+        /// <summary> Returns the number of segments added since the last build. </summary>
+        [[nodiscard]]
+        std::size_t GetSegmentCount()
+        {
+            std::lock_guard segmentsLock{ m_segmentsMutex };
+            return m_segments.size();
+        }
+
+        /// <summary> Returns the number of threads the last <c>Build</c> merged the task lists with. </summary>
+        [[nodiscard]]
+        std::size_t GetLastMergeThreads()
+        {
+            std::lock_guard segmentsLock{ m_segmentsMutex };
+            return m_lastMergeThreads;
+        }
+
+        /// <summary> Moves the tasks of every segment (each of the task source's lists) into one task source, and
+        /// removes the segments. </summary>
+        /// <param name="isOrdered"> Concatenate the segments by their order key, instead of the order they were added in. </param>
+        [[nodiscard]]
+        ThreadTaskSource Build(const bool isOrdered = true)
+        {
+            std::lock_guard segmentsLock{ m_segmentsMutex };
+            std::vector<std::size_t> segmentOrder(m_segments.size());
+            std::iota(segmentOrder.begin(), segmentOrder.end(), std::size_t{ 0 });
+            if (isOrdered)
+                std::ranges::stable_sort(segmentOrder, {}, [this](const std::size_t i) { return m_segments[i].OrderKey; });
+            ThreadTaskSource taskSource{};
+            moveTaskLists(segmentOrder, taskSource.TaskList);
+            for (const auto segmentIndex : segmentOrder)
+            {
+                auto& segment = m_segments[segmentIndex].Segment;
+                moveAppend(taskSource.HighPriorityTaskList, segment.HighPriorityTaskList);
+                moveAppend(taskSource.SignalledTaskList, segment.SignalledTaskList);
+                moveAppend(taskSource.RangeTaskList, segment.RangeTaskList);
+                moveAppend(taskSource.IterationEndTaskList, segment.IterationEndTaskList);
+            }
+            m_segments.clear();
+            return taskSource;
+        }
+    private:
+        // Appends the source list to the destination, taking over the whole list if the destination is empty.
+        static void moveAppend(auto& destination, auto& source)
+        {
+            if (destination.empty())
+            {
+                destination = std::move(source);
+                return;
+            }
+            std::ranges::move(source, std::back_inserter(destination));
+        }
+
+        // Moves the segments' task lists into taskList. A large list is sized first, then the segments are moved into
+        // their places by several threads (writing distinct elements of a deque concurrently is safe).
+        void moveTaskLists(const std::vector<std::size_t>& segmentOrder, std::deque<ThreadTaskSource::TaskInfo>& taskList)
+        {
+            std::vector<std::size_t> segmentStarts;
+            segmentStarts.reserve(segmentOrder.size());
+            std::size_t totalTasks = 0;
+            for (const auto segmentIndex : segmentOrder)
+            {
+                segmentStarts.emplace_back(totalTasks);
+                totalTasks += m_segments[segmentIndex].Segment.TaskList.size();
+            }
+            const std::size_t mergeThreads = std::min<std::size_t>({ m_maxMergeThreads, segmentOrder.size(), totalTasks / m_mergeTasksPerThread });
+            m_lastMergeThreads = std::max<std::size_t>(mergeThreads, 1);
+            if (mergeThreads < 2)
+            {
+                for (const auto segmentIndex : segmentOrder)
+                    moveAppend(taskList, m_segments[segmentIndex].Segment.TaskList);
+                return;
+            }
+            taskList.resize(totalTasks);
+            const auto MoveSegments = [&](const std::size_t firstSegment)
+            {
+                for (std::size_t i = firstSegment; i < segmentOrder.size(); i += mergeThreads)
+                {
+                    auto& segmentTasks = m_segments[segmentOrder[i]].Segment.TaskList;
+                    std::ranges::move(segmentTasks, taskList.begin() + static_cast<std::ptrdiff_t>(segmentStarts[i]));
+                    // Free the segment on this thread too, rather than in the single-threaded clear.
+                    segmentTasks = {};
+                }
+            };
+            {
+                std::vector<std::jthread> mergeWorkers;
+                for (std::size_t i = 1; i < mergeThreads; i++)
+                    mergeWorkers.emplace_back(MoveSegments, i);
+                MoveSegments(0);
+            }
+        }
+    };
+}
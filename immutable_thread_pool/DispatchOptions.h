@@ -0,0 +1,68 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "UnitThrottle.h"
+#include "UnitStateEvents.h"
+#include "TaskListReclaimer.h"
+#include "SamplingProfiler.h"
+#include "UnitTimeSource.h"
+
+namespace imp
+{
+    /// <summary> Options for how a unit's work thread dispatches its infinite tasks, copied into the work thread
+    /// when it is created (like the task list, they are not mutated while in use). </summary>
+    /// <remarks> <b>Pause/stop latency bound:</b> an unordered pause or stop request is observed before the next
+    /// dispatch once <c>CheckEveryTasks</c> tasks have run since the last check, or once <c>CheckEveryTime</c>
+    /// (if non-zero) has passed since the last check, whichever comes first. The time bound is measured at task
+    /// boundaries, so it is exceeded by at most the duration of the task in progress. With task fusion enabled the
+    /// check is made before every dispatch, and a fused dispatch holds at most <c>CheckEveryTasks</c> tasks (and,
+    /// if non-zero, at most <c>CheckEveryTime</c> of measured task time). Ordered pauses are unaffected, they are
+    /// observed at the end of the iteration. The defaults check before every task. </remarks>
+    struct DispatchOptions
+    {
+        /// <summary> Check the pause/stop state before every Nth task, 1 checks before every task. </summary>
+        std::size_t CheckEveryTasks{ 1 };
+        /// <summary> If non-zero, also check when this much time has passed since the last check. Reads the
+        /// clock after every task, so leave at zero for the lowest overhead with micro-tasks. </summary>
+        std::chrono::microseconds CheckEveryTime{ 0 };
+        /// <summary> Fuse runs of consecutive small tasks into single dispatches. The tasks are timed on the
+        /// first complete iteration, and the fused dispatch list is used from then on. </summary>
+        bool IsTaskFusionEnabled{ false };
+        /// <summary> A task that took less than this on the first iteration is small, and may be fused. </summary>
+        std::chrono::nanoseconds SmallTaskThreshold{ std::chrono::microseconds(1) };
+        /// <summary> If non-zero, the timer slack of the work thread: how long the kernel may defer its timer
+        /// expiries (waits and sleeps) to group them with other wakeups. Linux only, ignored elsewhere. </summary>
+        std::chrono::nanoseconds TimerSlack{ 0 };
+        /// <summary> If non-zero, the work thread's empty list wait, and the sleeps of its tasks made through
+        /// <c>UnitTime</c>, end on a common tick of this period, so the wakeups of every unit with the same
+        /// alignment coalesce. Lengthens each wait by less than one period, for background units. </summary>
+        std::chrono::microseconds WakeupAlignment{ 0 };
+        /// <summary> Run the work thread below normal priority, for background and blocking work
+        /// (nice +10 on Linux, THREAD_PRIORITY_BELOW_NORMAL on Windows). </summary>
+        bool IsLowPriority{ false };
+        /// <summary> If set, a throttle the work thread waits on at the end of each iteration, shared by the
+        /// background units a controller slows or pauses (e.g. under host pressure, see <c>PressureMonitor</c>). </summary>
+        std::shared_ptr<UnitThrottle> Throttle{};
+        /// <summary> If set, receives the work thread's state change events (pause completed, resumed, stopped,
+        /// iteration completed), pollable through its eventfd. Share it between units to watch them as a group. </summary>
+        std::shared_ptr<UnitStateEvents> StateEvents{};
+        /// <summary> If set, the unit's retired task lists (replaced, or cleared by <c>DestroyThread</c>) and the work
+        /// thread's copy are destroyed on the reclaimer's thread, so control calls do not wait on large lists. </summary>
+        std::shared_ptr<TaskListReclaimer> Reclaimer{};
+        /// <summary> If set, the file the state of the unit's checkpointed tasks is saved to when an ordered pause
+        /// completes and when the work thread exits, and restored from when the unit is made or the path is changed
+        /// with <c>SetDispatchOptions</c>. One file per unit. </summary>
+        std::string CheckpointPath{};
+        /// <summary> If set, samples the work thread's stacks, by task, while it runs (see <c>SamplingProfiler</c>).
+        /// Task fusion is off while profiling. </summary>
+        std::shared_ptr<SamplingProfiler> Profiler{};
+        /// <summary> The unit's name in diagnostics, e.g. the root frame of its profiled stacks. </summary>
+        std::string UnitName{};
+        /// <summary> If set, the time source of the work thread and of its tasks' <c>UnitTime</c> calls, instead of real
+        /// time (its sleeps are not aligned by <c>WakeupAlignment</c>). A simulated source (e.g. a unit's clock in a
+        /// <c>VirtualTimeScheduler</c>) also schedules the work thread, whose waits then go through the source. </summary>
+        std::shared_ptr<imp::TimeSource> TimeSource{};
+    };
+}
@@ -0,0 +1,121 @@
+// C++20 named module interface for the thread unit library, use with: import imp.thread_pool;
+// The headers are retained and remain the source of the definitions, they are parsed once here
+// (in the global module fragment) when the module is built instead of in every importing translation unit.
+// Macros (e.g. IMP_DEFINE_TASK_PLUGIN) are not exported by a module, include the header for those.
+// Compilers: MSVC 19.30 (Visual Studio 2022) or later. g++ 12 or later builds the module (-fmodules-ts), but g++ before 15
+// does not export the using-declarations below, so importers need g++ 15. Both are built in .github/workflows/module.yml.
+module;
+#include "BoolCvPack.h"
+#include "TaskSignal.h"
+#include "TaskHandle.h"
+#include "DispatchOptions.h"
+#include "TaskPrefetch.h"
+#include "BlockingTask.h"
+#include "CheckpointedTask.h"
+#include "TaskCheckpoint.h"
+#include "ThreadPriority.h"
+#include "ThreadTaskSource.h"
+#include "ThreadConcepts.h"
+#include "ThreadUnitPlusPlus.h"
+#include "PluginTask.h"
+#include "UnitTimeSource.h"
+#include "TscClock.h"
+#include "TimerCoalescing.h"
+#include "VirtualTimeScheduler.h"
+#include "ProcessUnitHost.h"
+#include "IoUringWriter.h"
+#include "OutputBatcher.h"
+#include "MappedRecordStream.h"
+#include "KeyedTaskPlacement.h"
+#include "BlockingUnitGroup.h"
+#include "UnitThrottle.h"
+#include "UnitStateEvents.h"
+#include "TaskListReclaimer.h"
+#include "ConcurrentTaskListBuilder.h"
+#include "UnitBroadcast.h"
+#include "SlabBufferPool.h"
+#include "SamplingProfiler.h"
+#include "PressureMonitor.h"
+
+export module imp.thread_pool;
+
+export namespace imp
+{
+    using imp::BoolCvPack;
+    using imp::SignalReadySet;
+    using imp::TaskSignal;
+    using imp::TaskHandle;
+    using imp::IdentifiedTask;
+    using imp::MakeTaskHandle;
+    using imp::GetTaskIdentity;
+    using imp::UnwrapTaskIdentity;
+    using imp::DispatchOptions;
+    using imp::PrefetchAddress;
+    using imp::PrefetchRange;
+    using imp::PrefetchingTask;
+    using imp::GetTaskPrefetch;
+    using imp::IsFnRange;
+    using imp::IsTaskRange;
+    using imp::ThreadTaskSource;
+    using imp::IsThreadUnit;
+    using imp::ThreadUnitPlusPlus;
+    using imp::KeyedTaskPlacement;
+    using imp::BlockingTask;
+    using imp::IsBlockingTask;
+    using imp::CheckpointedTask;
+    using imp::GetTaskCheckpoint;
+    using imp::HasCheckpointedTasks;
+    using imp::WriteTaskCheckpoint;
+    using imp::RestoreTaskCheckpoint;
+    using imp::BlockingUnitGroup;
+    using imp::LowPriorityNiceIncrement;
+    using imp::SetCurrentThreadLowPriority;
+    using imp::UnitThrottle;
+    using imp::UnitStateEvent;
+    using imp::UnitStateEvents;
+    using imp::TaskListReclaimer;
+    using imp::ConcurrentTaskListBuilder;
+    using imp::BroadcastToUnits;
+    using imp::SlabBufferPool;
+    using imp::PooledBuffer;
+    using imp::ProfiledLane;
+    using imp::SamplingProfiler;
+    using imp::TaskPluginApiVersion;
+    using imp::TaskPluginRunFn_t;
+    using imp::TaskPluginDescriptor;
+    using imp::TimeSource;
+    using imp::SteadyTimeSource;
+    using imp::TscClock;
+    using imp::AlignWakeup;
+    using imp::SetThreadTimerSlack;
+    using imp::CoalescingTimeSource;
+    using imp::ScopedTimeSource;
+    using imp::VirtualTimeScheduler;
+    namespace UnitTime
+    {
+        using imp::UnitTime::Current;
+        using imp::UnitTime::Now;
+        using imp::UnitTime::IterationNow;
+        using imp::UnitTime::SleepFor;
+    }
+#if defined(__unix__)
+    using imp::TaskPluginLibrary;
+    using imp::TaskPluginLatch;
+    using imp::TaskPluginLatchPtr_t;
+    using imp::TaskPluginLoader;
+    using imp::OutputBatcher;
+    using imp::MappedRecordStream;
+#endif
+#if defined(__linux__)
+    using imp::ProcessControlBlock;
+    using imp::ProcessUnit;
+    using imp::ProcessUnitHost;
+    using imp::PressureStats;
+    using imp::PressureThresholds;
+    using imp::PressureMonitorOptions;
+    using imp::PressureMonitor;
+#endif
+#if defined(IMP_IO_URING_SUPPORTED)
+    using imp::IoUringWriter;
+#endif
+}
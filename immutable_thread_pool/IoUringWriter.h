@@ -0,0 +1,195 @@
+#pragma once
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define IMP_IO_URING_SUPPORTED 1
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace imp
+{
+    /// <summary> A minimal io_uring submission ring for <c>writev</c> calls, it submits the writes of several file
+    /// descriptors and waits for all of them with a single <c>io_uring_enter</c> call. Used by <c>OutputBatcher</c>
+    /// to flush several destinations at once. </summary>
+    /// <remarks> Uses the system calls directly (no liburing). The ring is not created (<c>IsValid</c> returns false)
+    /// if the kernel does not support io_uring, if it is disabled, or if the kernel lacks the single mmap or the
+    /// current file position features (Linux 5.6), the caller then falls back to <c>writev</c>. Each write uses the
+    /// file's current position (offset -1), like <c>writev</c>. Not thread-safe, non-copyable. </remarks>
+    class IoUringWriter
+    {
+    public:
+        static constexpr unsigned RingEntries{ 32 };
+
+        /// <summary> A <c>writev</c> request, <c>Result</c> is set to the bytes written or to minus the error number
+        /// once <c>IsCompleted</c> is set. </summary>
+        struct WriteRequest
+        {
+            int Fd{ -1 };
+            const iovec* Buffers{};
+            unsigned BufferCount{};
+            std::int64_t Result{};
+            bool IsCompleted{};
+        };
+    private:
+        int m_ringFd{ -1 };
+        void* m_ringMemory{ MAP_FAILED };
+        std::size_t m_ringMemorySize{};
+        io_uring_sqe* m_submissionEntries{ static_cast<io_uring_sqe*>(MAP_FAILED) };
+        std::size_t m_submissionEntriesSize{};
+        unsigned* m_submissionTail{};
+        unsigned m_submissionMask{};
+        unsigned* m_submissionArray{};
+        unsigned* m_completionHead{};
+        unsigned* m_completionTail{};
+        unsigned m_completionMask{};
+        io_uring_cqe* m_completionEntries{};
+        unsigned m_entryCount{};
+        std::uint64_t m_enterCalls{};
+    public:
+        IoUringWriter()
+        {
+            io_uring_params params{};
+            const auto ringFd = ::syscall(__NR_io_uring_setup, RingEntries, &params);
+            if (ringFd < 0)
+                return;
+            m_ringFd = static_cast<int>(ringFd);
+            if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_RW_CUR_POS))
+            {
+                destroyRing();
+                return;
+            }
+            // The submission and completion rings share one mapping (IORING_FEAT_SINGLE_MMAP).
+            const std::size_t submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            const std::size_t completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            m_ringMemorySize = submissionRingSize > completionRingSize ? submissionRingSize : completionRingSize;
+            m_ringMemory = ::mmap(nullptr, m_ringMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+            m_submissionEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+            m_submissionEntries = static_cast<io_uring_sqe*>(::mmap(nullptr, m_submissionEntriesSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES));
+            if (m_ringMemory == MAP_FAILED || m_submissionEntries == MAP_FAILED)
+            {
+                destroyRing();
+                return;
+            }
+            auto* const ring = static_cast<char*>(m_ringMemory);
+            m_submissionTail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+            m_submissionMask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+            m_submissionArray = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+            m_completionHead = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+            m_completionTail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+            m_completionMask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+            m_completionEntries = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+            m_entryCount = params.sq_entries;
+        }
+        IoUringWriter(const IoUringWriter&) = delete;
+        IoUringWriter& operator=(const IoUringWriter&) = delete;
+        ~IoUringWriter()
+        {
+            destroyRing();
+        }
+    public:
+        /// <summary> Returns true if the ring was created, false if io_uring is not available. </summary>
+        [[nodiscard]] bool IsValid() const { return m_ringFd >= 0; }
+        /// <summary> Returns the number of requests that can be submitted at once. </summary>
+        [[nodiscard]] unsigned GetEntryCount() const { return m_entryCount; }
+        /// <summary> Returns the number of <c>io_uring_enter</c> calls made. </summary>
+        [[nodiscard]] std::uint64_t GetEnterCalls() const { return m_enterCalls; }
+
+        /// <summary> Submits the requests (at most <c>GetEntryCount</c>) and waits for all of them to complete, usually
+        /// with a single <c>io_uring_enter</c> call. </summary>
+        /// <returns> true if every request completed, false if the ring failed: the requests not completed were not
+        /// run, and the ring is no longer valid. </returns>
+        bool Write(const std::span<WriteRequest> requests)
+        {
+            const auto requestCount = static_cast<unsigned>(requests.size());
+            if (!IsValid() || requestCount > m_entryCount)
+                return false;
+            // Only this thread produces submissions, the tail is published to the kernel with release ordering.
+            unsigned tail = *m_submissionTail;
+            for (unsigned i = 0; i < requestCount; i++, tail++)
+            {
+                auto& request = requests[i];
+                request.IsCompleted = false;
+                const unsigned index = tail & m_submissionMask;
+                io_uring_sqe& entry = m_submissionEntries[index];
+                std::memset(&entry, 0, sizeof(entry));
+                entry.opcode = IORING_OP_WRITEV;
+                entry.fd = request.Fd;
+                entry.addr = reinterpret_cast<std::uint64_t>(request.Buffers);
+                entry.len = request.BufferCount;
+                entry.off = static_cast<std::uint64_t>(-1);
+                entry.user_data = i;
+                m_submissionArray[index] = index;
+            }
+            std::atomic_ref<unsigned>(*m_submissionTail).store(tail, std::memory_order_release);
+
+            unsigned submitted = 0;
+            unsigned completed = 0;
+            bool isRingFailed = false;
+            while (completed < submitted || (submitted < requestCount && !isRingFailed))
+            {
+                // Waits for all the writes, the kernel skips the wait if it submitted fewer than asked.
+                const unsigned toSubmit = isRingFailed ? 0 : requestCount - submitted;
+                const unsigned toComplete = (isRingFailed ? submitted : requestCount) - completed;
+                const auto entered = ::syscall(__NR_io_uring_enter, m_ringFd, toSubmit, toComplete, IORING_ENTER_GETEVENTS, nullptr, 0);
+                m_enterCalls++;
+                if (entered >= 0)
+                    submitted += static_cast<unsigned>(entered);
+                else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                {
+                    // Signals and transient errors are retried, after a hard error only the submitted writes are
+                    // waited for, and if waiting fails too closing the ring cancels them.
+                    if (isRingFailed)
+                        break;
+                    isRingFailed = true;
+                }
+                completed += reapCompletions(requests);
+            }
+            if (isRingFailed)
+            {
+                // Submissions left in the ring would run on a later call, with stale buffers.
+                destroyRing();
+                return false;
+            }
+            return true;
+        }
+    private:
+        unsigned reapCompletions(const std::span<WriteRequest> requests)
+        {
+            unsigned head = *m_completionHead;
+            const unsigned tail = std::atomic_ref<unsigned>(*m_completionTail).load(std::memory_order_acquire);
+            unsigned reaped = 0;
+            for (; head != tail; head++, reaped++)
+            {
+                const io_uring_cqe& entry = m_completionEntries[head & m_completionMask];
+                auto& request = requests[static_cast<std::size_t>(entry.user_data)];
+                request.Result = entry.res;
+                request.IsCompleted = true;
+            }
+            std::atomic_ref<unsigned>(*m_completionHead).store(head, std::memory_order_release);
+            return reaped;
+        }
+
+        void destroyRing()
+        {
+            if (m_submissionEntries != MAP_FAILED)
+                ::munmap(m_submissionEntries, m_submissionEntriesSize);
+            if (m_ringMemory != MAP_FAILED)
+                ::munmap(m_ringMemory, m_ringMemorySize);
+            if (m_ringFd >= 0)
+                ::close(m_ringFd);
+            m_submissionEntries = static_cast<io_uring_sqe*>(MAP_FAILED);
+            m_ringMemory = MAP_FAILED;
+            m_ringFd = -1;
+            m_entryCount = 0;
+        }
+    };
+}
+#endif
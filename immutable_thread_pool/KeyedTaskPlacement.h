@@ -0,0 +1,146 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <ranges>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ThreadTaskSource.h"
+
+namespace imp
+{
+    /// <summary> Places keyed tasks (e.g. keyed by tenant or shard) onto a set of units with jump consistent
+    /// hashing, so every task of a key runs on the same unit, and changing the number of units moves only the
+    /// minimal fraction of keys: growing from N to N+1 units moves about 1/(N+1) of them, all to the new unit. </summary>
+    /// <remarks> Units are added and removed at the end of the set (jump hashing numbers them 0..N-1). <c>ApplyTo</c>
+    /// rebuilds the task sources from the pushed tasks, and a unit runs copies of them, so state a task updates as it
+    /// runs is not carried to its new unit when it moves. Per-key state must be shared instead (e.g. the task captures
+    /// a shared_ptr to it), and a moved task then picks up where the old unit left off. <c>ApplyTo</c> only restarts
+    /// the units whose task list changed, so units with unmoved keys keep running. Copyable, Movable. </remarks>
+    class KeyedTaskPlacement
+    {
+    public:
+        using TaskInfo = ThreadTaskSource::TaskInfo;
+        struct KeyedTaskInfo
+        {
+            std::uint64_t Key;
+            TaskInfo Task;
+        };
+    private:
+        std::deque<KeyedTaskInfo> m_keyedTasks{};
+        // Unit of each task when last applied, and the number of units then.
+        std::vector<std::optional<std::size_t>> m_appliedUnits{};
+        std::size_t m_appliedUnitCount{};
+    public:
+        /// <summary> Push a function with zero or more arguments, but no return value, for the given key. </summary>
+        /// <typeparam name="F"> The type of the function. </typeparam>
+        /// <typeparam name="A"> The types of the arguments. </typeparam>
+        /// <param name="key"> The key, tasks with the same key are placed on the same unit. </param>
+        /// <param name="taskFn"> The function to push. </param>
+        /// <param name="args"> The arguments to pass to the function (by value). </param>
+        template <typename F, typename... A>
+        void PushKeyedTaskBack(const std::uint64_t key, const F& taskFn, const A&... args)
+        {
+            if constexpr (sizeof...(args) == 0)
+            {
+                m_keyedTasks.emplace_back(KeyedTaskInfo{ key, TaskInfo{taskFn} });
+            }
+            else
+            {
+                m_keyedTasks.emplace_back(KeyedTaskInfo{ key, TaskInfo([taskFn, args...] { taskFn(args...); }) });
+            }
+        }
+
+        /// <summary> Returns the keyed tasks, in push order. </summary>
+        [[nodiscard]] const std::deque<KeyedTaskInfo>& GetKeyedTasks() const { return m_keyedTasks; }
+
+        /// <summary> Returns the unit (0..unitCount-1) the key is placed on, unitCount must be non-zero. </summary>
+        [[nodiscard]]
+        static std::size_t GetUnitForKey(const std::uint64_t key, const std::size_t unitCount) noexcept
+        {
+            return static_cast<std::size_t>(JumpHash(key, static_cast<std::int64_t>(unitCount)));
+        }
+
+        /// <summary> Jump consistent hash (Lamping and Veach), maps a key to a bucket in [0, buckets). </summary>
+        [[nodiscard]]
+        static std::int64_t JumpHash(std::uint64_t key, const std::int64_t buckets) noexcept
+        {
+            std::int64_t bucket = -1;
+            std::int64_t nextBucket = 0;
+            while (nextBucket < buckets)
+            {
+                bucket = nextBucket;
+                key = key * 2862933555777941757ULL + 1;
+                nextBucket = static_cast<std::int64_t>(static_cast<double>(bucket + 1) * (static_cast<double>(1LL << 31) / static_cast<double>((key >> 33) + 1)));
+            }
+            return bucket;
+        }
+
+        /// <summary> Hashes a string key (FNV-1a, 64 bit), stable across processes unlike <c>std::hash</c>. </summary>
+        [[nodiscard]]
+        static constexpr std::uint64_t HashKey(const std::string_view key) noexcept
+        {
+            std::uint64_t hash = 14695981039346656037ULL;
+            for (const char keyChar : key)
+            {
+                hash ^= static_cast<unsigned char>(keyChar);
+                hash *= 1099511628211ULL;
+            }
+            return hash;
+        }
+
+        /// <summary> Makes the task source of each of <c>unitCount</c> units, tasks keep their push order. </summary>
+        [[nodiscard]]
+        auto MakeTaskSources(const std::size_t unitCount) const -> std::vector<ThreadTaskSource>
+        {
+            std::vector<ThreadTaskSource> taskSources(unitCount);
+            if (unitCount == 0)
+                return taskSources;
+            for (const auto& keyedTask : m_keyedTasks)
+                taskSources[GetUnitForKey(keyedTask.Key, unitCount)].TaskList.emplace_back(keyedTask.Task);
+            return taskSources;
+        }
+
+        /// <summary> Sets the task source of each unit to its placed tasks, restarting only the units whose
+        /// tasks changed since the last call (all of them on the first call). </summary>
+        /// <param name="units"> The units (e.g. a std::vector of <c>ThreadUnitPlusPlus</c>), the unit count is its size. </param>
+        /// <returns> The number of units restarted. </returns>
+        template<std::ranges::random_access_range Units_t>
+        std::size_t ApplyTo(Units_t& units)
+        {
+            const auto unitCount = static_cast<std::size_t>(std::ranges::size(units));
+            std::vector<bool> isUnitChanged(unitCount, false);
+            std::vector<std::optional<std::size_t>> placedUnits(m_keyedTasks.size());
+            for (std::size_t i = 0; i < m_keyedTasks.size() && unitCount > 0; i++)
+            {
+                placedUnits[i] = GetUnitForKey(m_keyedTasks[i].Key, unitCount);
+                const std::size_t placedUnit = *placedUnits[i];
+                const bool isApplied = i < m_appliedUnits.size() && m_appliedUnits[i].has_value();
+                const std::size_t appliedUnit = isApplied ? *m_appliedUnits[i] : placedUnit;
+                if (!isApplied || appliedUnit != placedUnit)
+                {
+                    isUnitChanged[placedUnit] = true;
+                    if (appliedUnit < unitCount)
+                        isUnitChanged[appliedUnit] = true;
+                }
+            }
+            // Units added since the last call start with their (possibly empty) task list.
+            for (std::size_t i = m_appliedUnitCount; i < unitCount; i++)
+                isUnitChanged[i] = true;
+            const auto taskSources = MakeTaskSources(unitCount);
+            std::size_t unitsRestarted = 0;
+            for (std::size_t i = 0; i < unitCount; i++)
+            {
+                if (!isUnitChanged[i])
+                    continue;
+                std::ranges::begin(units)[i].SetTaskSource(taskSources[i]);
+                unitsRestarted++;
+            }
+            m_appliedUnits = std::move(placedUnits);
+            m_appliedUnitCount = unitCount;
+            return unitsRestarted;
+        }
+    };
+}
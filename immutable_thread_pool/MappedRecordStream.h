@@ -0,0 +1,252 @@
+#pragma once
+#if defined(__unix__)
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ThreadTaskSource.h"
+
+namespace imp
+{
+    /// <summary> Streams the records of a file, or a rolling set of files, to a callback with no copying: the
+    /// current file is mapped with <c>mmap</c> and each record is handed over as a span of the mapping. The task made
+    /// by <c>MakeTask</c> delivers up to <c>MaxRecordsPerCall</c> records each time it runs (once per iteration
+    /// as an infinite task), and follows data appended to the file by remapping it when it grows. </summary>
+    /// <remarks> The mapping is advised <c>MADV_SEQUENTIAL</c>, and consumed pages are released with
+    /// <c>MADV_DONTNEED</c> as the stream advances. A record span is only valid during the callback.
+    /// The last file in the set is followed until another file is appended with <c>AppendFile</c>, then its
+    /// remaining bytes (a trailing partial record, if any) are delivered as its last record and the stream moves on.
+    /// Files must only be appended to, never truncated. A file that does not exist yet is retried each call.
+    /// Make one task per stream, it is not meant to run on two units at once. Copyable, Movable (copies share the stream). </remarks>
+    class MappedRecordStream
+    {
+    public:
+        using Record_t = std::span<const std::byte>;
+        using RecordFn_t = std::function<void(Record_t)>;
+        /// <summary> Returns the length of the first record of the unconsumed bytes, or zero if it is incomplete. </summary>
+        using RecordSplitFn_t = std::function<std::size_t(Record_t)>;
+        static constexpr std::size_t DefaultMaxRecordsPerCall{ 4096 };
+    private:
+        struct StreamState
+        {
+            RecordSplitFn_t SplitFn;
+            RecordFn_t RecordFn;
+            std::size_t MaxRecordsPerCall{};
+            // Files still to stream, the front file is the current one. Appended to by the controller.
+            std::mutex FilesMutex{};
+            std::deque<std::string> Files{};
+            // Mapping of the current file, only used by the task.
+            int Fd{ -1 };
+            const std::byte* Mapping{};
+            std::size_t MappedBytes{};
+            std::size_t Offset{};
+            std::size_t ReleasedOffset{};
+            // Statistics.
+            std::atomic<std::uint64_t> RecordsDelivered{ 0 };
+            std::atomic<std::uint64_t> BytesDelivered{ 0 };
+            std::atomic<std::uint64_t> FilesCompleted{ 0 };
+
+            ~StreamState()
+            {
+                CloseCurrent();
+            }
+
+            bool IsNextFileQueued()
+            {
+                std::lock_guard filesLock{ FilesMutex };
+                return Files.size() > 1;
+            }
+
+            bool OpenCurrent()
+            {
+                if (Fd >= 0)
+                    return true;
+                std::string path;
+                {
+                    std::lock_guard filesLock{ FilesMutex };
+                    if (Files.empty())
+                        return false;
+                    path = Files.front();
+                }
+                Fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                return Fd >= 0;
+            }
+
+            void CloseCurrent()
+            {
+                if (Mapping != nullptr)
+                    ::munmap(const_cast<std::byte*>(Mapping), MappedBytes);
+                if (Fd >= 0)
+                    ::close(Fd);
+                Fd = -1;
+                Mapping = nullptr;
+                MappedBytes = 0;
+                Offset = 0;
+                ReleasedOffset = 0;
+            }
+
+            // Extends the mapping to the current file size, returns true if it grew.
+            bool UpdateMapping()
+            {
+                struct stat fileStat{};
+                if (::fstat(Fd, &fileStat) != 0 || static_cast<std::size_t>(fileStat.st_size) <= MappedBytes)
+                    return false;
+                const auto fileBytes = static_cast<std::size_t>(fileStat.st_size);
+                void* newMapping = MAP_FAILED;
+#if defined(__linux__)
+                if (Mapping != nullptr)
+                    newMapping = ::mremap(const_cast<std::byte*>(Mapping), MappedBytes, fileBytes, MREMAP_MAYMOVE);
+                else
+                    newMapping = ::mmap(nullptr, fileBytes, PROT_READ, MAP_SHARED, Fd, 0);
+#else
+                newMapping = ::mmap(nullptr, fileBytes, PROT_READ, MAP_SHARED, Fd, 0);
+                if (newMapping != MAP_FAILED && Mapping != nullptr)
+                    ::munmap(const_cast<std::byte*>(Mapping), MappedBytes);
+#endif
+                if (newMapping == MAP_FAILED)
+                    return false;
+                Mapping = static_cast<const std::byte*>(newMapping);
+                MappedBytes = fileBytes;
+                ::madvise(newMapping, MappedBytes, MADV_SEQUENTIAL);
+                return true;
+            }
+
+            [[nodiscard]] Record_t Remaining() const
+            {
+                return Mapping != nullptr ? Record_t{ Mapping + Offset, MappedBytes - Offset } : Record_t{};
+            }
+
+            void Deliver(const Record_t record)
+            {
+                RecordFn(record);
+                Offset += record.size();
+                RecordsDelivered.fetch_add(1, std::memory_order_relaxed);
+                BytesDelivered.fetch_add(record.size(), std::memory_order_relaxed);
+            }
+
+            // Releases the whole pages before the offset, they are not read again.
+            void ReleaseConsumed()
+            {
+                static const auto PageBytes = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+                const std::size_t releaseEnd = Offset / PageBytes * PageBytes;
+                if (releaseEnd <= ReleasedOffset)
+                    return;
+                ::madvise(const_cast<std::byte*>(Mapping) + ReleasedOffset, releaseEnd - ReleasedOffset, MADV_DONTNEED);
+                ReleasedOffset = releaseEnd;
+            }
+
+            void FinishCurrent()
+            {
+                CloseCurrent();
+                {
+                    std::lock_guard filesLock{ FilesMutex };
+                    Files.pop_front();
+                }
+                FilesCompleted.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void Run()
+            {
+                if (!OpenCurrent())
+                    return;
+                UpdateMapping();
+                std::size_t recordsDelivered = 0;
+                while (recordsDelivered < MaxRecordsPerCall)
+                {
+                    const Record_t remaining = Remaining();
+                    if (remaining.empty())
+                        break;
+                    const std::size_t recordBytes = SplitFn(remaining);
+                    if (recordBytes == 0 || recordBytes > remaining.size())
+                        break;
+                    Deliver(remaining.first(recordBytes));
+                    recordsDelivered++;
+                }
+                if (Mapping != nullptr)
+                    ReleaseConsumed();
+                // Caught up with a file that has a successor, the writer has moved on. Pick up its last
+                // appends next call, or finish it now if there are none.
+                if (recordsDelivered < MaxRecordsPerCall && IsNextFileQueued() && !UpdateMapping())
+                {
+                    if (const Record_t remaining = Remaining(); !remaining.empty())
+                        Deliver(remaining);
+                    FinishCurrent();
+                }
+            }
+        };
+        using StatePtr_t = std::shared_ptr<StreamState>;
+    private:
+        StatePtr_t m_state{ std::make_shared<StreamState>() };
+    public:
+        /// <summary> Ctor. </summary>
+        /// <param name="files"> The files to stream, in order. The last one is followed for appended data. </param>
+        /// <param name="splitFn"> Finds the end of the first record, e.g. <c>FixedSizeRecords</c> or <c>DelimitedRecords</c>. </param>
+        /// <param name="recordFn"> Called with each record, on the unit's work thread. </param>
+        /// <param name="maxRecordsPerCall"> Most records delivered each time the task runs, bounds the task's duration. </param>
+        MappedRecordStream(std::vector<std::string> files, RecordSplitFn_t splitFn, RecordFn_t recordFn,
+            const std::size_t maxRecordsPerCall = DefaultMaxRecordsPerCall)
+        {
+            m_state->SplitFn = std::move(splitFn);
+            m_state->RecordFn = std::move(recordFn);
+            m_state->MaxRecordsPerCall = std::max<std::size_t>(maxRecordsPerCall, 1);
+            m_state->Files.assign(std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+        }
+    public:
+        /// <summary> Makes the task that streams the records, push it as an infinite task. </summary>
+        [[nodiscard]]
+        auto MakeTask() const -> ThreadTaskSource::TaskInfo
+        {
+            return [state = m_state]() { state->Run(); };
+        }
+
+        /// <summary> Appends a file to the rolling set, the stream moves on to it once the previous files are consumed. </summary>
+        void AppendFile(std::string path) const
+        {
+            std::lock_guard filesLock{ m_state->FilesMutex };
+            m_state->Files.emplace_back(std::move(path));
+        }
+
+        /// <summary> Returns the number of files not yet completely streamed, including the current one. </summary>
+        [[nodiscard]]
+        std::size_t GetPendingFileCount() const
+        {
+            std::lock_guard filesLock{ m_state->FilesMutex };
+            return m_state->Files.size();
+        }
+
+        [[nodiscard]] std::uint64_t GetRecordsDelivered() const { return m_state->RecordsDelivered.load(std::memory_order_relaxed); }
+        [[nodiscard]] std::uint64_t GetBytesDelivered() const { return m_state->BytesDelivered.load(std::memory_order_relaxed); }
+        [[nodiscard]] std::uint64_t GetFilesCompleted() const { return m_state->FilesCompleted.load(std::memory_order_relaxed); }
+
+        /// <summary> Record splitter for records of a fixed size in bytes. </summary>
+        [[nodiscard]]
+        static auto FixedSizeRecords(const std::size_t recordBytes) -> RecordSplitFn_t
+        {
+            return [recordBytes](const Record_t bytes) -> std::size_t { return recordBytes > 0 && bytes.size() >= recordBytes ? recordBytes : 0; };
+        }
+
+        /// <summary> Record splitter for records ending with a delimiter (included in the record), e.g. '\n' for lines. </summary>
+        [[nodiscard]]
+        static auto DelimitedRecords(const char delimiter = '\n') -> RecordSplitFn_t
+        {
+            return [delimiter](const Record_t bytes) -> std::size_t
+            {
+                const auto delimiterIt = std::find(bytes.begin(), bytes.end(), static_cast<std::byte>(delimiter));
+                return delimiterIt != bytes.end() ? static_cast<std::size_t>(delimiterIt - bytes.begin()) + 1 : 0;
+            };
+        }
+    };
+}
+#endif
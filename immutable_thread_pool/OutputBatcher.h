@@ -0,0 +1,300 @@
+#pragma once
+#if defined(__unix__)
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "IoUringWriter.h"
+
+namespace imp
+{
+    /// <summary> Batches the output of a unit's tasks, per destination file descriptor. The tasks append their
+    /// output buffers, and the batcher writes each destination's buffers with a single <c>writev</c> call (per
+    /// <c>MaxBuffersPerWrite</c> buffers) when flushed, instead of one <c>write</c> call per task. On Linux, when
+    /// several destinations have output, their writes are submitted together with io_uring (one
+    /// <c>io_uring_enter</c> call for all of them), falling back to <c>writev</c> if io_uring is not available. </summary>
+    /// <remarks> Flush it at the end of each iteration with an iteration end task, e.g.
+    /// <c>tasks.PushIterationEndTaskBack([batcher]() { batcher->Flush(); });</c> it is also flushed when the pending
+    /// output reaches the flush threshold, and on destruction. Output appended for a destination keeps its order.
+    /// Output a non-blocking destination can't take yet (<c>EAGAIN</c>) stays pending, from the first unwritten
+    /// byte, and is written by the next flush; output still pending on destruction is lost. A destination is
+    /// non-blocking if its fd has <c>O_NONBLOCK</c> set when its first output is appended, such destinations are
+    /// always written with <c>writev</c>, io_uring would wait for them.
+    /// Not thread-safe, share it only between the tasks of one unit (they run on the unit's work thread).
+    /// Non-copyable. </remarks>
+    class OutputBatcher
+    {
+    public:
+        static constexpr std::size_t DefaultFlushThreshold{ 64 * 1024 };
+#if defined(IOV_MAX)
+        static constexpr std::size_t MaxBuffersPerWrite{ IOV_MAX };
+#else
+        static constexpr std::size_t MaxBuffersPerWrite{ 16 };
+#endif
+    private:
+        struct Destination
+        {
+            int Fd{ -1 };
+            std::vector<std::string> Buffers{};
+            // The first buffer not completely written, and the bytes of it already written.
+            std::size_t FirstBuffer{};
+            std::size_t FirstOffset{};
+            // io_uring does not honour O_NONBLOCK (it waits for the fd), such a destination is written with writev.
+            bool IsNonBlocking{};
+            [[nodiscard]] bool IsPending() const { return FirstBuffer < Buffers.size(); }
+        };
+        enum class WriteStatus
+        {
+            Written,
+            Interrupted,
+            WouldBlock,
+            Failed
+        };
+    private:
+        std::vector<Destination> m_destinations{};
+        std::vector<iovec> m_writeVector{};
+        std::size_t m_flushThreshold{};
+        std::size_t m_pendingBytes{};
+        std::uint64_t m_writeCalls{};
+        std::uint64_t m_writeErrors{};
+#if defined(IMP_IO_URING_SUPPORTED)
+        std::unique_ptr<IoUringWriter> m_ioUring{};
+        std::vector<std::size_t> m_ringDestinations{};
+        std::vector<IoUringWriter::WriteRequest> m_ringRequests{};
+#endif
+    public:
+        /// <summary> Ctor. </summary>
+        /// <param name="flushThreshold"> Pending output size (in bytes) that triggers a flush from <c>Append</c>, zero to
+        /// only flush when <c>Flush</c> is called. </param>
+        /// <param name="isIoUringEnabled"> false to always write with <c>writev</c>, true to submit the writes of several
+        /// destinations with io_uring where it is available. </param>
+        explicit OutputBatcher(const std::size_t flushThreshold = DefaultFlushThreshold, [[maybe_unused]] const bool isIoUringEnabled = true)
+            : m_flushThreshold(flushThreshold)
+        {
+#if defined(IMP_IO_URING_SUPPORTED)
+            if (isIoUringEnabled)
+            {
+                m_ioUring = std::make_unique<IoUringWriter>();
+                if (!m_ioUring->IsValid())
+                    m_ioUring.reset();
+            }
+#endif
+        }
+        OutputBatcher(const OutputBatcher&) = delete;
+        OutputBatcher& operator=(const OutputBatcher&) = delete;
+        ~OutputBatcher()
+        {
+            Flush();
+        }
+    public:
+        /// <summary> Appends an output buffer for the destination <c>fd</c>, written on the next flush. </summary>
+        void Append(const int fd, std::string buffer)
+        {
+            if (buffer.empty())
+                return;
+            m_pendingBytes += buffer.size();
+            getDestination(fd).Buffers.emplace_back(std::move(buffer));
+            if (m_flushThreshold > 0 && m_pendingBytes >= m_flushThreshold)
+                Flush();
+        }
+
+        /// <summary> Writes all pending output, one <c>writev</c> call per destination (and per
+        /// <c>MaxBuffersPerWrite</c> buffers, and per partial write), or one io_uring submission for all of them. </summary>
+        /// <returns> true if all pending output was written. false if a destination would block, its unwritten output
+        /// stays pending (see <c>GetPendingBytes</c>), or if a write failed, the output of that destination is dropped
+        /// and counted by <c>GetWriteErrors</c>. </returns>
+        bool Flush()
+        {
+            bool isAllWritten = true;
+            bool isRingWritten = false;
+#if defined(IMP_IO_URING_SUPPORTED)
+            if (m_ioUring && m_ioUring->IsValid() && countRingDestinations() > 1)
+            {
+                isAllWritten = writeRing();
+                // If the ring failed the destinations it did not write are still pending, and written below.
+                // Non-blocking destinations are always written below.
+                isRingWritten = m_ioUring->IsValid();
+            }
+#endif
+            for (auto& destination : m_destinations)
+            {
+                if (destination.IsPending() && (!isRingWritten || destination.IsNonBlocking))
+                    isAllWritten = writeBuffers(destination) && isAllWritten;
+                // Releases the written buffers, the unwritten tail stays pending.
+                destination.Buffers.erase(destination.Buffers.begin(), destination.Buffers.begin() + static_cast<std::ptrdiff_t>(destination.FirstBuffer));
+                destination.FirstBuffer = 0;
+            }
+            return isAllWritten;
+        }
+
+        /// <summary> Returns the size (in bytes) of the output not written yet. </summary>
+        [[nodiscard]] std::size_t GetPendingBytes() const { return m_pendingBytes; }
+        /// <summary> Returns the flush threshold, zero if the batcher is only flushed explicitly. </summary>
+        [[nodiscard]] std::size_t GetFlushThreshold() const { return m_flushThreshold; }
+        /// <summary> Returns the number of write system calls made, <c>writev</c> and <c>io_uring_enter</c>. </summary>
+        [[nodiscard]] std::uint64_t GetWriteCalls() const
+        {
+#if defined(IMP_IO_URING_SUPPORTED)
+            if (m_ioUring)
+                return m_writeCalls + m_ioUring->GetEnterCalls();
+#endif
+            return m_writeCalls;
+        }
+        /// <summary> Returns the number of failed writes, their destination's pending output was dropped. </summary>
+        [[nodiscard]] std::uint64_t GetWriteErrors() const { return m_writeErrors; }
+        /// <summary> Returns true if the writes of several destinations are submitted with io_uring. </summary>
+        [[nodiscard]] bool IsIoUringActive() const
+        {
+#if defined(IMP_IO_URING_SUPPORTED)
+            return m_ioUring && m_ioUring->IsValid();
+#else
+            return false;
+#endif
+        }
+    private:
+        Destination& getDestination(const int fd)
+        {
+            // Units write to few destinations, a linear search beats a map here.
+            for (auto& destination : m_destinations)
+            {
+                if (destination.Fd == fd)
+                    return destination;
+            }
+            auto& destination = m_destinations.emplace_back(Destination{ fd });
+            const int statusFlags = ::fcntl(fd, F_GETFL);
+            destination.IsNonBlocking = statusFlags >= 0 && (statusFlags & O_NONBLOCK) != 0;
+            return destination;
+        }
+
+        // Appends the destination's unwritten buffers (at most MaxBuffersPerWrite) to the write vector, returns their count.
+        std::size_t fillWriteVector(const Destination& destination)
+        {
+            const auto& buffers = destination.Buffers;
+            std::size_t count = 0;
+            for (std::size_t i = destination.FirstBuffer; i < buffers.size() && count < MaxBuffersPerWrite; i++, count++)
+            {
+                const std::size_t offset = i == destination.FirstBuffer ? destination.FirstOffset : 0;
+                m_writeVector.emplace_back(iovec{ const_cast<char*>(buffers[i].data() + offset), buffers[i].size() - offset });
+            }
+            return count;
+        }
+
+        // Applies the result of a write to the destination: advances past the written bytes (a partial write continues
+        // from within a buffer), keeps the output pending if the destination would block, drops it on an error.
+        WriteStatus applyWriteResult(Destination& destination, const ssize_t written, const int error)
+        {
+            if (written > 0)
+            {
+                m_pendingBytes -= static_cast<std::size_t>(written);
+                auto remaining = static_cast<std::size_t>(written);
+                while (remaining > 0)
+                {
+                    const std::size_t bufferRemaining = destination.Buffers[destination.FirstBuffer].size() - destination.FirstOffset;
+                    if (remaining < bufferRemaining)
+                    {
+                        destination.FirstOffset += remaining;
+                        break;
+                    }
+                    remaining -= bufferRemaining;
+                    destination.FirstBuffer++;
+                    destination.FirstOffset = 0;
+                }
+                return WriteStatus::Written;
+            }
+            if (written < 0 && error == EINTR)
+                return WriteStatus::Interrupted;
+            if (written == 0 || error == EAGAIN || error == EWOULDBLOCK)
+                return WriteStatus::WouldBlock;
+            m_writeErrors++;
+            for (std::size_t i = destination.FirstBuffer; i < destination.Buffers.size(); i++)
+                m_pendingBytes -= destination.Buffers[i].size() - (i == destination.FirstBuffer ? destination.FirstOffset : 0);
+            destination.FirstBuffer = destination.Buffers.size();
+            destination.FirstOffset = 0;
+            return WriteStatus::Failed;
+        }
+
+        bool writeBuffers(Destination& destination)
+        {
+            while (destination.IsPending())
+            {
+                m_writeVector.clear();
+                const std::size_t count = fillWriteVector(destination);
+                const ssize_t written = ::writev(destination.Fd, m_writeVector.data(), static_cast<int>(count));
+                m_writeCalls++;
+                const auto status = applyWriteResult(destination, written, errno);
+                if (status == WriteStatus::WouldBlock || status == WriteStatus::Failed)
+                    return false;
+            }
+            return true;
+        }
+
+#if defined(IMP_IO_URING_SUPPORTED)
+        std::size_t countRingDestinations() const
+        {
+            std::size_t count = 0;
+            for (const auto& destination : m_destinations)
+                count += destination.IsPending() && !destination.IsNonBlocking ? 1 : 0;
+            return count;
+        }
+
+        // Submits one writev per pending (blocking) destination with io_uring per round, a destination partially written
+        // continues in the next round.
+        bool writeRing()
+        {
+            bool isAllWritten = true;
+            m_ringDestinations.clear();
+            for (std::size_t i = 0; i < m_destinations.size(); i++)
+            {
+                if (m_destinations[i].IsPending() && !m_destinations[i].IsNonBlocking)
+                    m_ringDestinations.emplace_back(i);
+            }
+            while (!m_ringDestinations.empty() && m_ioUring->IsValid())
+            {
+                const std::size_t chunkSize = std::min<std::size_t>(m_ringDestinations.size(), m_ioUring->GetEntryCount());
+                // The write vector is filled first, its buffer is only stable once all the chunk's iovecs are in it.
+                m_writeVector.clear();
+                m_ringRequests.clear();
+                for (std::size_t i = 0; i < chunkSize; i++)
+                {
+                    const auto& destination = m_destinations[m_ringDestinations[i]];
+                    m_ringRequests.emplace_back(IoUringWriter::WriteRequest{ destination.Fd, nullptr, static_cast<unsigned>(fillWriteVector(destination)) });
+                }
+                const iovec* buffers = m_writeVector.data();
+                for (auto& request : m_ringRequests)
+                {
+                    request.Buffers = buffers;
+                    buffers += request.BufferCount;
+                }
+                m_ioUring->Write(m_ringRequests);
+                std::size_t kept = 0;
+                for (std::size_t i = 0; i < m_ringDestinations.size(); i++)
+                {
+                    auto& destination = m_destinations[m_ringDestinations[i]];
+                    bool isKept = i >= chunkSize || !m_ringRequests[i].IsCompleted;
+                    if (!isKept)
+                    {
+                        const auto result = m_ringRequests[i].Result;
+                        const auto status = applyWriteResult(destination, result >= 0 ? static_cast<ssize_t>(result) : -1, result >= 0 ? 0 : static_cast<int>(-result));
+                        const bool isWriting = status == WriteStatus::Written || status == WriteStatus::Interrupted;
+                        isAllWritten = isAllWritten && isWriting;
+                        isKept = isWriting && destination.IsPending();
+                    }
+                    if (isKept)
+                        m_ringDestinations[kept++] = m_ringDestinations[i];
+                }
+                m_ringDestinations.resize(kept);
+            }
+            return isAllWritten;
+        }
+#endif
+    };
+}
+#endif
@@ -0,0 +1,219 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include "ThreadTaskSource.h"
+
+namespace imp
+{
+    /// <summary> Version of the plugin descriptor layout, a plugin built against a different version is rejected. </summary>
+    inline constexpr std::uint32_t TaskPluginApiVersion{ 1 };
+
+    /// <summary> Signature of a task implementation exported by a plugin. The context is owned by the host,
+    /// so warm state kept there survives a swap to a newly loaded version of the task. </summary>
+    using TaskPluginRunFn_t = void(*)(void* context);
+
+    /// <summary> Descriptor returned by the plugin's versioned entry point <c>imp_task_plugin_v1</c>. </summary>
+    struct TaskPluginDescriptor
+    {
+        // Must equal TaskPluginApiVersion.
+        std::uint32_t ApiVersion;
+        // Version of the task implementations in this library, reported to the host.
+        std::uint32_t PluginVersion;
+        // Returns the task implementation with the given name, or nullptr if there is none.
+        TaskPluginRunFn_t(*FindTask)(const char* taskName);
+    };
+}
+
+/// <summary> Defines the versioned entry point of a task plugin, use once in the plugin library.
+/// <c>findTaskFn</c> is a function <c>imp::TaskPluginRunFn_t(const char*)</c>. </summary>
+#define IMP_DEFINE_TASK_PLUGIN(pluginVersion, findTaskFn) \
+    extern "C" const imp::TaskPluginDescriptor* imp_task_plugin_v1() \
+    { \
+        static const imp::TaskPluginDescriptor descriptor{ imp::TaskPluginApiVersion, (pluginVersion), (findTaskFn) }; \
+        return &descriptor; \
+    }
+
+#if defined(__unix__)
+#include <dlfcn.h>
+
+namespace imp
+{
+    /// <summary> A loaded task plugin library, it is unloaded when the last reference is released. A built-in
+    /// plugin (linked into the host) has no library handle. </summary>
+    /// <remarks> Non-copyable, non-movable, held by shared_ptr. </remarks>
+    class TaskPluginLibrary
+    {
+        void* m_libraryHandle{};
+        const TaskPluginDescriptor* m_descriptor{};
+        std::string m_path{};
+    public:
+        TaskPluginLibrary(void* libraryHandle, const TaskPluginDescriptor* descriptor, std::string path)
+            : m_libraryHandle(libraryHandle), m_descriptor(descriptor), m_path(std::move(path))
+        {
+        }
+        ~TaskPluginLibrary()
+        {
+            if (m_libraryHandle != nullptr)
+                dlclose(m_libraryHandle);
+        }
+        TaskPluginLibrary(const TaskPluginLibrary&) = delete;
+        TaskPluginLibrary& operator=(const TaskPluginLibrary&) = delete;
+    public:
+        [[nodiscard]] std::uint32_t GetPluginVersion() const { return m_descriptor->PluginVersion; }
+        [[nodiscard]] const std::string& GetPath() const { return m_path; }
+        [[nodiscard]] TaskPluginRunFn_t FindTask(const std::string& taskName) const { return m_descriptor->FindTask(taskName.c_str()); }
+    };
+
+    /// <summary> The plugin version run by the plugin tasks of one unit. It swaps to the newest loaded version only
+    /// in its iteration end task, so every task of an iteration runs the same version. </summary>
+    /// <remarks> Made by <c>TaskPluginLoader::MakeLatch</c>, and used by the work thread of the one unit running its
+    /// tasks, so it needs no locking. Non-copyable, non-movable, held by shared_ptr. </remarks>
+    class TaskPluginLatch
+    {
+        friend class TaskPluginLoader;
+        std::shared_ptr<const TaskPluginLibrary> m_plugin{};
+        // Generation of the loader when m_plugin was latched, tasks compare it to their cached value.
+        std::uint64_t m_generation{ 0 };
+    public:
+        TaskPluginLatch() = default;
+        TaskPluginLatch(const TaskPluginLatch&) = delete;
+        TaskPluginLatch& operator=(const TaskPluginLatch&) = delete;
+    public:
+        /// <summary> Returns the plugin the tasks run this iteration, or nullptr if none was loaded. </summary>
+        [[nodiscard]] const std::shared_ptr<const TaskPluginLibrary>& GetPlugin() const { return m_plugin; }
+    };
+    using TaskPluginLatchPtr_t = std::shared_ptr<TaskPluginLatch>;
+
+    /// <summary> Loads task implementations from shared library plugins, and makes tasks that swap to the newest
+    /// loaded version of their implementation at the unit's iteration boundary. The tasks of a unit share a
+    /// <c>TaskPluginLatch</c>, whose iteration end task latches the version for the next iteration, so an
+    /// iteration never mixes versions and a task never changes version part way through a call. </summary>
+    /// <remarks> The previous library is unloaded once no latch references it anymore. A latch on a paused or
+    /// destroyed unit keeps its reference until its unit completes an iteration or it is destroyed. A failed load
+    /// leaves the current version running.
+    /// The dynamic loader returns the already loaded library for a path it has seen, so each new version
+    /// must be loaded from a distinct path (e.g. <c>libtasks.so.2</c>). Copyable, Movable (copies share the plugin). </remarks>
+    /// <code>
+    /// auto latch = loader.MakeLatch();
+    /// tasks.PushInfiniteTaskBack(loader.MakeTask(latch, "parse"));
+    /// tasks.PushInfiniteTaskBack(loader.MakeTask(latch, "publish"));
+    /// tasks.PushIterationEndTaskBack(loader.MakeLatchTask(latch));
+    /// </code>
+    class TaskPluginLoader
+    {
+        struct LoaderState
+        {
+            std::mutex PluginMutex{};
+            std::shared_ptr<const TaskPluginLibrary> CurrentPlugin{};
+            // Incremented each time a new plugin is published, latches compare it to their latched value.
+            std::atomic<std::uint64_t> Generation{ 0 };
+        };
+        using StatePtr_t = std::shared_ptr<LoaderState>;
+    private:
+        StatePtr_t m_state{ std::make_shared<LoaderState>() };
+    public:
+        /// <summary> Loads the plugin library at <c>libraryPath</c> and publishes it as the current version. </summary>
+        /// <returns> true on success, false if the library could not be loaded or has no compatible entry point. </returns>
+        bool Load(const std::string& libraryPath)
+        {
+            void* libraryHandle = dlopen(libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+            if (libraryHandle == nullptr)
+                return false;
+            using EntryPoint_t = const TaskPluginDescriptor* (*)();
+            const auto entryPoint = reinterpret_cast<EntryPoint_t>(dlsym(libraryHandle, "imp_task_plugin_v1"));
+            const TaskPluginDescriptor* descriptor = entryPoint != nullptr ? entryPoint() : nullptr;
+            if (!isCompatible(descriptor))
+            {
+                dlclose(libraryHandle);
+                return false;
+            }
+            publish(std::make_shared<const TaskPluginLibrary>(libraryHandle, descriptor, libraryPath));
+            return true;
+        }
+
+        /// <summary> Publishes task implementations linked into the host as the current version, e.g. the
+        /// version used until a plugin is loaded, or to fall back to. </summary>
+        /// <returns> true on success, false if the descriptor is not compatible. </returns>
+        bool LoadBuiltIn(const TaskPluginDescriptor* descriptor, std::string name)
+        {
+            if (!isCompatible(descriptor))
+                return false;
+            publish(std::make_shared<const TaskPluginLibrary>(nullptr, descriptor, std::move(name)));
+            return true;
+        }
+
+        /// <summary> Returns the current plugin library, or nullptr if none is loaded. </summary>
+        [[nodiscard]]
+        std::shared_ptr<const TaskPluginLibrary> GetCurrentPlugin() const
+        {
+            std::lock_guard pluginLock{ m_state->PluginMutex };
+            return m_state->CurrentPlugin;
+        }
+
+        /// <summary> Makes a latch for the plugin tasks of one unit, latched to the current plugin. </summary>
+        [[nodiscard]]
+        TaskPluginLatchPtr_t MakeLatch() const
+        {
+            auto latch = std::make_shared<TaskPluginLatch>();
+            updateLatch(*latch);
+            return latch;
+        }
+
+        /// <summary> Makes the iteration end task of a latch, it latches a newly loaded version for the next iteration. </summary>
+        [[nodiscard]]
+        auto MakeLatchTask(TaskPluginLatchPtr_t latch) const -> ThreadTaskSource::TaskInfo
+        {
+            return [loader = *this, latch = std::move(latch)]()
+            {
+                if (loader.m_state->Generation.load(std::memory_order_acquire) != latch->m_generation)
+                    loader.updateLatch(*latch);
+            };
+        }
+
+        /// <summary> Makes a task that runs the named implementation from the latched plugin. The task does nothing
+        /// while the latched plugin lacks the name. </summary>
+        /// <param name="latch"> Latch shared by the plugin tasks of the unit, its task must be in the unit's iteration end tasks. </param>
+        /// <param name="taskName"> Name of the task implementation in the plugin. </param>
+        /// <param name="context"> Host owned state passed to every version of the implementation, kept alive by the task. </param>
+        [[nodiscard]]
+        auto MakeTask(TaskPluginLatchPtr_t latch, std::string taskName, std::shared_ptr<void> context = {}) const -> ThreadTaskSource::TaskInfo
+        {
+            return [latch = std::move(latch), taskName = std::move(taskName), context = std::move(context),
+                runFn = TaskPluginRunFn_t{}, generation = std::uint64_t{ 0 }]() mutable
+            {
+                // The latch keeps the library of runFn loaded, it only changes between iterations.
+                if (latch->m_generation != generation)
+                {
+                    generation = latch->m_generation;
+                    runFn = latch->m_plugin != nullptr ? latch->m_plugin->FindTask(taskName) : nullptr;
+                }
+                if (runFn != nullptr)
+                    runFn(context.get());
+            };
+        }
+    private:
+        static bool isCompatible(const TaskPluginDescriptor* descriptor)
+        {
+            return descriptor != nullptr && descriptor->ApiVersion == TaskPluginApiVersion && descriptor->FindTask != nullptr;
+        }
+
+        void publish(std::shared_ptr<const TaskPluginLibrary> plugin) const
+        {
+            std::lock_guard pluginLock{ m_state->PluginMutex };
+            m_state->CurrentPlugin = std::move(plugin);
+            m_state->Generation.fetch_add(1, std::memory_order_release);
+        }
+
+        void updateLatch(TaskPluginLatch& latch) const
+        {
+            std::lock_guard pluginLock{ m_state->PluginMutex };
+            latch.m_plugin = m_state->CurrentPlugin;
+            latch.m_generation = m_state->Generation.load(std::memory_order_relaxed);
+        }
+    };
+}
+#endif
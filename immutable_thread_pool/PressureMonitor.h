@@ -0,0 +1,190 @@
+#pragma once
+#if defined(__linux__)
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "UnitThrottle.h"
+
+namespace imp
+{
+    /// <summary> One resource's pressure stall information, the share of time (percent) in which some (or all)
+    /// non-idle tasks were stalled on the resource, averaged over 10 and 60 seconds. </summary>
+    struct PressureStats
+    {
+        double SomeAvg10{};
+        double SomeAvg60{};
+        double FullAvg10{};
+        double FullAvg60{};
+    };
+
+    /// <summary> Pressure thresholds (percent, of the "some" 10 second average) for one throttle. </summary>
+    struct PressureThresholds
+    {
+        /// <summary> Slow the units at or above this pressure. </summary>
+        double SlowAbove{ 20.0 };
+        /// <summary> Pause the units at or above this pressure. </summary>
+        double PauseAbove{ 50.0 };
+        /// <summary> A level is left only once the pressure is this far below its threshold, so it does not flap. </summary>
+        double Hysteresis{ 5.0 };
+    };
+
+    /// <summary> Options of a <c>PressureMonitor</c>, the host's pressure files by default. </summary>
+    struct PressureMonitorOptions
+    {
+        std::string CpuPressurePath{ "/proc/pressure/cpu" };
+        std::string MemoryPressurePath{ "/proc/pressure/memory" };
+        /// <summary> How often the pressure is read, zero to only update it with <c>Update</c>. </summary>
+        std::chrono::milliseconds PollInterval{ 1000 };
+
+        /// <summary> Options reading the pressure of a cgroup (v2), e.g. "/sys/fs/cgroup/system.slice/app.service". </summary>
+        [[nodiscard]]
+        static PressureMonitorOptions ForCgroup(const std::string& cgroupDirectory)
+        {
+            PressureMonitorOptions options{};
+            options.CpuPressurePath = cgroupDirectory + "/cpu.pressure";
+            options.MemoryPressurePath = cgroupDirectory + "/memory.pressure";
+            return options;
+        }
+    };
+
+    /// <summary> Monitors Linux pressure stall information (PSI) for CPU and memory, and sets the level of the
+    /// registered <c>UnitThrottle</c>s from it: background units using a throttle are slowed, then paused, as
+    /// pressure crosses the throttle's thresholds, and resumed when it subsides. </summary>
+    /// <remarks> The pressure is the larger of the CPU and memory "some" 10 second averages. To shrink a set of
+    /// units rather than pause all of it, give part of the set its own throttle with lower thresholds.
+    /// Polls on its own thread. Non-copyable, non-movable. </remarks>
+    class PressureMonitor
+    {
+        struct ThrottleEntry
+        {
+            std::shared_ptr<UnitThrottle> Throttle;
+            PressureThresholds Thresholds;
+        };
+    private:
+        PressureMonitorOptions m_options{};
+        std::mutex m_throttlesMutex{};
+        std::vector<ThrottleEntry> m_throttles{};
+        std::optional<double> m_lastPressure{};
+        std::jthread m_pollThread{};
+    public:
+        explicit PressureMonitor(PressureMonitorOptions options = {})
+            : m_options(std::move(options))
+        {
+            if (m_options.PollInterval > std::chrono::milliseconds::zero())
+                m_pollThread = std::jthread{ [this](const std::stop_token stopToken) { pollPressure(stopToken); } };
+        }
+        PressureMonitor(const PressureMonitor&) = delete;
+        PressureMonitor& operator=(const PressureMonitor&) = delete;
+        ~PressureMonitor()
+        {
+            m_pollThread = {};
+        }
+    public:
+        /// <summary> Registers a throttle, its level is set from the pressure from the next update on. </summary>
+        void AddThrottle(std::shared_ptr<UnitThrottle> throttle, const PressureThresholds thresholds = {})
+        {
+            std::lock_guard throttlesLock{ m_throttlesMutex };
+            m_throttles.emplace_back(ThrottleEntry{ std::move(throttle), thresholds });
+        }
+
+        /// <summary> Returns the pressure of the last update, empty if none could be read yet. </summary>
+        [[nodiscard]]
+        std::optional<double> GetLastPressure()
+        {
+            std::lock_guard throttlesLock{ m_throttlesMutex };
+            return m_lastPressure;
+        }
+
+        /// <summary> Sets the level of every registered throttle from <c>pressure</c> (percent). Called by the poll
+        /// thread, or directly when polling is disabled. </summary>
+        void Update(const double pressure)
+        {
+            std::lock_guard throttlesLock{ m_throttlesMutex };
+            m_lastPressure = pressure;
+            for (const auto& [throttle, thresholds] : m_throttles)
+                throttle->SetLevel(GetThrottleLevel(throttle->GetLevel(), pressure, thresholds));
+        }
+
+        /// <summary> Returns the throttle level for <c>pressure</c>, leaving the current level only past its hysteresis. </summary>
+        [[nodiscard]]
+        static UnitThrottle::Level GetThrottleLevel(const UnitThrottle::Level currentLevel, const double pressure, const PressureThresholds& thresholds)
+        {
+            using Level = UnitThrottle::Level;
+            if (pressure >= thresholds.PauseAbove)
+                return Level::Pause;
+            if (currentLevel == Level::Pause && pressure >= thresholds.PauseAbove - thresholds.Hysteresis)
+                return Level::Pause;
+            if (pressure >= thresholds.SlowAbove)
+                return Level::Slow;
+            if (currentLevel != Level::None && pressure >= thresholds.SlowAbove - thresholds.Hysteresis)
+                return Level::Slow;
+            return Level::None;
+        }
+
+        /// <summary> Reads a PSI file (e.g. /proc/pressure/cpu), empty if it cannot be read (no PSI support). </summary>
+        [[nodiscard]]
+        static std::optional<PressureStats> ReadPressureFile(const std::string& path)
+        {
+            std::FILE* pressureFile = std::fopen(path.c_str(), "r");
+            if (pressureFile == nullptr)
+                return {};
+            PressureStats stats{};
+            bool isSomeRead = false;
+            char kind[8]{};
+            double avg10{}, avg60{}, avg300{};
+            unsigned long long total{};
+            while (std::fscanf(pressureFile, "%7s avg10=%lf avg60=%lf avg300=%lf total=%llu", kind, &avg10, &avg60, &avg300, &total) == 5)
+            {
+                if (std::string_view{ kind } == "some")
+                {
+                    stats.SomeAvg10 = avg10;
+                    stats.SomeAvg60 = avg60;
+                    isSomeRead = true;
+                }
+                else if (std::string_view{ kind } == "full")
+                {
+                    stats.FullAvg10 = avg10;
+                    stats.FullAvg60 = avg60;
+                }
+            }
+            std::fclose(pressureFile);
+            return isSomeRead ? std::optional{ stats } : std::nullopt;
+        }
+
+        /// <summary> Reads the pressure used for throttling, the larger of the CPU and memory "some" 10 second
+        /// averages, empty if neither can be read. </summary>
+        [[nodiscard]]
+        std::optional<double> ReadPressure() const
+        {
+            const auto cpuStats = ReadPressureFile(m_options.CpuPressurePath);
+            const auto memoryStats = ReadPressureFile(m_options.MemoryPressurePath);
+            if (!cpuStats.has_value() && !memoryStats.has_value())
+                return {};
+            return std::max(cpuStats ? cpuStats->SomeAvg10 : 0.0, memoryStats ? memoryStats->SomeAvg10 : 0.0);
+        }
+    private:
+        void pollPressure(const std::stop_token stopToken)
+        {
+            std::mutex pollMutex;
+            std::condition_variable_any pollCv;
+            std::unique_lock pollLock{ pollMutex };
+            while (!stopToken.stop_requested())
+            {
+                if (const auto pressure = ReadPressure(); pressure.has_value())
+                    Update(*pressure);
+                pollCv.wait_for(pollLock, stopToken, m_options.PollInterval, []() { return false; });
+            }
+        }
+    };
+}
+#endif
@@ -0,0 +1,417 @@
+#pragma once
+#if defined(__linux__)
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cerrno>
+#include <climits>
+#include <new>
+#include <string_view>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ThreadTaskSource.h"
+#include "ThreadUnitPlusPlus.h"
+
+namespace imp
+{
+    /// <summary> Control block placed in memory shared between a host process and one worker process.
+    /// The pause/stop words are process-shared futexes, so the control path needs no IPC round trips. </summary>
+    /// <remarks> Only lock-free 32/64 bit atomics are used, they are address-free and valid across processes. </remarks>
+    struct ProcessControlBlock
+    {
+        using Word_t = std::atomic<std::uint32_t>;
+        using Counter_t = std::atomic<std::uint64_t>;
+        static_assert(Word_t::is_always_lock_free && sizeof(Word_t) == sizeof(std::uint32_t));
+        static_assert(Counter_t::is_always_lock_free);
+    public:
+        // Written by the host only, the worker never clears a request (it would race a new one).
+        Word_t OrderedPause{ 0 };
+        Word_t UnorderedPause{ 0 };
+        Word_t StopRequested{ 0 };
+        // Incremented by the host on every change to the words above, the worker waits on this futex.
+        Word_t ControlSequence{ 0 };
+        // Written by the worker, the host waits on this futex. Once every unit of the worker has paused, the control
+        // sequence the pause was completed at plus one, so a completion is not taken for a later request. Zero otherwise.
+        alignas(64) Word_t PauseCompleted{ 0 };
+        Word_t NumberOfTasks{ 0 };
+        // Iterations completed by the units of the worker, summed over the units.
+        alignas(64) Counter_t Heartbeat{ 0 };
+        // CLOCK_MONOTONIC time of the last heartbeat in nanoseconds, comparable across processes.
+        Counter_t HeartbeatTimeNs{ 0 };
+        // Infinite tasks (TaskList) run by the units of the worker, counted as each iteration ends.
+        Counter_t TasksRun{ 0 };
+    public:
+        /// <summary> Waits while <c>word</c> holds <c>expected</c>, or until woken or <c>timeout</c> elapses. </summary>
+        static void FutexWait(Word_t& word, const std::uint32_t expected, const std::chrono::nanoseconds timeout)
+        {
+            const timespec ts{
+                static_cast<time_t>(timeout.count() / 1'000'000'000),
+                static_cast<long>(timeout.count() % 1'000'000'000) };
+            syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+        }
+        /// <summary> Wakes every process waiting on <c>word</c>. </summary>
+        static void FutexWakeAll(Word_t& word)
+        {
+            syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        }
+        /// <summary> CLOCK_MONOTONIC now, in nanoseconds. </summary>
+        static std::uint64_t MonotonicNowNs()
+        {
+            timespec ts{};
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000ull + static_cast<std::uint64_t>(ts.tv_nsec);
+        }
+    public:
+        /// <summary> Host side, sets a control word and wakes the worker. </summary>
+        void UpdateControl(Word_t& word, const bool isEnabled)
+        {
+            word.store(isEnabled ? 1u : 0u);
+            ControlSequence.fetch_add(1);
+            FutexWakeAll(ControlSequence);
+        }
+        [[nodiscard]] bool IsPauseRequested() const { return OrderedPause.load() != 0 || UnorderedPause.load() != 0; }
+        [[nodiscard]] bool IsStopRequested() const { return StopRequested.load() != 0; }
+        [[nodiscard]] bool IsPauseCompleted() const { return PauseCompleted.load() == ControlSequence.load() + 1; }
+    };
+
+    /// <summary> Handle to a worker process running a named task set (or group of them), controlled through a shared
+    /// <c>ProcessControlBlock</c> with the same semantics as <c>ThreadUnitPlusPlus</c>. </summary>
+    /// <remarks> The worker process runs a <c>ThreadUnitPlusPlus</c> per task source of the set, so all of its task
+    /// lists run as they would in the host. A pause completes once every unit of the worker has paused.
+    /// Non-copyable, <b>is moveable! (move-construct and move-assign)</b></remarks>
+    class ProcessUnit
+    {
+        friend class ProcessUnitHost;
+        /// <summary> Constant used as the poll period for checking the worker process is still alive while waiting,
+        /// and by the worker for checking its host process is still alive. </summary>
+        static constexpr std::chrono::milliseconds EmptyWaitTime{ std::chrono::milliseconds(20) };
+        /// <summary> Constant used by the worker as the poll period for its units completing a requested pause. </summary>
+        static constexpr std::chrono::milliseconds PausePollTime{ std::chrono::milliseconds(1) };
+    private:
+        // Control block in the shared mapping, nullptr if there is no worker process.
+        ProcessControlBlock* m_controlBlock{};
+        // Worker process id, -1 after it has been reaped.
+        pid_t m_workerPid{ -1 };
+        // Name of the task set the worker process is running.
+        std::string m_taskSetName{};
+        // Wait status of the worker process once reaped.
+        int m_exitStatus{};
+    private:
+        ProcessUnit(ProcessControlBlock* controlBlock, const pid_t workerPid, std::string taskSetName)
+            : m_controlBlock(controlBlock), m_workerPid(workerPid), m_taskSetName(std::move(taskSetName))
+        {
+        }
+    public:
+        ~ProcessUnit()
+        {
+            DestroyThread();
+        }
+        ProcessUnit(ProcessUnit&& other) noexcept
+            : m_controlBlock(std::exchange(other.m_controlBlock, nullptr)),
+              m_workerPid(std::exchange(other.m_workerPid, -1)),
+              m_taskSetName(std::move(other.m_taskSetName)),
+              m_exitStatus(other.m_exitStatus)
+        {
+        }
+        ProcessUnit& operator=(ProcessUnit&& other) noexcept
+        {
+            if (this == &other)
+                return *this;
+            DestroyThread();
+            m_controlBlock = std::exchange(other.m_controlBlock, nullptr);
+            m_workerPid = std::exchange(other.m_workerPid, -1);
+            m_taskSetName = std::move(other.m_taskSetName);
+            m_exitStatus = other.m_exitStatus;
+            return *this;
+        }
+        ProcessUnit(const ProcessUnit&) = delete;
+        ProcessUnit& operator=(const ProcessUnit&) = delete;
+    public:
+        /// <summary> Pause after the in-process task list iteration completes. See <c>ThreadUnitPlusPlus</c>. </summary>
+        void SetPauseValueOrdered(const bool enablePause)
+        {
+            if (m_controlBlock != nullptr)
+                m_controlBlock->UpdateControl(m_controlBlock->OrderedPause, enablePause);
+        }
+
+        /// <summary> Pause after the in-process task completes. See <c>ThreadUnitPlusPlus</c>. </summary>
+        void SetPauseValueUnordered(const bool enablePause)
+        {
+            if (m_controlBlock != nullptr)
+                m_controlBlock->UpdateControl(m_controlBlock->UnorderedPause, enablePause);
+        }
+
+        /// <summary> True if the worker process exists, is not stopping, and has not exited. </summary>
+        [[nodiscard]]
+        bool IsRunning()
+        {
+            return m_controlBlock != nullptr && !m_controlBlock->IsStopRequested() && !TryReapWorker();
+        }
+
+        [[nodiscard]]
+        bool GetPauseCompletionStatus() const
+        {
+            return m_controlBlock != nullptr && m_controlBlock->IsPauseCompleted();
+        }
+
+        /// <summary> Waits for the worker process to enter the "paused" state, if a pause is requested.
+        /// Returns early if the worker process exits. </summary>
+        void WaitForPauseCompleted()
+        {
+            if (m_controlBlock == nullptr)
+                return;
+            while (m_controlBlock->IsPauseRequested() && !m_controlBlock->IsPauseCompleted())
+            {
+                if (TryReapWorker())
+                    return;
+                const auto pauseCompleted = m_controlBlock->PauseCompleted.load();
+                if (!m_controlBlock->IsPauseCompleted())
+                    ProcessControlBlock::FutexWait(m_controlBlock->PauseCompleted, pauseCompleted, EmptyWaitTime);
+            }
+        }
+
+        /// <summary> Returns the number of tasks in the task set (summed over its units, see
+        /// <c>ThreadUnitPlusPlus::GetNumberOfTasks</c>), as reported by the worker process. </summary>
+        [[nodiscard]]
+        std::size_t GetNumberOfTasks() const
+        {
+            return m_controlBlock != nullptr ? m_controlBlock->NumberOfTasks.load() : 0;
+        }
+
+        /// <summary> Returns the number of task list iterations completed by the worker process, summed over its units. </summary>
+        [[nodiscard]]
+        std::uint64_t GetHeartbeat() const
+        {
+            return m_controlBlock != nullptr ? m_controlBlock->Heartbeat.load() : 0;
+        }
+
+        /// <summary> Returns the time since the worker process last completed an iteration (or started). </summary>
+        [[nodiscard]]
+        std::chrono::nanoseconds GetHeartbeatAge() const
+        {
+            if (m_controlBlock == nullptr)
+                return {};
+            return std::chrono::nanoseconds{ ProcessControlBlock::MonotonicNowNs() - m_controlBlock->HeartbeatTimeNs.load() };
+        }
+
+        /// <summary> Returns the total number of infinite tasks (<c>TaskList</c>) run by the worker process, counted as
+        /// each iteration of a unit ends. </summary>
+        [[nodiscard]]
+        std::uint64_t GetTasksRun() const
+        {
+            return m_controlBlock != nullptr ? m_controlBlock->TasksRun.load() : 0;
+        }
+
+        [[nodiscard]]
+        const std::string& GetTaskSetName() const
+        {
+            return m_taskSetName;
+        }
+
+        /// <summary> Process id of the worker process, -1 once it has been reaped. </summary>
+        [[nodiscard]]
+        pid_t GetWorkerPid() const
+        {
+            return m_workerPid;
+        }
+
+        /// <summary> Wait status of the worker process (see <c>waitpid</c>), valid once it is no longer running. </summary>
+        [[nodiscard]]
+        int GetExitStatus() const
+        {
+            return m_exitStatus;
+        }
+
+        /// <summary> Stops the worker process after its units finish the task they are on, and waits for it to exit.
+        /// Releases the shared control block. </summary>
+        void DestroyThread()
+        {
+            if (m_controlBlock == nullptr)
+                return;
+            m_controlBlock->UpdateControl(m_controlBlock->StopRequested, true);
+            if (m_workerPid > 0)
+            {
+                int status{};
+                while (waitpid(m_workerPid, &status, 0) < 0 && errno == EINTR) {}
+                m_exitStatus = status;
+                m_workerPid = -1;
+            }
+            munmap(m_controlBlock, sizeof(ProcessControlBlock));
+            m_controlBlock = nullptr;
+        }
+    private:
+        /// <summary> Returns true if the worker process has exited (and reaps it). </summary>
+        bool TryReapWorker()
+        {
+            if (m_workerPid <= 0)
+                return true;
+            int status{};
+            if (waitpid(m_workerPid, &status, WNOHANG) == m_workerPid)
+            {
+                m_exitStatus = status;
+                m_workerPid = -1;
+                return true;
+            }
+            return false;
+        }
+    };
+
+    /// <summary> Spawns worker processes that each run a named task set, for fault isolation and to escape a
+    /// single process's allocator and lock contention. Task sets are registered by name before spawning, the
+    /// factory is called in the worker process so the tasks are constructed there. A task group is a set of task
+    /// sources run by one worker process, each on its own <c>ThreadUnitPlusPlus</c>. </summary>
+    /// <remarks> The worker is created with <c>fork()</c>, so the factory must only rely on state that is valid
+    /// in a forked child (no locks held by other threads of the host process). The worker stops its units and exits
+    /// once its host process has exited, within <c>ProcessUnit::EmptyWaitTime</c>. </remarks>
+    class ProcessUnitHost
+    {
+    public:
+        using TaskSetFactory_t = std::function<imp::ThreadTaskSource()>;
+        using TaskGroupFactory_t = std::function<std::vector<imp::ThreadTaskSource>()>;
+    private:
+        struct TaskGroupInfo
+        {
+            TaskGroupFactory_t Factory;
+            imp::DispatchOptions Options;
+        };
+        std::map<std::string, TaskGroupInfo, std::less<>> m_taskSets{};
+    public:
+        /// <summary> Registers (or replaces) the factory for a named task set, run by one unit in the worker process. </summary>
+        /// <param name="options"> Dispatch options of the unit, copied into the worker process when it is spawned. </param>
+        void RegisterTaskSet(std::string name, TaskSetFactory_t factory, imp::DispatchOptions options = {})
+        {
+            RegisterTaskGroup(std::move(name), [factory = std::move(factory)]() { return std::vector<imp::ThreadTaskSource>{ factory() }; }, std::move(options));
+        }
+
+        /// <summary> Registers (or replaces) the factory for a named group of task sets, each run by its own unit in
+        /// one worker process. </summary>
+        /// <param name="options"> Dispatch options of the units, copied into the worker process when it is spawned. </param>
+        void RegisterTaskGroup(std::string name, TaskGroupFactory_t factory, imp::DispatchOptions options = {})
+        {
+            m_taskSets.insert_or_assign(std::move(name), TaskGroupInfo{ std::move(factory), std::move(options) });
+        }
+
+        /// <summary> Spawns a worker process running the named task set (or group). </summary>
+        /// <param name="isPausedOnStart"> If true the worker starts paused (ordered), its units start when it is resumed. </param>
+        /// <returns> The unit handle, or empty if the task set is unknown or the process could not be created. </returns>
+        [[nodiscard]]
+        std::optional<ProcessUnit> SpawnUnit(const std::string_view taskSetName, const bool isPausedOnStart = false) const
+        {
+            const auto taskSetIt = m_taskSets.find(taskSetName);
+            if (taskSetIt == m_taskSets.end())
+                return {};
+            void* mapping = mmap(nullptr, sizeof(ProcessControlBlock), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (mapping == MAP_FAILED)
+                return {};
+            auto* controlBlock = new (mapping) ProcessControlBlock{};
+            controlBlock->OrderedPause.store(isPausedOnStart ? 1u : 0u);
+            controlBlock->HeartbeatTimeNs.store(ProcessControlBlock::MonotonicNowNs());
+            const pid_t hostPid = getpid();
+            const pid_t workerPid = fork();
+            if (workerPid < 0)
+            {
+                munmap(mapping, sizeof(ProcessControlBlock));
+                return {};
+            }
+            if (workerPid == 0)
+            {
+                int exitCode = 0;
+                try
+                {
+                    workerProcessFunc(*controlBlock, hostPid, taskSetIt->second.Factory(), taskSetIt->second.Options);
+                }
+                catch (...)
+                {
+                    exitCode = 1;
+                }
+                _exit(exitCode);
+            }
+            return ProcessUnit{ controlBlock, workerPid, taskSetIt->first };
+        }
+    private:
+        /// <summary> The worker function, on the main thread of the worker process. Runs a <c>ThreadUnitPlusPlus</c>
+        /// per task source and mirrors the control state read from the shared block onto them, until a stop is
+        /// requested or the host process exits. </summary>
+        static void workerProcessFunc(ProcessControlBlock& control, const pid_t hostPid, std::vector<imp::ThreadTaskSource> taskSources,
+            const imp::DispatchOptions& options)
+        {
+            std::size_t numberOfTasks{};
+            for (auto& taskSource : taskSources)
+            {
+                numberOfTasks += ThreadUnitPlusPlus::CountTasks(taskSource);
+                // The heartbeat is the last iteration end task, it is not counted as a task of the set.
+                taskSource.PushIterationEndTaskBack([&control, iterationTasks = taskSource.TaskList.size()]()
+                {
+                    control.TasksRun.fetch_add(iterationTasks, std::memory_order_relaxed);
+                    control.Heartbeat.fetch_add(1, std::memory_order_relaxed);
+                    control.HeartbeatTimeNs.store(ProcessControlBlock::MonotonicNowNs(), std::memory_order_relaxed);
+                });
+            }
+            control.NumberOfTasks.store(static_cast<std::uint32_t>(numberOfTasks));
+            // The units are started once the worker is first not paused, so a worker paused on start runs no task.
+            std::vector<ThreadUnitPlusPlus> units;
+            units.reserve(taskSources.size());
+            const auto IsUnitPaused = [](const ThreadUnitPlusPlus& unit) { return unit.GetPauseCompletionStatus(); };
+            // The pause requests forwarded to the units, and whether the units are still leaving the last pause.
+            bool isOrderedPause{};
+            bool isUnorderedPause{};
+            bool isUnitsResuming{};
+            // Reparented once the host has exited, getppid() no longer returns the host.
+            while (!control.IsStopRequested() && getppid() == hostPid)
+            {
+                const auto sequence = control.ControlSequence.load();
+                const bool isOrderedRequested = control.OrderedPause.load() != 0;
+                const bool isUnorderedRequested = control.UnorderedPause.load() != 0;
+                const bool isPauseRequested = isOrderedRequested || isUnorderedRequested;
+                if (units.empty() && !isPauseRequested)
+                {
+                    for (const auto& taskSource : taskSources)
+                        units.emplace_back(taskSource, options);
+                }
+                // A new pause is forwarded once every unit has left the last one, so its stale completion is not taken
+                // for the new pause.
+                if (isUnitsResuming)
+                    isUnitsResuming = std::ranges::any_of(units, IsUnitPaused);
+                if (!isUnitsResuming)
+                {
+                    const bool isPaused = isOrderedPause || isUnorderedPause;
+                    for (auto& unit : units)
+                    {
+                        if (isOrderedRequested != isOrderedPause)
+                            unit.SetPauseValueOrdered(isOrderedRequested);
+                        if (isUnorderedRequested != isUnorderedPause)
+                            unit.SetPauseValueUnordered(isUnorderedRequested);
+                    }
+                    isOrderedPause = isOrderedRequested;
+                    isUnorderedPause = isUnorderedRequested;
+                    isUnitsResuming = isPaused && !isPauseRequested;
+                }
+                const bool isPauseForwarded = isOrderedPause == isOrderedRequested && isUnorderedPause == isUnorderedRequested;
+                const bool isPauseCompleted = isPauseRequested && isPauseForwarded && std::ranges::all_of(units, IsUnitPaused);
+                const std::uint32_t pauseCompleted = isPauseCompleted ? sequence + 1 : 0;
+                if (control.PauseCompleted.load() != pauseCompleted)
+                {
+                    control.PauseCompleted.store(pauseCompleted);
+                    ProcessControlBlock::FutexWakeAll(control.PauseCompleted);
+                }
+                // The units completing a pause or resuming are polled, control changes wake the wait.
+                const bool isPolling = isUnitsResuming || (isPauseRequested && !isPauseCompleted);
+                ProcessControlBlock::FutexWait(control.ControlSequence, sequence, isPolling ? ProcessUnit::PausePollTime : ProcessUnit::EmptyWaitTime);
+            }
+            // Stops each unit after the task it is on, as a stop of a ThreadUnitPlusPlus.
+            units.clear();
+        }
+    };
+}
+#endif
\ No newline at end of file
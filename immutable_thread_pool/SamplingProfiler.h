@@ -0,0 +1,555 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ThreadTaskSource.h"
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define IMP_SAMPLING_PROFILER_SUPPORTED 1
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#if !defined(sigev_notify_thread_id)
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+namespace imp
+{
+    /// <summary> The task list a sampled task is in, with its index in the list it names the task in a profile. </summary>
+    enum class ProfiledLane : std::uint32_t
+    {
+        None,
+        Task,
+        HighPriority,
+        Range,
+        Signalled,
+        IterationEnd
+    };
+
+    /// <summary> An in-process sampling profiler for unit work threads, for hosts where an external profiler (e.g.
+    /// <c>perf</c>) cannot run. Set it in the <c>DispatchOptions::Profiler</c> of the units to profile: each work
+    /// thread then gets a timer on its own CPU time clock that interrupts it with <c>SIGPROF</c> every sample period,
+    /// and the signal handler records the interrupted stack, with the task the thread was running. The samples are
+    /// written as folded stacks (<c>unit;task;frame;...;frame count</c> lines) for flame graph tools. </summary>
+    /// <remarks> The handler only walks frame pointers within the thread's stack bounds and writes to a preallocated
+    /// ring buffer of the thread, so it takes no locks and does not allocate. Build with frame pointers
+    /// (<c>-fno-omit-frame-pointer</c>) for full stacks, otherwise stacks may be cut short, and link with
+    /// <c>-rdynamic</c> for function names rather than module offsets. A collector thread drains the ring buffers
+    /// every <c>CollectInterval</c>, samples that find a ring buffer full are counted as dropped. Task fusion is off on
+    /// profiled units, as a fused dispatch runs several tasks. Uses <c>SIGPROF</c>, so do not combine it with other
+    /// users of that signal. Linux (x86-64, AArch64) only, elsewhere no samples are taken (see <c>IsSupported</c>).
+    /// Thread-safe. Non-copyable, non-movable, held by shared_ptr. </remarks>
+    class SamplingProfiler
+    {
+    public:
+        static constexpr std::size_t MaxStackDepth{ 64 };
+        static constexpr std::chrono::microseconds DefaultSamplePeriod{ 10'000 };
+        static constexpr std::size_t DefaultSamplesPerThread{ 1024 };
+        static constexpr std::chrono::milliseconds CollectInterval{ 100 };
+    private:
+        struct StackSample
+        {
+            std::uint32_t Label;
+            std::uint32_t Depth;
+            std::uintptr_t Frames[MaxStackDepth];
+        };
+
+        // The sampling state of one work thread. The signal handler is the single producer of its ring buffer,
+        // the collector the single consumer.
+        struct ThreadProfile
+        {
+            std::string UnitName;
+            // The name of each label, label 0 is time outside of any task.
+            std::vector<std::string> LabelNames;
+            std::uint32_t LaneLabelBases[6]{};
+            std::atomic<std::uint32_t> CurrentLabel{};
+            std::uintptr_t StackLow{};
+            std::uintptr_t StackHigh{};
+            std::vector<StackSample> Ring;
+            std::atomic<std::uint64_t> WriteIndex{};
+            std::atomic<std::uint64_t> ReadIndex{};
+            std::atomic<std::uint64_t> DroppedCount{};
+            std::atomic<bool> IsStopped{};
+#if defined(IMP_SAMPLING_PROFILER_SUPPORTED)
+            timer_t Timer{};
+            bool HasTimer{};
+#endif
+        };
+        using StackKey_t = std::pair<std::string, std::vector<std::uintptr_t>>;
+    public:
+        /// <summary> Samples a work thread from construction until destruction, made by <c>SampleThread</c>. Empty (not
+        /// sampling) if default constructed, or if the profiler is not supported. Movable, non-copyable. </summary>
+        class ThreadSampler
+        {
+            friend class SamplingProfiler;
+            std::shared_ptr<ThreadProfile> m_profile{};
+        public:
+            ThreadSampler() = default;
+            ThreadSampler(const ThreadSampler&) = delete;
+            ThreadSampler& operator=(const ThreadSampler&) = delete;
+            ThreadSampler(ThreadSampler&&) noexcept = default;
+            ThreadSampler& operator=(ThreadSampler&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    stopSampling();
+                    m_profile = std::move(other.m_profile);
+                }
+                return *this;
+            }
+            ~ThreadSampler()
+            {
+                stopSampling();
+            }
+        public:
+            [[nodiscard]] bool IsSampling() const noexcept { return m_profile != nullptr; }
+
+            /// <summary> Returns a copy of the task source the sampled thread runs instead, each task of which marks
+            /// itself as running for the samples taken while it runs. Same lists, same order, so the dispatch loop is
+            /// unchanged, and a thread that is not sampled pays nothing. Only while sampling. </summary>
+            [[nodiscard]]
+            ThreadTaskSource MakeProfiledTasks(const ThreadTaskSource& tasks) const
+            {
+                ThreadProfile* profile = m_profile.get();
+                const auto ProfiledTask = [profile](const ProfiledLane lane, const std::size_t taskIndex, ThreadTaskSource::TaskInfo task)
+                {
+                    const auto label = profile->LaneLabelBases[static_cast<std::size_t>(lane)] + static_cast<std::uint32_t>(taskIndex);
+                    return ThreadTaskSource::TaskInfo{ [profile, label, task = std::move(task)]()
+                        {
+                            setCurrentLabel(*profile, label);
+                            task();
+                            setCurrentLabel(*profile, 0);
+                        } };
+                };
+                ThreadTaskSource profiledTasks{};
+                for (std::size_t i = 0; i < tasks.TaskList.size(); i++)
+                    profiledTasks.TaskList.emplace_back(ProfiledTask(ProfiledLane::Task, i, tasks.TaskList[i]));
+                for (std::size_t i = 0; i < tasks.HighPriorityTaskList.size(); i++)
+                    profiledTasks.HighPriorityTaskList.emplace_back(ProfiledTask(ProfiledLane::HighPriority, i, tasks.HighPriorityTaskList[i]));
+                for (std::size_t i = 0; i < tasks.SignalledTaskList.size(); i++)
+                {
+                    const auto& signalledTask = tasks.SignalledTaskList[i];
+                    profiledTasks.SignalledTaskList.emplace_back(ThreadTaskSource::SignalledTaskInfo{ signalledTask.Signal,
+                        ProfiledTask(ProfiledLane::Signalled, i, signalledTask.Task) });
+                }
+                for (std::size_t i = 0; i < tasks.RangeTaskList.size(); i++)
+                {
+                    const auto label = profile->LaneLabelBases[static_cast<std::size_t>(ProfiledLane::Range)] + static_cast<std::uint32_t>(i);
+                    profiledTasks.RangeTaskList.emplace_back(ThreadTaskSource::RangeTaskInfo{
+                        [profile, label, makeCursor = tasks.RangeTaskList[i].MakeCursor]() -> ThreadTaskSource::RangeCursor_t
+                        {
+                            return [profile, label, rangeCursor = makeCursor()](const std::size_t maxTasks) mutable -> std::size_t
+                            {
+                                setCurrentLabel(*profile, label);
+                                const auto tasksRun = rangeCursor(maxTasks);
+                                setCurrentLabel(*profile, 0);
+                                return tasksRun;
+                            };
+                        }, tasks.RangeTaskList[i].TaskCount });
+                }
+                for (std::size_t i = 0; i < tasks.IterationEndTaskList.size(); i++)
+                    profiledTasks.IterationEndTaskList.emplace_back(ProfiledTask(ProfiledLane::IterationEnd, i, tasks.IterationEndTaskList[i]));
+                return profiledTasks;
+            }
+        private:
+            void stopSampling() noexcept;
+        };
+    private:
+        static void setCurrentLabel(ThreadProfile& profile, const std::uint32_t label) noexcept
+        {
+            profile.CurrentLabel.store(label, std::memory_order_relaxed);
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+    private:
+        std::chrono::microseconds m_samplePeriod{};
+        std::size_t m_samplesPerThread{};
+        std::mutex m_profilesMutex{};
+        std::vector<std::shared_ptr<ThreadProfile>> m_profiles{};
+        std::size_t m_unnamedUnits{};
+        // Aggregated samples, by unit name, then by task label and stack.
+        std::map<std::string, std::map<StackKey_t, std::uint64_t>> m_stackCounts{};
+        std::uint64_t m_sampleCount{};
+        // Samples dropped by the threads whose profiles were removed once stopped and collected.
+        std::uint64_t m_droppedCount{};
+        std::condition_variable_any m_collectCv{};
+        std::jthread m_collectThread{};
+    public:
+        /// <summary> Ctor, starts the collector thread. </summary>
+        /// <param name="samplePeriod"> CPU time of a work thread between samples of it. </param>
+        /// <param name="samplesPerThread"> Size of each work thread's ring buffer, in samples. </param>
+        explicit SamplingProfiler(const std::chrono::microseconds samplePeriod = DefaultSamplePeriod,
+            const std::size_t samplesPerThread = DefaultSamplesPerThread)
+            : m_samplePeriod(samplePeriod > std::chrono::microseconds::zero() ? samplePeriod : DefaultSamplePeriod),
+            m_samplesPerThread(samplesPerThread > 0 ? samplesPerThread : DefaultSamplesPerThread)
+        {
+            m_collectThread = std::jthread{ [this](const std::stop_token stopToken)
+                {
+                    std::unique_lock profilesLock{ m_profilesMutex };
+                    while (!stopToken.stop_requested())
+                    {
+                        m_collectCv.wait_for(profilesLock, stopToken, CollectInterval, []() { return false; });
+                        collect();
+                    }
+                } };
+        }
+        SamplingProfiler(const SamplingProfiler&) = delete;
+        SamplingProfiler& operator=(const SamplingProfiler&) = delete;
+        ~SamplingProfiler()
+        {
+            m_collectThread.request_stop();
+            m_collectThread = {};
+        }
+    public:
+        /// <summary> Returns true if samples can be taken on this platform. </summary>
+        [[nodiscard]]
+        static constexpr bool IsSupported() noexcept
+        {
+#if defined(IMP_SAMPLING_PROFILER_SUPPORTED)
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        /// <summary> Starts sampling the calling thread, called by a unit's work thread when it starts. The tasks of
+        /// the task source name the samples, by list and index (and name, for a task given one). </summary>
+        /// <param name="unitName"> The name of the unit, the root frame of its stacks, "unitN" if empty. </param>
+        [[nodiscard]]
+        ThreadSampler SampleThread(std::string unitName, const ThreadTaskSource& tasks)
+        {
+            ThreadSampler threadSampler{};
+#if defined(IMP_SAMPLING_PROFILER_SUPPORTED)
+            installSignalHandler();
+            auto profile = std::make_shared<ThreadProfile>();
+            profile->LabelNames.emplace_back("(dispatch)");
+            const auto AddLabels = [&profile](const ProfiledLane lane, const char* listName, const auto& taskList, const auto& GetTask)
+            {
+                profile->LaneLabelBases[static_cast<std::size_t>(lane)] = static_cast<std::uint32_t>(profile->LabelNames.size());
+                for (std::size_t i = 0; i < taskList.size(); i++)
+                {
+                    std::string labelName = std::string{ listName } + "[" + std::to_string(i) + "]";
+                    if (const auto* taskIdentity = GetTask(taskList[i]); taskIdentity != nullptr && !taskIdentity->Name.empty())
+                        labelName += " " + taskIdentity->Name;
+                    profile->LabelNames.emplace_back(std::move(labelName));
+                }
+            };
+            const auto TaskIdentity = [](const ThreadTaskSource::TaskInfo& task) { return GetTaskIdentity(task); };
+            AddLabels(ProfiledLane::Task, "TaskList", tasks.TaskList, TaskIdentity);
+            AddLabels(ProfiledLane::HighPriority, "HighPriorityTaskList", tasks.HighPriorityTaskList, TaskIdentity);
+            AddLabels(ProfiledLane::Range, "RangeTaskList", tasks.RangeTaskList, [](const ThreadTaskSource::RangeTaskInfo&) { return static_cast<const IdentifiedTask*>(nullptr); });
+            AddLabels(ProfiledLane::Signalled, "SignalledTaskList", tasks.SignalledTaskList, [](const ThreadTaskSource::SignalledTaskInfo& task) { return GetTaskIdentity(task.Task); });
+            AddLabels(ProfiledLane::IterationEnd, "IterationEndTaskList", tasks.IterationEndTaskList, TaskIdentity);
+            profile->Ring.resize(m_samplesPerThread);
+            pthread_attr_t threadAttr{};
+            if (::pthread_getattr_np(::pthread_self(), &threadAttr) == 0)
+            {
+                void* stackAddress{};
+                std::size_t stackSize{};
+                if (::pthread_attr_getstack(&threadAttr, &stackAddress, &stackSize) == 0)
+                {
+                    profile->StackLow = reinterpret_cast<std::uintptr_t>(stackAddress);
+                    profile->StackHigh = profile->StackLow + stackSize;
+                }
+                ::pthread_attr_destroy(&threadAttr);
+            }
+            {
+                std::lock_guard profilesLock{ m_profilesMutex };
+                profile->UnitName = !unitName.empty() ? std::move(unitName) : "unit" + std::to_string(m_unnamedUnits++);
+                m_profiles.emplace_back(profile);
+            }
+            // Published before the timer starts, the handler finds the thread's profile through it.
+            currentProfile() = profile.get();
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            sigevent timerEvent{};
+            timerEvent.sigev_notify = SIGEV_THREAD_ID;
+            timerEvent.sigev_signo = SIGPROF;
+            timerEvent.sigev_notify_thread_id = static_cast<pid_t>(::syscall(SYS_gettid));
+            if (::timer_create(CLOCK_THREAD_CPUTIME_ID, &timerEvent, &profile->Timer) == 0)
+            {
+                profile->HasTimer = true;
+                const auto periodSeconds = std::chrono::duration_cast<std::chrono::seconds>(m_samplePeriod);
+                const auto periodNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(m_samplePeriod - periodSeconds);
+                itimerspec timerSpec{};
+                timerSpec.it_interval.tv_sec = static_cast<time_t>(periodSeconds.count());
+                timerSpec.it_interval.tv_nsec = static_cast<long>(periodNanoseconds.count());
+                timerSpec.it_value = timerSpec.it_interval;
+                ::timer_settime(profile->Timer, 0, &timerSpec, nullptr);
+            }
+            threadSampler.m_profile = std::move(profile);
+#else
+            (void)unitName;
+            (void)tasks;
+#endif
+            return threadSampler;
+        }
+
+        /// <summary> Moves the samples taken so far out of the work threads' ring buffers into the profile. Called by
+        /// the collector thread, and before the profile is read. </summary>
+        void Collect()
+        {
+            std::lock_guard profilesLock{ m_profilesMutex };
+            collect();
+        }
+
+        /// <summary> Returns the number of samples collected. </summary>
+        [[nodiscard]]
+        std::uint64_t GetSampleCount()
+        {
+            std::lock_guard profilesLock{ m_profilesMutex };
+            collect();
+            return m_sampleCount;
+        }
+
+        /// <summary> Returns the number of samples dropped, because a ring buffer was full. </summary>
+        [[nodiscard]]
+        std::uint64_t GetDroppedCount()
+        {
+            std::lock_guard profilesLock{ m_profilesMutex };
+            std::uint64_t droppedCount = m_droppedCount;
+            for (const auto& profile : m_profiles)
+                droppedCount += profile->DroppedCount.load(std::memory_order_relaxed);
+            return droppedCount;
+        }
+
+        /// <summary> Returns the number of work threads with samples still to collect, i.e. running, or stopped since
+        /// the last collection. </summary>
+        [[nodiscard]]
+        std::size_t GetProfiledThreadCount()
+        {
+            std::lock_guard profilesLock{ m_profilesMutex };
+            collect();
+            return m_profiles.size();
+        }
+
+        /// <summary> Returns the names of the units sampled. </summary>
+        [[nodiscard]]
+        std::vector<std::string> GetUnitNames()
+        {
+            std::lock_guard profilesLock{ m_profilesMutex };
+            collect();
+            std::vector<std::string> unitNames;
+            for (const auto& [unitName, stackCounts] : m_stackCounts)
+                unitNames.emplace_back(unitName);
+            return unitNames;
+        }
+
+        /// <summary> Writes the folded stacks of the samples collected, one line per distinct stack, rooted at the
+        /// unit and then the task. </summary>
+        /// <param name="out"> The stream to write to. </param>
+        /// <param name="unitName"> Only write the stacks of this unit, if not empty. </param>
+        void WriteFoldedStacks(std::ostream& out, const std::string& unitName = {})
+        {
+            std::lock_guard profilesLock{ m_profilesMutex };
+            collect();
+            std::unordered_map<std::uintptr_t, std::string> symbolNames;
+            for (const auto& [stacksUnitName, stackCounts] : m_stackCounts)
+            {
+                if (!unitName.empty() && stacksUnitName != unitName)
+                    continue;
+                for (const auto& [stackKey, sampleCount] : stackCounts)
+                {
+                    out << foldedFrameName(stacksUnitName) << ';' << foldedFrameName(stackKey.first);
+                    // The frames are stored leaf first, the leaf is the interrupted instruction, the rest return addresses.
+                    const auto& frames = stackKey.second;
+                    for (std::size_t i = frames.size(); i > 0; i--)
+                    {
+                        const auto framePc = i == 1 ? frames[i - 1] : frames[i - 1] - 1;
+                        auto [symbolIt, isNewSymbol] = symbolNames.try_emplace(framePc);
+                        if (isNewSymbol)
+                            symbolIt->second = foldedFrameName(symbolName(framePc));
+                        out << ';' << symbolIt->second;
+                    }
+                    out << ' ' << sampleCount << '\n';
+                }
+            }
+        }
+
+        /// <summary> Writes the folded stacks of each unit to its own file, <c>&lt;unit name&gt;.folded</c> in the directory. </summary>
+        /// <returns> true if every file was written. </returns>
+        bool WriteFoldedStacks(const std::filesystem::path& directory)
+        {
+            bool isAllWritten = true;
+            for (const auto& unitName : GetUnitNames())
+            {
+                std::ofstream foldedFile{ directory / (foldedFrameName(unitName) + ".folded"), std::ios::trunc };
+                WriteFoldedStacks(foldedFile, unitName);
+                isAllWritten = isAllWritten && static_cast<bool>(foldedFile.flush());
+            }
+            return isAllWritten;
+        }
+    private:
+        // Moves the samples out of every ring buffer into the aggregated counts, and removes the profiles of stopped
+        // threads once all their samples are collected. Called with the profiles locked.
+        void collect()
+        {
+            std::erase_if(m_profiles, [this](const std::shared_ptr<ThreadProfile>& profilePtr)
+            {
+                auto& profile = *profilePtr;
+                const auto writeIndex = profile.WriteIndex.load(std::memory_order_acquire);
+                auto readIndex = profile.ReadIndex.load(std::memory_order_relaxed);
+                auto& stackCounts = m_stackCounts[profile.UnitName];
+                for (; readIndex != writeIndex; readIndex++)
+                {
+                    const auto& sample = profile.Ring[readIndex % profile.Ring.size()];
+                    const auto& labelName = sample.Label < profile.LabelNames.size() ? profile.LabelNames[sample.Label] : profile.LabelNames.front();
+                    stackCounts[StackKey_t{ labelName, { sample.Frames, sample.Frames + sample.Depth } }]++;
+                    m_sampleCount++;
+                }
+                profile.ReadIndex.store(readIndex, std::memory_order_release);
+                // A stopped thread takes no more samples, keep only its dropped count.
+                if (!profile.IsStopped.load(std::memory_order_acquire) || readIndex != profile.WriteIndex.load(std::memory_order_acquire))
+                    return false;
+                m_droppedCount += profile.DroppedCount.load(std::memory_order_relaxed);
+                return true;
+            });
+        }
+
+        // A frame of a folded stack must not hold the frame separator, or end a line with what reads as a count.
+        static std::string foldedFrameName(std::string frameName)
+        {
+            for (auto& c : frameName)
+            {
+                if (c == ';' || c == '\n' || c == '/')
+                    c = c == '/' ? '_' : ':';
+            }
+            return frameName;
+        }
+
+        static std::string symbolName([[maybe_unused]] const std::uintptr_t framePc)
+        {
+#if defined(IMP_SAMPLING_PROFILER_SUPPORTED)
+            Dl_info symbolInfo{};
+            if (::dladdr(reinterpret_cast<const void*>(framePc), &symbolInfo) != 0)
+            {
+                if (symbolInfo.dli_sname != nullptr)
+                {
+                    int demangleStatus{};
+                    char* demangled = abi::__cxa_demangle(symbolInfo.dli_sname, nullptr, nullptr, &demangleStatus);
+                    std::string name = demangleStatus == 0 && demangled != nullptr ? demangled : symbolInfo.dli_sname;
+                    std::free(demangled);
+                    return name;
+                }
+                if (symbolInfo.dli_fname != nullptr)
+                {
+                    char offset[32]{};
+                    std::snprintf(offset, sizeof(offset), "+0x%zx", static_cast<std::size_t>(framePc - reinterpret_cast<std::uintptr_t>(symbolInfo.dli_fbase)));
+                    return std::filesystem::path{ symbolInfo.dli_fname }.filename().string() + offset;
+                }
+            }
+#endif
+            char address[32]{};
+            std::snprintf(address, sizeof(address), "0x%zx", static_cast<std::size_t>(framePc));
+            return address;
+        }
+
+        // The profile of the calling thread, read by the signal handler. A pointer, constant-initialized, so reading
+        // it in the handler does not allocate or run an initializer.
+        static ThreadProfile*& currentProfile() noexcept
+        {
+            static thread_local ThreadProfile* threadProfile{};
+            return threadProfile;
+        }
+
+#if defined(IMP_SAMPLING_PROFILER_SUPPORTED)
+        static void installSignalHandler()
+        {
+            static std::once_flag handlerOnce;
+            std::call_once(handlerOnce, []()
+                {
+                    struct sigaction profAction{};
+                    profAction.sa_sigaction = &onProfileSignal;
+                    profAction.sa_flags = SA_SIGINFO | SA_RESTART;
+                    sigemptyset(&profAction.sa_mask);
+                    ::sigaction(SIGPROF, &profAction, nullptr);
+                });
+        }
+
+        // The SIGPROF handler, async-signal-safe: records the interrupted instruction and the return addresses found by
+        // walking the frame pointer chain, reading only within the thread's stack.
+        static void onProfileSignal(int, siginfo_t*, void* context) noexcept
+        {
+            const int savedErrno = errno;
+            ThreadProfile* profile = currentProfile();
+            if (profile != nullptr && !profile->Ring.empty())
+            {
+                const auto writeIndex = profile->WriteIndex.load(std::memory_order_relaxed);
+                if (writeIndex - profile->ReadIndex.load(std::memory_order_acquire) >= profile->Ring.size())
+                {
+                    profile->DroppedCount.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    auto& sample = profile->Ring[writeIndex % profile->Ring.size()];
+                    const auto& machineContext = static_cast<const ucontext_t*>(context)->uc_mcontext;
+#if defined(__x86_64__)
+                    const auto pc = static_cast<std::uintptr_t>(machineContext.gregs[REG_RIP]);
+                    auto framePointer = static_cast<std::uintptr_t>(machineContext.gregs[REG_RBP]);
+#else
+                    const auto pc = static_cast<std::uintptr_t>(machineContext.pc);
+                    auto framePointer = static_cast<std::uintptr_t>(machineContext.regs[29]);
+#endif
+                    std::uint32_t depth = 0;
+                    sample.Frames[depth++] = pc;
+                    while (depth < MaxStackDepth && framePointer >= profile->StackLow
+                        && framePointer + 2 * sizeof(std::uintptr_t) <= profile->StackHigh && framePointer % alignof(std::uintptr_t) == 0)
+                    {
+                        const auto* frameRecord = reinterpret_cast<const std::uintptr_t*>(framePointer);
+                        const auto returnAddress = frameRecord[1];
+                        if (returnAddress == 0)
+                            break;
+                        sample.Frames[depth++] = returnAddress;
+                        // Frames only go up the stack, anything else is not a frame pointer chain.
+                        if (frameRecord[0] <= framePointer)
+                            break;
+                        framePointer = frameRecord[0];
+                    }
+                    sample.Depth = depth;
+                    sample.Label = profile->CurrentLabel.load(std::memory_order_relaxed);
+                    profile->WriteIndex.store(writeIndex + 1, std::memory_order_release);
+                }
+            }
+            errno = savedErrno;
+        }
+#endif
+    };
+
+    inline void SamplingProfiler::ThreadSampler::stopSampling() noexcept
+    {
+        if (m_profile == nullptr)
+            return;
+#if defined(IMP_SAMPLING_PROFILER_SUPPORTED)
+        if (m_profile->HasTimer)
+            ::timer_delete(m_profile->Timer);
+        // The thread stops sampling itself, a signal still pending is ignored.
+        if (currentProfile() == m_profile.get())
+        {
+            currentProfile() = nullptr;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+#endif
+        m_profile->IsStopped.store(true, std::memory_order_release);
+        m_profile.reset();
+    }
+}
@@ -0,0 +1,289 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace imp
+{
+    /// <summary> A pool of fixed-size buffers for handing data from the tasks of one unit to those of another without
+    /// copying it, and without the allocator moving memory between thread caches. Buffers are carved from slabs, and
+    /// each unit takes them from its own cache (<c>GetUnitCache</c>), without locking. A buffer is passed on as a
+    /// <c>PooledBuffer</c> handle, which owns it, and a unit done with another unit's buffer releases it to its own
+    /// cache, which returns it to the buffer's home cache in batches of <c>returnBatchSize</c>. </summary>
+    /// <remarks> Flush the returns at the end of each iteration with an iteration end task, e.g.
+    /// <c>tasks.PushIterationEndTaskBack([&amp;cache]() { cache.FlushReturns(); });</c> so a unit that has run out
+    /// of buffers gets its partial batches back. A handle dropped without being released returns its buffer to its
+    /// home cache at once.
+    /// Slabs are kept until the pool is destroyed, and the pool must outlive its buffers. Non-copyable. </remarks>
+    class SlabBufferPool
+    {
+    public:
+        static constexpr std::size_t BufferAlignment{ 64 };
+        static constexpr std::size_t DefaultBuffersPerSlab{ 64 };
+        static constexpr std::size_t DefaultReturnBatchSize{ 32 };
+        class UnitCache;
+
+        /// <summary> Owns a buffer of the pool, move-only. Holds the size of the data written to it, up to its capacity. </summary>
+        class PooledBuffer
+        {
+            friend class UnitCache;
+            UnitCache* m_homeCache{};
+            std::byte* m_data{};
+            std::size_t m_size{};
+        public:
+            PooledBuffer() = default;
+            PooledBuffer(const PooledBuffer&) = delete;
+            PooledBuffer& operator=(const PooledBuffer&) = delete;
+            PooledBuffer(PooledBuffer&& other) noexcept
+                : m_homeCache(std::exchange(other.m_homeCache, nullptr)),
+                m_data(std::exchange(other.m_data, nullptr)),
+                m_size(std::exchange(other.m_size, 0))
+            {
+            }
+            PooledBuffer& operator=(PooledBuffer&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    Reset();
+                    m_homeCache = std::exchange(other.m_homeCache, nullptr);
+                    m_data = std::exchange(other.m_data, nullptr);
+                    m_size = std::exchange(other.m_size, 0);
+                }
+                return *this;
+            }
+            ~PooledBuffer()
+            {
+                Reset();
+            }
+        public:
+            /// <summary> Returns the buffer to its home cache now, leaving the handle empty. It does not allocate, the
+            /// home cache reserves room for all of its buffers. </summary>
+            void Reset() noexcept;
+
+            [[nodiscard]] explicit operator bool() const noexcept { return m_data != nullptr; }
+            [[nodiscard]] std::byte* GetData() const noexcept { return m_data; }
+            [[nodiscard]] std::size_t GetCapacity() const noexcept;
+            [[nodiscard]] std::size_t GetSize() const noexcept { return m_size; }
+            /// <summary> Sets the size of the data written to the buffer, clamped to its capacity. </summary>
+            void SetSize(const std::size_t dataSize) noexcept { m_size = dataSize < GetCapacity() ? dataSize : GetCapacity(); }
+            /// <summary> Returns the data written to the buffer. </summary>
+            [[nodiscard]] std::span<std::byte> GetSpan() const noexcept { return { m_data, m_size }; }
+            /// <summary> Returns the index of the unit cache the buffer belongs to. </summary>
+            [[nodiscard]] std::size_t GetHomeUnit() const noexcept;
+        };
+
+        /// <summary> A unit's cache of free buffers. Use it only from the tasks of its unit (on the unit's work thread),
+        /// except <c>PooledBuffer::Reset</c>, which any thread may call. </summary>
+        class alignas(BufferAlignment) UnitCache
+        {
+            friend class SlabBufferPool;
+            friend class PooledBuffer;
+            SlabBufferPool* m_pool{};
+            std::size_t m_unitIndex{};
+            std::vector<std::byte*> m_freeBuffers{};
+            // Buffers of other units released here, by home unit, returned in batches.
+            std::vector<std::vector<std::byte*>> m_pendingReturns{};
+            // Buffers of this unit returned by others, taken when the free list runs out.
+            std::mutex m_returnedMutex{};
+            std::vector<std::byte*> m_returnedBuffers{};
+            std::atomic<bool> m_hasReturned{ false };
+            // Set when the unit ran out of buffers, so partial batches are returned to it.
+            std::atomic<bool> m_isStarved{ false };
+            std::atomic<std::uint64_t> m_returnBatches{};
+            // Buffers carved for this unit, the free and returned lists are reserved to hold all of them.
+            std::size_t m_ownedBuffers{};
+        public:
+            UnitCache(const UnitCache&) = delete;
+            UnitCache& operator=(const UnitCache&) = delete;
+        private:
+            UnitCache(SlabBufferPool& pool, const std::size_t unitIndex)
+                : m_pool(&pool),
+                m_unitIndex(unitIndex),
+                m_pendingReturns(pool.m_unitCount)
+            {
+            }
+        public:
+            /// <summary> Takes a free buffer, from this cache, else from the buffers returned to it, else from a new slab. </summary>
+            [[nodiscard]]
+            PooledBuffer Acquire()
+            {
+                if (m_freeBuffers.empty() && m_hasReturned.load(std::memory_order_acquire))
+                {
+                    std::lock_guard returnedLock{ m_returnedMutex };
+                    m_freeBuffers.swap(m_returnedBuffers);
+                    m_hasReturned.store(false, std::memory_order_relaxed);
+                }
+                if (m_freeBuffers.empty())
+                {
+                    m_isStarved.store(true, std::memory_order_relaxed);
+                    // Each list can hold every buffer of this unit (they are swapped above), so returning a buffer
+                    // (from PooledBuffer::Reset, which is noexcept) never allocates.
+                    const std::size_t ownedBuffers = m_ownedBuffers + m_pool->m_buffersPerSlab;
+                    m_freeBuffers.reserve(ownedBuffers);
+                    {
+                        std::lock_guard returnedLock{ m_returnedMutex };
+                        m_returnedBuffers.reserve(ownedBuffers);
+                    }
+                    m_pool->allocateSlab(m_freeBuffers);
+                    m_ownedBuffers = ownedBuffers;
+                }
+                PooledBuffer buffer{};
+                buffer.m_homeCache = this;
+                buffer.m_data = m_freeBuffers.back();
+                m_freeBuffers.pop_back();
+                return buffer;
+            }
+
+            /// <summary> Releases a buffer the unit is done with. One of this unit's own is free again at once, one of
+            /// another unit's is added to the batch returned to its home unit. </summary>
+            void Release(PooledBuffer&& buffer)
+            {
+                if (!buffer)
+                    return;
+                UnitCache* homeCache = std::exchange(buffer.m_homeCache, nullptr);
+                std::byte* data = std::exchange(buffer.m_data, nullptr);
+                buffer.m_size = 0;
+                if (homeCache == this)
+                {
+                    m_freeBuffers.emplace_back(data);
+                    return;
+                }
+                auto& pendingReturns = m_pendingReturns[homeCache->m_unitIndex];
+                pendingReturns.emplace_back(data);
+                if (pendingReturns.size() >= m_pool->m_returnBatchSize)
+                    homeCache->returnBuffers(pendingReturns);
+            }
+
+            /// <summary> Returns the partial batches of released buffers to those home units that have run out of
+            /// buffers since they were last returned some, or to every home unit if <c>isAll</c>. </summary>
+            void FlushReturns(const bool isAll = false)
+            {
+                for (std::size_t i = 0; i < m_pendingReturns.size(); i++)
+                {
+                    auto& homeCache = *m_pool->m_unitCaches[i];
+                    if (!m_pendingReturns[i].empty() && (isAll || homeCache.m_isStarved.load(std::memory_order_relaxed)))
+                        homeCache.returnBuffers(m_pendingReturns[i]);
+                }
+            }
+
+            [[nodiscard]] std::size_t GetUnitIndex() const noexcept { return m_unitIndex; }
+            [[nodiscard]] std::size_t GetFreeCount() const noexcept { return m_freeBuffers.size(); }
+            /// <summary> Returns the number of batches of buffers returned to this unit by others. </summary>
+            [[nodiscard]] std::uint64_t GetReturnBatchCount() const noexcept { return m_returnBatches.load(std::memory_order_relaxed); }
+        private:
+            // Moves a batch of this unit's buffers into its returned list, one lock per batch.
+            void returnBuffers(std::vector<std::byte*>& buffers)
+            {
+                {
+                    std::lock_guard returnedLock{ m_returnedMutex };
+                    m_returnedBuffers.insert(m_returnedBuffers.end(), buffers.begin(), buffers.end());
+                    m_hasReturned.store(true, std::memory_order_release);
+                }
+                m_isStarved.store(false, std::memory_order_relaxed);
+                m_returnBatches.fetch_add(1, std::memory_order_relaxed);
+                buffers.clear();
+            }
+
+            // Returns one of this unit's buffers, within the reserved capacity.
+            void returnBuffer(std::byte* data) noexcept
+            {
+                std::lock_guard returnedLock{ m_returnedMutex };
+                m_returnedBuffers.emplace_back(data);
+                m_hasReturned.store(true, std::memory_order_release);
+            }
+        };
+    private:
+        struct SlabDeleter
+        {
+            void operator()(std::byte* slab) const noexcept
+            {
+                ::operator delete[](slab, std::align_val_t{ BufferAlignment });
+            }
+        };
+        using Slab_t = std::unique_ptr<std::byte[], SlabDeleter>;
+    private:
+        std::size_t m_bufferSize{};
+        std::size_t m_buffersPerSlab{};
+        std::size_t m_returnBatchSize{};
+        std::size_t m_unitCount{};
+        std::vector<std::unique_ptr<UnitCache>> m_unitCaches{};
+        std::mutex m_slabsMutex{};
+        std::vector<Slab_t> m_slabs{};
+    public:
+        /// <summary> Ctor, no slab is allocated until a buffer is acquired. </summary>
+        /// <param name="bufferSize"> Capacity of each buffer in bytes, rounded up to a multiple of <c>BufferAlignment</c>
+        /// so buffers do not share cache lines. </param>
+        /// <param name="unitCount"> Number of unit caches, one per unit handing buffers around. </param>
+        /// <param name="buffersPerSlab"> Number of buffers allocated at once, when a unit's cache runs out. </param>
+        /// <param name="returnBatchSize"> Number of another unit's released buffers returned to it at once. </param>
+        SlabBufferPool(const std::size_t bufferSize, const std::size_t unitCount,
+            const std::size_t buffersPerSlab = DefaultBuffersPerSlab, const std::size_t returnBatchSize = DefaultReturnBatchSize)
+            : m_bufferSize((std::max<std::size_t>(bufferSize, 1) + BufferAlignment - 1) / BufferAlignment * BufferAlignment),
+            m_buffersPerSlab(std::max<std::size_t>(buffersPerSlab, 1)),
+            m_returnBatchSize(std::max<std::size_t>(returnBatchSize, 1)),
+            m_unitCount(std::max<std::size_t>(unitCount, 1))
+        {
+            m_unitCaches.reserve(m_unitCount);
+            for (std::size_t i = 0; i < m_unitCount; i++)
+                m_unitCaches.emplace_back(new UnitCache{ *this, i });
+        }
+        SlabBufferPool(const SlabBufferPool&) = delete;
+        SlabBufferPool& operator=(const SlabBufferPool&) = delete;
+    public:
+        /// <summary> Returns the cache of the unit at <c>unitIndex</c>, for the tasks of that unit to acquire and release buffers with. </summary>
+        [[nodiscard]]
+        UnitCache& GetUnitCache(const std::size_t unitIndex)
+        {
+            return *m_unitCaches.at(unitIndex);
+        }
+
+        [[nodiscard]] std::size_t GetBufferSize() const noexcept { return m_bufferSize; }
+        [[nodiscard]] std::size_t GetUnitCount() const noexcept { return m_unitCount; }
+
+        /// <summary> Returns the number of slabs allocated. </summary>
+        [[nodiscard]]
+        std::size_t GetSlabCount()
+        {
+            std::lock_guard slabsLock{ m_slabsMutex };
+            return m_slabs.size();
+        }
+    private:
+        // Allocates a slab, and adds its buffers to a unit's free list.
+        void allocateSlab(std::vector<std::byte*>& freeBuffers)
+        {
+            Slab_t slab{ static_cast<std::byte*>(::operator new[](m_bufferSize * m_buffersPerSlab, std::align_val_t{ BufferAlignment })) };
+            freeBuffers.reserve(freeBuffers.size() + m_buffersPerSlab);
+            for (std::size_t i = m_buffersPerSlab; i > 0; i--)
+                freeBuffers.emplace_back(slab.get() + (i - 1) * m_bufferSize);
+            std::lock_guard slabsLock{ m_slabsMutex };
+            m_slabs.emplace_back(std::move(slab));
+        }
+    };
+
+    inline void SlabBufferPool::PooledBuffer::Reset() noexcept
+    {
+        if (m_data == nullptr)
+            return;
+        std::exchange(m_homeCache, nullptr)->returnBuffer(std::exchange(m_data, nullptr));
+        m_size = 0;
+    }
+
+    inline std::size_t SlabBufferPool::PooledBuffer::GetCapacity() const noexcept
+    {
+        return m_homeCache != nullptr ? m_homeCache->m_pool->m_bufferSize : 0;
+    }
+
+    inline std::size_t SlabBufferPool::PooledBuffer::GetHomeUnit() const noexcept
+    {
+        return m_homeCache != nullptr ? m_homeCache->m_unitIndex : 0;
+    }
+
+    using PooledBuffer = SlabBufferPool::PooledBuffer;
+}
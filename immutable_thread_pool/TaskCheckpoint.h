@@ -0,0 +1,248 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include "CheckpointedTask.h"
+#include "ThreadTaskSource.h"
+#include <cstdio>
+#if defined(__unix__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
+namespace imp
+{
+    namespace detail
+    {
+        inline constexpr char CheckpointMagic[8]{ 'I', 'M', 'P', 'C', 'K', 'P', 'T', '1' };
+
+        // Calls fn with the hooks of each checkpointed task of the task source, in every task list.
+        template<typename Fn_t>
+        void ForEachCheckpointedTask(const ThreadTaskSource& tasks, const Fn_t& fn)
+        {
+            const auto VisitTask = [&fn](const ThreadTaskSource::TaskInfo& task)
+            {
+                if (const auto* taskCheckpoint = GetTaskCheckpoint(task); taskCheckpoint != nullptr)
+                    fn(*taskCheckpoint);
+            };
+            for (const auto& task : tasks.TaskList)
+                VisitTask(task);
+            for (const auto& task : tasks.HighPriorityTaskList)
+                VisitTask(task);
+            for (const auto& signalledTask : tasks.SignalledTaskList)
+                VisitTask(signalledTask.Task);
+            for (const auto& task : tasks.IterationEndTaskList)
+                VisitTask(task);
+        }
+
+        // A read-only view of a checkpoint file's bytes, mapped where supported (so opening it costs a mapping, not a read).
+        class CheckpointFileView
+        {
+#if defined(__unix__)
+            const char* m_mapping{};
+            std::size_t m_mappedBytes{};
+#else
+            std::string m_contents{};
+#endif
+        public:
+            explicit CheckpointFileView(const std::string& path)
+            {
+#if defined(__unix__)
+                const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                    return;
+                struct stat fileStat{};
+                if (::fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+                {
+                    const auto fileBytes = static_cast<std::size_t>(fileStat.st_size);
+                    if (void* mapping = ::mmap(nullptr, fileBytes, PROT_READ, MAP_PRIVATE, fd, 0); mapping != MAP_FAILED)
+                    {
+                        m_mapping = static_cast<const char*>(mapping);
+                        m_mappedBytes = fileBytes;
+                    }
+                }
+                ::close(fd);
+#else
+                std::ifstream checkpointFile{ path, std::ios::binary };
+                m_contents.assign(std::istreambuf_iterator<char>{ checkpointFile }, std::istreambuf_iterator<char>{});
+#endif
+            }
+            CheckpointFileView(const CheckpointFileView&) = delete;
+            CheckpointFileView& operator=(const CheckpointFileView&) = delete;
+            ~CheckpointFileView()
+            {
+#if defined(__unix__)
+                if (m_mapping != nullptr)
+                    ::munmap(const_cast<char*>(m_mapping), m_mappedBytes);
+#endif
+            }
+            [[nodiscard]]
+            std::string_view GetBytes() const
+            {
+#if defined(__unix__)
+                return { m_mapping, m_mappedBytes };
+#else
+                return m_contents;
+#endif
+            }
+        };
+
+        // Writes bytes to a new file at path and flushes it to the disk (not only to the OS) before returning.
+        inline bool WriteFileDurably(const std::string& path, const std::string_view bytes)
+        {
+#if defined(__unix__)
+            const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0)
+                return false;
+            std::size_t bytesWritten = 0;
+            while (bytesWritten < bytes.size())
+            {
+                const auto writeResult = ::write(fd, bytes.data() + bytesWritten, bytes.size() - bytesWritten);
+                if (writeResult < 0 && errno == EINTR)
+                    continue;
+                if (writeResult <= 0)
+                    break;
+                bytesWritten += static_cast<std::size_t>(writeResult);
+            }
+            const bool isSynced = bytesWritten == bytes.size() && ::fsync(fd) == 0;
+            return ::close(fd) == 0 && isSynced;
+#else
+            std::FILE* checkpointFile = std::fopen(path.c_str(), "wb");
+            if (checkpointFile == nullptr)
+                return false;
+            bool isWritten = std::fwrite(bytes.data(), 1, bytes.size(), checkpointFile) == bytes.size() && std::fflush(checkpointFile) == 0;
+#if defined(_WIN32)
+            isWritten = isWritten && ::_commit(::_fileno(checkpointFile)) == 0;
+#endif
+            return std::fclose(checkpointFile) == 0 && isWritten;
+#endif
+        }
+
+        // Syncs the directory holding path, so a rename into it is durable. No-op where directories cannot be synced.
+        inline void SyncParentDirectory(const std::string& path)
+        {
+#if defined(__unix__)
+            auto directoryPath = std::filesystem::path{ path }.parent_path();
+            if (directoryPath.empty())
+                directoryPath = ".";
+            const int fd = ::open(directoryPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0)
+                return;
+            ::fsync(fd);
+            ::close(fd);
+#endif
+        }
+    }
+
+    /// <summary> Returns true if any task of the task source was pushed with checkpoint hooks. </summary>
+    [[nodiscard]]
+    inline bool HasCheckpointedTasks(const ThreadTaskSource& tasks)
+    {
+        bool isAnyCheckpointed = false;
+        detail::ForEachCheckpointedTask(tasks, [&isAnyCheckpointed](const CheckpointedTask&) { isAnyCheckpointed = true; });
+        return isAnyCheckpointed;
+    }
+
+    /// <summary> Writes a checkpoint of the checkpointed tasks' state (each task's <c>Save</c> result, by key) to
+    /// <c>path</c>. The file is written beside the path, flushed to the disk, and renamed over it, so a crash mid-write
+    /// leaves the previous checkpoint intact. On POSIX the directory is synced after the rename, so the new checkpoint
+    /// also survives a power loss once this returns; on other platforms the rename itself may not be durable yet.
+    /// Must not race with the tasks running (call it from the work thread, or a paused unit). </summary>
+    /// <returns> true if written, false if the file could not be written (the previous checkpoint is kept). </returns>
+    inline bool WriteTaskCheckpoint(const std::string& path, const ThreadTaskSource& tasks)
+    {
+        std::string checkpointBytes{ detail::CheckpointMagic, sizeof(detail::CheckpointMagic) };
+        const auto AppendValue = [&checkpointBytes](const auto value)
+        {
+            checkpointBytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        std::uint64_t entryCount = 0;
+        detail::ForEachCheckpointedTask(tasks, [&entryCount](const CheckpointedTask& taskCheckpoint) { entryCount += taskCheckpoint.Save ? 1 : 0; });
+        AppendValue(entryCount);
+        detail::ForEachCheckpointedTask(tasks, [&](const CheckpointedTask& taskCheckpoint)
+            {
+                if (!taskCheckpoint.Save)
+                    return;
+                const std::string state = taskCheckpoint.Save();
+                AppendValue(static_cast<std::uint32_t>(taskCheckpoint.Key.size()));
+                AppendValue(static_cast<std::uint64_t>(state.size()));
+                checkpointBytes.append(taskCheckpoint.Key);
+                checkpointBytes.append(state);
+            });
+        const std::string tempPath = path + ".tmp";
+        if (!detail::WriteFileDurably(tempPath, checkpointBytes))
+        {
+            std::error_code removeError;
+            std::filesystem::remove(tempPath, removeError);
+            return false;
+        }
+        std::error_code renameError;
+        std::filesystem::rename(tempPath, path, renameError);
+        if (renameError)
+            return false;
+        detail::SyncParentDirectory(path);
+        return true;
+    }
+
+    /// <summary> Restores the checkpointed tasks' state from the checkpoint at <c>path</c>, calling each task's
+    /// <c>Restore</c> with the bytes saved under its key (tasks without saved state are left as they are).
+    /// The file is mapped, not read, and each task is handed a view of the mapping. </summary>
+    /// <returns> The number of tasks restored, zero if there is no (valid) checkpoint. </returns>
+    inline std::size_t RestoreTaskCheckpoint(const std::string& path, const ThreadTaskSource& tasks)
+    {
+        if (!HasCheckpointedTasks(tasks))
+            return 0;
+        const detail::CheckpointFileView checkpointFile{ path };
+        std::string_view bytes = checkpointFile.GetBytes();
+        const auto ReadValue = [&bytes](auto& value) -> bool
+        {
+            if (bytes.size() < sizeof(value))
+                return false;
+            std::memcpy(&value, bytes.data(), sizeof(value));
+            bytes.remove_prefix(sizeof(value));
+            return true;
+        };
+        if (bytes.substr(0, sizeof(detail::CheckpointMagic)) != std::string_view{ detail::CheckpointMagic, sizeof(detail::CheckpointMagic) })
+            return 0;
+        bytes.remove_prefix(sizeof(detail::CheckpointMagic));
+        std::uint64_t entryCount{};
+        if (!ReadValue(entryCount))
+            return 0;
+        std::unordered_map<std::string_view, std::string_view> savedStates;
+        for (std::uint64_t i = 0; i < entryCount; i++)
+        {
+            std::uint32_t keySize{};
+            std::uint64_t stateSize{};
+            if (!ReadValue(keySize) || !ReadValue(stateSize) || bytes.size() < keySize || bytes.size() - keySize < stateSize)
+                return 0;
+            const auto key = bytes.substr(0, keySize);
+            const auto state = bytes.substr(keySize, static_cast<std::size_t>(stateSize));
+            bytes.remove_prefix(keySize + static_cast<std::size_t>(stateSize));
+            savedStates.emplace(key, state);
+        }
+        std::size_t tasksRestored = 0;
+        detail::ForEachCheckpointedTask(tasks, [&savedStates, &tasksRestored](const CheckpointedTask& taskCheckpoint)
+            {
+                if (!taskCheckpoint.Restore)
+                    return;
+                if (const auto stateIt = savedStates.find(taskCheckpoint.Key); stateIt != savedStates.end())
+                {
+                    taskCheckpoint.Restore(stateIt->second);
+                    tasksRestored++;
+                }
+            });
+        return tasksRestored;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace imp
+{
+    /// <summary> A stable identity of a task, unique in the process. It stays with the task when the list is edited,
+    /// reordered or copied (copies of a task source share it), so per-task statistics keyed by it (e.g. in a
+    /// <c>std::unordered_map</c>) survive reconfiguration, where an index into the list would not. A default
+    /// constructed handle refers to no task. Copyable. </summary>
+    struct TaskHandle
+    {
+        std::uint64_t Id{};
+
+        [[nodiscard]] explicit operator bool() const noexcept { return Id != 0; }
+        friend auto operator<=>(const TaskHandle&, const TaskHandle&) = default;
+    };
+
+    /// <summary> A task with a stable handle and an optional name. Runs like any other task, with one more indirect
+    /// call. Stored in the task list as the task's <c>std::function</c>, wrapping any other marker (e.g. a
+    /// <c>PrefetchingTask</c>), which is still found through it. Copyable. </summary>
+    struct IdentifiedTask
+    {
+        std::function<void()> Task;
+        TaskHandle Handle;
+        std::string Name;
+
+        void operator()() const
+        {
+            Task();
+        }
+    };
+
+    /// <summary> Returns a new handle, distinct from every handle made before it in the process. Thread-safe. </summary>
+    [[nodiscard]]
+    inline TaskHandle MakeTaskHandle() noexcept
+    {
+        static std::atomic<std::uint64_t> lastTaskId{};
+        return TaskHandle{ lastTaskId.fetch_add(1, std::memory_order_relaxed) + 1 };
+    }
+
+    /// <summary> Returns the identity (handle and name) of a task given one, nullptr for other tasks. </summary>
+    [[nodiscard]]
+    inline const IdentifiedTask* GetTaskIdentity(const std::function<void()>& task) noexcept
+    {
+        return task.target<IdentifiedTask>();
+    }
+
+    /// <summary> Returns the task inside its identity wrapper, or the task itself if it has none. </summary>
+    [[nodiscard]]
+    inline const std::function<void()>& UnwrapTaskIdentity(const std::function<void()>& task) noexcept
+    {
+        const auto* taskIdentity = GetTaskIdentity(task);
+        return taskIdentity != nullptr ? taskIdentity->Task : task;
+    }
+}
+
+template<>
+struct std::hash<imp::TaskHandle>
+{
+    std::size_t operator()(const imp::TaskHandle& taskHandle) const noexcept
+    {
+        return std::hash<std::uint64_t>{}(taskHandle.Id);
+    }
+};
@@ -0,0 +1,137 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ThreadTaskSource.h"
+#include "ThreadPriority.h"
+
+namespace imp
+{
+    /// <summary> Destroys retired task lists on a background thread, so dropping a large list of heavyweight closures
+    /// (sockets, buffers, shared_ptr graphs) does not block the controller. Set it in <c>DispatchOptions::Reclaimer</c>,
+    /// and a unit's <c>DestroyThread</c> and <c>SetTaskSource</c> hand the old list to it instead of destroying it,
+    /// as does the work thread with its copy when it exits. </summary>
+    /// <remarks> Retiring is a move and a push under a lock, independent of the list's size. The reclaimer thread wakes
+    /// on the first retired list, waits <c>BatchDelay</c> for more, then destroys the batch, below normal priority by
+    /// default. A retired object must not hold the last reference to its reclaimer. Destroys any pending objects
+    /// before its destructor returns. Thread-safe. Non-copyable, non-movable, held by shared_ptr. </remarks>
+    class TaskListReclaimer
+    {
+    public:
+        using Retired_t = std::shared_ptr<const void>;
+        static constexpr std::chrono::milliseconds DefaultBatchDelay{ 10 };
+    private:
+        std::chrono::milliseconds m_batchDelay{};
+        std::mutex m_retiredMutex{};
+        std::condition_variable_any m_retiredCv{};
+        std::vector<Retired_t> m_retired{};
+        std::uint64_t m_retiredCount{};
+        std::uint64_t m_reclaimedCount{};
+        std::uint64_t m_batchCount{};
+        std::jthread m_reclaimThread{};
+    public:
+        /// <summary> Ctor, starts the reclaimer thread. </summary>
+        /// <param name="batchDelay"> Time to wait after the first retired object for more to destroy in the same batch. </param>
+        /// <param name="isLowPriority"> Run the reclaimer thread below normal priority. </param>
+        explicit TaskListReclaimer(const std::chrono::milliseconds batchDelay = DefaultBatchDelay, const bool isLowPriority = true)
+            : m_batchDelay(batchDelay)
+        {
+            m_reclaimThread = std::jthread{ [this, isLowPriority](const std::stop_token stopToken)
+                {
+                    if (isLowPriority)
+                        SetCurrentThreadLowPriority();
+                    reclaim(stopToken);
+                } };
+        }
+        TaskListReclaimer(const TaskListReclaimer&) = delete;
+        TaskListReclaimer& operator=(const TaskListReclaimer&) = delete;
+        ~TaskListReclaimer()
+        {
+            m_reclaimThread.request_stop();
+            m_reclaimThread = {};
+        }
+    public:
+        /// <summary> Hands a shared object (e.g. a work thread's task list) to the reclaimer, the reference is dropped
+        /// on the reclaimer thread. </summary>
+        void Retire(Retired_t retired)
+        {
+            if (retired == nullptr)
+                return;
+            {
+                std::lock_guard retiredLock{ m_retiredMutex };
+                m_retired.emplace_back(std::move(retired));
+                m_retiredCount++;
+            }
+            m_retiredCv.notify_all();
+        }
+
+        /// <summary> Hands a task list to the reclaimer, it is destroyed on the reclaimer thread. </summary>
+        void Retire(ThreadTaskSource&& taskSource)
+        {
+            Retire(std::make_shared<const ThreadTaskSource>(std::move(taskSource)));
+        }
+
+        /// <summary> Waits until every object retired so far has been destroyed. </summary>
+        void WaitForReclaimed()
+        {
+            std::unique_lock retiredLock{ m_retiredMutex };
+            const auto retiredCount = m_retiredCount;
+            m_retiredCv.wait(retiredLock, [this, retiredCount]() { return m_reclaimedCount >= retiredCount; });
+        }
+
+        [[nodiscard]] std::chrono::milliseconds GetBatchDelay() const { return m_batchDelay; }
+
+        /// <summary> Returns the number of retired objects not yet destroyed. </summary>
+        [[nodiscard]]
+        std::uint64_t GetPendingCount()
+        {
+            std::lock_guard retiredLock{ m_retiredMutex };
+            return m_retiredCount - m_reclaimedCount;
+        }
+
+        /// <summary> Returns the number of retired objects destroyed. </summary>
+        [[nodiscard]]
+        std::uint64_t GetReclaimedCount()
+        {
+            std::lock_guard retiredLock{ m_retiredMutex };
+            return m_reclaimedCount;
+        }
+
+        /// <summary> Returns the number of batches destroyed. </summary>
+        [[nodiscard]]
+        std::uint64_t GetBatchCount()
+        {
+            std::lock_guard retiredLock{ m_retiredMutex };
+            return m_batchCount;
+        }
+    private:
+        void reclaim(const std::stop_token stopToken)
+        {
+            std::vector<Retired_t> batch;
+            std::unique_lock retiredLock{ m_retiredMutex };
+            while (true)
+            {
+                m_retiredCv.wait(retiredLock, stopToken, [this]() { return !m_retired.empty(); });
+                if (m_retired.empty() && stopToken.stop_requested())
+                    return;
+                // Let a burst of retirements (e.g. restarting a group of units) gather into one batch.
+                if (m_batchDelay > std::chrono::milliseconds::zero() && !stopToken.stop_requested())
+                    m_retiredCv.wait_for(retiredLock, stopToken, m_batchDelay, []() { return false; });
+                batch.swap(m_retired);
+                retiredLock.unlock();
+                const auto batchSize = batch.size();
+                batch.clear();
+                retiredLock.lock();
+                m_reclaimedCount += batchSize;
+                m_batchCount++;
+                m_retiredCv.notify_all();
+            }
+        }
+    };
+}
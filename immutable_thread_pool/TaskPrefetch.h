@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include "TaskHandle.h"
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace imp
+{
+    /// <summary> Issues a prefetch of the cache line holding <c>address</c> into all cache levels, a hint only. </summary>
+    inline void PrefetchAddress(const void* address) noexcept
+    {
+#if defined(_MSC_VER) && !defined(__clang__) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#elif defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address, 0, 3);
+#else
+        (void)address;
+#endif
+    }
+
+    /// <summary> A prefetch function for an address range, prefetches each cache line of (at most
+    /// <c>MaxPrefetchBytes</c> of) the range so that issuing it stays cheap. Copyable. </summary>
+    struct PrefetchRange
+    {
+        static constexpr std::size_t CacheLineBytes{ 64 };
+        static constexpr std::size_t MaxPrefetchBytes{ 4096 };
+        const void* Address{};
+        std::size_t Bytes{};
+
+        void operator()() const noexcept
+        {
+            const auto* bytePtr = static_cast<const std::byte*>(Address);
+            const std::size_t prefetchBytes = std::min(Bytes, MaxPrefetchBytes);
+            for (std::size_t offset = 0; offset < prefetchBytes; offset += CacheLineBytes)
+                PrefetchAddress(bytePtr + offset);
+        }
+    };
+
+    /// <summary> A task with a prefetch function, the work thread calls the prefetch function of the next task
+    /// just before running the current one, so the next task's memory latency is hidden behind the current
+    /// task's work. Stored in the task list as the task's <c>std::function</c>, the work thread finds the
+    /// prefetch function when it is created. Copyable. </summary>
+    struct PrefetchingTask
+    {
+        std::function<void()> Task;
+        std::function<void()> Prefetch;
+
+        void operator()() const
+        {
+            Task();
+        }
+    };
+
+    /// <summary> Returns the prefetch function of a task pushed with a prefetch function (looking through an identity),
+    /// or nullptr. </summary>
+    [[nodiscard]]
+    inline const std::function<void()>* GetTaskPrefetch(const std::function<void()>& task) noexcept
+    {
+        const auto* prefetchingTask = UnwrapTaskIdentity(task).target<PrefetchingTask>();
+        return prefetchingTask != nullptr ? &prefetchingTask->Prefetch : nullptr;
+    }
+}
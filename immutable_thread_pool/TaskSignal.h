@@ -0,0 +1,146 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace imp
+{
+    /// <summary> The set of signalled tasks that are ready to run on a single work thread.
+    /// Producers mark a task index ready, the work thread takes the whole set at once and
+    /// parks on it when nothing is ready. </summary>
+    /// <remarks> A task marked ready more than once before the work thread takes it will only run once.
+    /// Non-copyable, non-movable, shared between the work thread and any bound <c>TaskSignal</c> via shared_ptr. </remarks>
+    class SignalReadySet
+    {
+        using Lock_t = std::unique_lock<std::mutex>;
+    private:
+        std::mutex m_readyMutex{};
+        std::condition_variable m_readyCv{};
+        // Indices of the tasks marked ready, in the order they were signalled.
+        std::vector<std::size_t> m_readyIndices{};
+        // Flag per task index, true if the index is already in m_readyIndices.
+        std::vector<bool> m_isQueued{};
+        // Set by Wake() so a parked work thread returns to check the pause/stop state.
+        bool m_isWakeRequested{ false };
+    public:
+        /// <summary> Ctor, every task starts out ready so it runs once after the thread starts. </summary>
+        /// <param name="taskCount"> Number of signalled tasks on the work thread. </param>
+        explicit SignalReadySet(const std::size_t taskCount)
+            : m_isQueued(taskCount, true)
+        {
+            m_readyIndices.reserve(taskCount);
+            for (std::size_t i = 0; i < taskCount; i++)
+                m_readyIndices.emplace_back(i);
+        }
+        SignalReadySet(const SignalReadySet&) = delete;
+        SignalReadySet& operator=(const SignalReadySet&) = delete;
+    public:
+        /// <summary> Marks the task at <c>index</c> ready, and notifies the work thread. </summary>
+        void MarkReady(const std::size_t index)
+        {
+            {
+                Lock_t readyLock{ m_readyMutex };
+                if (index >= m_isQueued.size() || m_isQueued[index])
+                    return;
+                m_isQueued[index] = true;
+                m_readyIndices.emplace_back(index);
+            }
+            m_readyCv.notify_one();
+        }
+
+        /// <summary> Wakes the work thread if it is parked in <c>WaitForReady</c>, used
+        /// to have it observe a pause or stop request. </summary>
+        void Wake()
+        {
+            {
+                Lock_t readyLock{ m_readyMutex };
+                m_isWakeRequested = true;
+            }
+            m_readyCv.notify_one();
+        }
+
+        /// <summary> Parks the calling thread until a task is ready or <c>Wake</c> is called. </summary>
+        void WaitForReady()
+        {
+            Lock_t readyLock{ m_readyMutex };
+            m_readyCv.wait(readyLock, [this]() { return !m_readyIndices.empty() || m_isWakeRequested; });
+            m_isWakeRequested = false;
+        }
+
+        /// <summary> Parks the calling thread until a task is ready, <c>Wake</c> is called, or <c>maxWait</c> elapses. </summary>
+        template<typename Rep_t, typename Period_t>
+        void WaitForReady(const std::chrono::duration<Rep_t, Period_t> maxWait)
+        {
+            Lock_t readyLock{ m_readyMutex };
+            m_readyCv.wait_for(readyLock, maxWait, [this]() { return !m_readyIndices.empty() || m_isWakeRequested; });
+            m_isWakeRequested = false;
+        }
+
+        /// <summary> Returns true if any task is marked ready. </summary>
+        [[nodiscard]]
+        bool IsAnyReady()
+        {
+            Lock_t readyLock{ m_readyMutex };
+            return !m_readyIndices.empty();
+        }
+
+        /// <summary> Moves the ready task indices into <c>readyOut</c> (which is cleared first), the
+        /// tasks may be signalled again from that point. </summary>
+        void TakeReady(std::vector<std::size_t>& readyOut)
+        {
+            readyOut.clear();
+            Lock_t readyLock{ m_readyMutex };
+            std::swap(readyOut, m_readyIndices);
+            for (const auto index : readyOut)
+                m_isQueued[index] = false;
+        }
+    };
+
+    /// <summary> A signal that a task is bound to, a signalled task is only run by the work thread when
+    /// the signal has been set (by a producer, possibly on another thread unit) since it last ran. </summary>
+    /// <remarks> Copies refer to the same signal. Copyable, Movable. </remarks>
+    class TaskSignal
+    {
+        struct Binding
+        {
+            std::weak_ptr<SignalReadySet> ReadySet;
+            std::size_t TaskIndex{};
+        };
+        struct SignalState
+        {
+            std::mutex BindingMutex{};
+            std::vector<Binding> Bindings{};
+        };
+    private:
+        std::shared_ptr<SignalState> m_state{ std::make_shared<SignalState>() };
+    public:
+        /// <summary> Marks every task bound to this signal ready to run. Bindings to a work thread that
+        /// no longer exists are removed. </summary>
+        void Set() const
+        {
+            std::lock_guard bindingLock{ m_state->BindingMutex };
+            std::erase_if(m_state->Bindings, [](const Binding& binding)
+                {
+                    const auto readySet = binding.ReadySet.lock();
+                    if (readySet == nullptr)
+                        return true;
+                    readySet->MarkReady(binding.TaskIndex);
+                    return false;
+                });
+        }
+
+        /// <summary> Binds the signal to the task at <c>taskIndex</c> of a work thread's ready set,
+        /// called by the thread unit when it creates the work thread. </summary>
+        void Bind(const std::shared_ptr<SignalReadySet>& readySet, const std::size_t taskIndex) const
+        {
+            std::lock_guard bindingLock{ m_state->BindingMutex };
+            std::erase_if(m_state->Bindings, [](const Binding& binding) { return binding.ReadySet.expired(); });
+            m_state->Bindings.emplace_back(Binding{ readySet, taskIndex });
+        }
+
+        bool operator==(const TaskSignal& other) const noexcept = default;
+    };
+}
@@ -0,0 +1,44 @@
+#pragma once
+#if defined(_WIN32)
+namespace imp::detail
+{
+    // Declared here instead of including <Windows.h>, which would reach (with its macros) every includer of
+    // ThreadUnitPlusPlus.h. These match the declarations in <processthreadsapi.h> (HANDLE is void*, BOOL is int),
+    // so they still compile alongside it.
+    extern "C" __declspec(dllimport) void* __stdcall GetCurrentThread();
+    extern "C" __declspec(dllimport) int __stdcall SetThreadPriority(void* threadHandle, int threadPriority);
+    // THREAD_PRIORITY_BELOW_NORMAL
+    inline constexpr int ThreadPriorityBelowNormal{ -1 };
+}
+#elif defined(__linux__)
+#include <cerrno>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace imp
+{
+    /// <summary> Nice value increment applied by <c>SetCurrentThreadLowPriority</c> on Linux. </summary>
+    inline constexpr int LowPriorityNiceIncrement{ 10 };
+
+    /// <summary> Lowers the calling thread's scheduling priority, for background and blocking work: nice
+    /// +<c>LowPriorityNiceIncrement</c> on Linux (nice values are per thread there), THREAD_PRIORITY_BELOW_NORMAL
+    /// on Windows. </summary>
+    /// <returns> true if lowered, false on failure or if the platform is unsupported. </returns>
+    inline bool SetCurrentThreadLowPriority()
+    {
+#if defined(_WIN32)
+        return detail::SetThreadPriority(detail::GetCurrentThread(), detail::ThreadPriorityBelowNormal) != 0;
+#elif defined(__linux__)
+        const auto threadId = static_cast<id_t>(::syscall(SYS_gettid));
+        errno = 0;
+        const int currentNice = ::getpriority(PRIO_PROCESS, threadId);
+        if (currentNice == -1 && errno != 0)
+            return false;
+        return ::setpriority(PRIO_PROCESS, threadId, currentNice + LowPriorityNiceIncrement) == 0;
+#else
+        return false;
+#endif
+    }
+}
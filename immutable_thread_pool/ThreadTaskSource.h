@@ -4,16 +4,30 @@
 #include <functional>
 #include <deque>
 #include <ranges>
+#include <concepts>
+#include <iterator>
+#include <utility>
+#include <string>
+#include <string_view>
+#include "TaskSignal.h"
+#include "TaskHandle.h"
+#include "TaskPrefetch.h"
+#include "BlockingTask.h"
+#include "CheckpointedTask.h"
 
 namespace imp
 {
     /// <summary> Concept for a range of std::function or something convertible to it. </summary>
     template<typename FnRange_t>
-    concept IsFnRange = requires(FnRange_t & t)
-    {
-        { std::ranges::range<FnRange_t> };
-        { std::convertible_to<typename FnRange_t::value_type, std::function<void()>> };
-    };
+    concept IsFnRange = std::ranges::range<FnRange_t>
+        && std::convertible_to<std::ranges::range_reference_t<FnRange_t>, std::function<void()>>;
+
+    /// <summary> Concept for a range of tasks that can be run in place, without converting each element to
+    /// a std::function: a forward range (so it can be iterated again every iteration) of callables, e.g. a
+    /// <c>std::views::transform</c> of a parameter array into task lambdas. </summary>
+    template<typename TaskRange_t>
+    concept IsTaskRange = std::ranges::forward_range<TaskRange_t>
+        && std::invocable<std::ranges::range_reference_t<TaskRange_t>>;
 
 	/// <summary>
 	/// ThreadTaskSource provides a container that holds async tasks, and some functions
@@ -23,14 +37,43 @@ namespace imp
 	{
 	public:
         using TaskInfo = std::function<void()>;
+        /// <summary> A task that is only run when its signal has been set since it last ran. </summary>
+        struct SignalledTaskInfo
+        {
+            TaskSignal Signal;
+            TaskInfo Task;
+        };
+        /// <summary> Runs up to the given number of the next tasks of a range task, returns the number run (fewer
+        /// only at the end of the range). Runs a chunk per call, so the loop over the range is not type-erased. </summary>
+        using RangeCursor_t = std::function<std::size_t(std::size_t)>;
+        /// <summary> A range of tasks run in place, each element is a task. </summary>
+        struct RangeTaskInfo
+        {
+            /// <summary> Makes a cursor at the start of the range, called at the start of each pass over the range. </summary>
+            std::function<RangeCursor_t()> MakeCursor;
+            /// <summary> Number of tasks in the range if it is sized, otherwise one. </summary>
+            std::size_t TaskCount{};
+        };
 	public:
         /// <summary> Public data member, allows direct access to the task source. </summary>
         std::deque<TaskInfo> TaskList{};
+        /// <summary> Public data member, the high priority lane. The whole lane runs at the start of every iteration
+        /// and again after every task of the other lists, so an urgent task waits for at most one other task. </summary>
+        std::deque<TaskInfo> HighPriorityTaskList{};
+        /// <summary> Public data member, the event-triggered tasks. These are not run every iteration,
+        /// only after their signal is set. </summary>
+        std::deque<SignalledTaskInfo> SignalledTaskList{};
+        /// <summary> Public data member, ranges of tasks run in place after the task list, every iteration.
+        /// Each element of a range is a task, no std::function is made per element. </summary>
+        std::deque<RangeTaskInfo> RangeTaskList{};
+        /// <summary> Public data member, tasks run at the end of every iteration (after the infinite and signalled
+        /// tasks), including an iteration cut short by a stop, e.g. to flush output batched by the tasks. </summary>
+        std::deque<TaskInfo> IterationEndTaskList{};
 	public:
         ThreadTaskSource() = default;
         ThreadTaskSource(const IsFnRange auto &taskList)
         {
-            TaskList = taskList;
+            ResetTaskList(taskList);
         }
         ThreadTaskSource(const TaskInfo &&ti)
         {
@@ -72,6 +115,192 @@ namespace imp
             }
         }
 
+        /// <summary> Push a function with zero or more arguments, but no return value, into the task list, with a
+        /// stable handle and a name (see <c>IdentifiedTask</c>) to find, replace or remove it by later. </summary>
+        /// <typeparam name="F"> The type of the function. </typeparam>
+        /// <typeparam name="A"> The types of the arguments. </typeparam>
+        /// <param name="name"> The task's name, may be empty. </param>
+        /// <param name="taskFn"> The function to push. </param>
+        /// <param name="args"> The arguments to pass to the function (by value). </param>
+        /// <returns> The task's handle. </returns>
+        template <typename F, typename... A>
+        TaskHandle PushNamedTaskBack(std::string name, const F& taskFn, const A&... args)
+        {
+            PushInfiniteTaskBack(taskFn, args...);
+            return IdentifyTask(TaskList.back(), std::move(name));
+        }
+
+        /// <summary> Push a function with zero or more arguments, but no return value, onto the front of the task list,
+        /// with a stable handle and a name (see <c>IdentifiedTask</c>). </summary>
+        /// <typeparam name="F"> The type of the function. </typeparam>
+        /// <typeparam name="A"> The types of the arguments. </typeparam>
+        /// <param name="name"> The task's name, may be empty. </param>
+        /// <param name="taskFn"> The function to push. </param>
+        /// <param name="args"> The arguments to pass to the function (by value). </param>
+        /// <returns> The task's handle. </returns>
+        template <typename F, typename... A>
+        TaskHandle PushNamedTaskFront(std::string name, const F& taskFn, const A&... args)
+        {
+            PushInfiniteTaskFront(taskFn, args...);
+            return IdentifyTask(TaskList.front(), std::move(name));
+        }
+
+        /// <summary> Push a function with zero or more arguments, but no return value, into the high priority lane.
+        /// The lane runs between every task of the task list, so keep its tasks short (e.g. polling a queue). </summary>
+        /// <typeparam name="F"> The type of the function. </typeparam>
+        /// <typeparam name="A"> The types of the arguments. </typeparam>
+        /// <param name="taskFn"> The function to push. </param>
+        /// <param name="args"> The arguments to pass to the function (by value). </param>
+        template <typename F, typename... A>
+        void PushHighPriorityTaskBack(const F& taskFn, const A&... args)
+        {
+            if constexpr (sizeof...(args) == 0)
+            {
+                HighPriorityTaskList.emplace_back(TaskInfo{taskFn});
+            }
+            else
+            {
+                HighPriorityTaskList.emplace_back(TaskInfo([taskFn, args...] { taskFn(args...); }));
+            }
+        }
+
+        /// <summary> Push a function with zero or more arguments, but no return value, into the task list,
+        /// with a cheap prefetch function (e.g. a <c>PrefetchRange</c> over the data the task reads) that the work
+        /// thread calls just before running the task before this one. </summary>
+        /// <typeparam name="P"> The type of the prefetch function. </typeparam>
+        /// <typeparam name="F"> The type of the function. </typeparam>
+        /// <typeparam name="A"> The types of the arguments. </typeparam>
+        /// <param name="prefetchFn"> The prefetch function, it must not have side effects other than touching memory. </param>
+        /// <param name="taskFn"> The function to push. </param>
+        /// <param name="args"> The arguments to pass to the function (by value). </param>
+        template <typename P, typename F, typename... A>
+        void PushPrefetchedTaskBack(const P& prefetchFn, const F& taskFn, const A&... args)
+        {
+            if constexpr (sizeof...(args) == 0)
+            {
+                TaskList.emplace_back(TaskInfo{ PrefetchingTask{ TaskInfo{taskFn}, TaskInfo{prefetchFn} } });
+            }
+            else
+            {
+                TaskList.emplace_back(TaskInfo{ PrefetchingTask{ TaskInfo([taskFn, args...] { taskFn(args...); }), TaskInfo{prefetchFn} } });
+            }
+        }
+
+        /// <summary> Push a function with zero or more arguments, but no return value, into the task list, marked as
+        /// blocking. <c>BlockingUnitGroup::RouteBlockingTasks</c> moves it onto a unit for blocking work. </summary>
+        /// <typeparam name="F"> The type of the function. </typeparam>
+        /// <typeparam name="A"> The types of the arguments. </typeparam>
+        /// <param name="taskFn"> The function to push. </param>
+        /// <param name="args"> The arguments to pass to the function (by value). </param>
+        template <typename F, typename... A>
+        void PushBlockingTaskBack(const F& taskFn, const A&... args)
+        {
+            if constexpr (sizeof...(args) == 0)
+            {
+                TaskList.emplace_back(TaskInfo{ BlockingTask{ TaskInfo{taskFn} } });
+            }
+            else
+            {
+                TaskList.emplace_back(TaskInfo{ BlockingTask{ TaskInfo([taskFn, args...] { taskFn(args...); }) } });
+            }
+        }
+
+        /// <summary> Push a function with zero or more arguments, but no return value, into the task list, with checkpoint
+        /// hooks for the state it shares with them (see <c>CheckpointedTask</c> and <c>DispatchOptions::CheckpointPath</c>). </summary>
+        /// <typeparam name="F"> The type of the function. </typeparam>
+        /// <typeparam name="A"> The types of the arguments. </typeparam>
+        /// <param name="key"> The key the task's state is saved under, unique within the unit. </param>
+        /// <param name="saveFn"> Returns the task's state, serialized. </param>
+        /// <param name="restoreFn"> Restores the task's state from the bytes <c>saveFn</c> returned. </param>
+        /// <param name="taskFn"> The function to push. </param>
+        /// <param name="args"> The arguments to pass to the function (by value). </param>
+        template <typename F, typename... A>
+        void PushCheckpointedTaskBack(std::string key, CheckpointedTask::SaveFn_t saveFn, CheckpointedTask::RestoreFn_t restoreFn,
+            const F& taskFn, const A&... args)
+        {
+            if constexpr (sizeof...(args) == 0)
+            {
+                TaskList.emplace_back(TaskInfo{ CheckpointedTask{ TaskInfo{taskFn}, std::move(key), std::move(saveFn), std::move(restoreFn) } });
+            }
+            else
+            {
+                TaskList.emplace_back(TaskInfo{ CheckpointedTask{ TaskInfo([taskFn, args...] { taskFn(args...); }), std::move(key), std::move(saveFn), std::move(restoreFn) } });
+            }
+        }
+
+        /// <summary> Push a function with zero or more arguments, but no return value, into the signalled task list.
+        /// The task runs once when the thread starts, and afterwards only when <c>signal.Set()</c> has been
+        /// called since it last ran. </summary>
+        /// <typeparam name="F"> The type of the function. </typeparam>
+        /// <typeparam name="A"> The types of the arguments. </typeparam>
+        /// <param name="signal"> The signal the task is bound to, set by the producer of the task's input. </param>
+        /// <param name="taskFn"> The function to push. </param>
+        /// <param name="args"> The arguments to pass to the function (by value). </param>
+        template <typename F, typename... A>
+        void PushSignalledTaskBack(const TaskSignal& signal, const F& taskFn, const A&... args)
+        {
+            if constexpr (sizeof...(args) == 0)
+            {
+                SignalledTaskList.emplace_back(SignalledTaskInfo{ signal, TaskInfo{taskFn} });
+            }
+            else
+            {
+                SignalledTaskList.emplace_back(SignalledTaskInfo{ signal, TaskInfo([taskFn, args...] { taskFn(args...); }) });
+            }
+        }
+
+        /// <summary> Push a range of tasks into the range task list, the range is shared (not copied) and iterated in
+        /// place each iteration. The range must stay unchanged while a unit runs it. </summary>
+        /// <param name="taskRange"> The range, each element is a callable taking no arguments. </param>
+        template <IsTaskRange R>
+        void PushRangeTasksBack(std::shared_ptr<R> taskRange)
+        {
+            std::size_t taskCount = 1;
+            if constexpr (std::ranges::sized_range<R>)
+                taskCount = static_cast<std::size_t>(std::ranges::size(*taskRange));
+            RangeTaskList.emplace_back(RangeTaskInfo{ [taskRange]() -> RangeCursor_t
+                {
+                    return [taskRange, taskIt = std::ranges::begin(*taskRange)](const std::size_t maxTasks) mutable -> std::size_t
+                    {
+                        const auto endIt = std::ranges::end(*taskRange);
+                        std::size_t tasksRun = 0;
+                        for (; tasksRun < maxTasks && taskIt != endIt; ++taskIt, ++tasksRun)
+                            std::invoke(*taskIt);
+                        return tasksRun;
+                    };
+                }, taskCount });
+        }
+
+        /// <summary> Push a view of tasks into the range task list, e.g. <c>std::views::transform</c> of a parameter
+        /// array (held by reference, it must outlive the units running it) into task lambdas. The view is copied,
+        /// the elements are made as they are run. Copies of the task source share the view, so do not run a view
+        /// that caches its begin (e.g. <c>std::views::filter</c>) on more than one unit. </summary>
+        /// <param name="taskView"> The view, each element is a callable taking no arguments. </param>
+        template <IsTaskRange V> requires std::ranges::view<V>
+        void PushRangeTasksBack(V taskView)
+        {
+            PushRangeTasksBack(std::make_shared<V>(std::move(taskView)));
+        }
+
+        /// <summary> Push a function with zero or more arguments, but no return value, into the iteration end task list.
+        /// The task runs at the end of every iteration, including an iteration cut short by a stop. </summary>
+        /// <typeparam name="F"> The type of the function. </typeparam>
+        /// <typeparam name="A"> The types of the arguments. </typeparam>
+        /// <param name="taskFn"> The function to push. </param>
+        /// <param name="args"> The arguments to pass to the function (by value). </param>
+        template <typename F, typename... A>
+        void PushIterationEndTaskBack(const F& taskFn, const A&... args)
+        {
+            if constexpr (sizeof...(args) == 0)
+            {
+                IterationEndTaskList.emplace_back(TaskInfo{taskFn});
+            }
+            else
+            {
+                IterationEndTaskList.emplace_back(TaskInfo([taskFn, args...] { taskFn(args...); }));
+            }
+        }
+
         void ResetTaskList(const IsFnRange auto &taskContainer)
         {
             TaskList = {};
@@ -80,6 +309,124 @@ namespace imp
                 TaskList.emplace_back(elem);
             }
         }
+
+        /// <summary> Gives a task of any list a stable handle and a name, in place, e.g. the task just pushed with
+        /// <c>PushPrefetchedTaskBack</c> (<c>IdentifyTask(TaskList.back(), "name")</c>). A task that already has a
+        /// handle keeps it, and its name. </summary>
+        /// <returns> The task's handle. </returns>
+        static TaskHandle IdentifyTask(TaskInfo& task, std::string name = {})
+        {
+            if (const auto* taskIdentity = GetTaskIdentity(task); taskIdentity != nullptr)
+                return taskIdentity->Handle;
+            const auto taskHandle = MakeTaskHandle();
+            task = TaskInfo{ IdentifiedTask{ std::move(task), taskHandle, std::move(name) } };
+            return taskHandle;
+        }
+
+        /// <summary> Returns the task with the handle, in any of the task lists (except the range tasks), or nullptr. </summary>
+        [[nodiscard]]
+        TaskInfo* FindTask(const TaskHandle taskHandle)
+        {
+            TaskInfo* foundTask = nullptr;
+            findTask([taskHandle](const IdentifiedTask& taskIdentity) { return taskIdentity.Handle == taskHandle; },
+                [&foundTask](auto&, const auto taskIt) { foundTask = &getTask(*taskIt); });
+            return foundTask;
+        }
+
+        /// <summary> Returns the handle of the first task with the name (the task list first, then the high priority,
+        /// signalled and iteration end lists), or an empty handle if there is none. </summary>
+        [[nodiscard]]
+        TaskHandle FindTaskHandle(const std::string_view name)
+        {
+            TaskHandle foundHandle{};
+            findTask([name](const IdentifiedTask& taskIdentity) { return taskIdentity.Name == name; },
+                [&foundHandle](auto&, const auto taskIt) { foundHandle = GetTaskIdentity(getTask(*taskIt))->Handle; });
+            return foundHandle;
+        }
+
+        /// <summary> Removes the task with the handle from its list, in place (the rest of the list is not copied). </summary>
+        /// <returns> true if removed, false if no task has the handle. </returns>
+        bool RemoveTask(const TaskHandle taskHandle)
+        {
+            return findTask([taskHandle](const IdentifiedTask& taskIdentity) { return taskIdentity.Handle == taskHandle; },
+                [](auto& taskList, const auto taskIt) { taskList.erase(taskIt); });
+        }
+
+        /// <summary> Replaces the function of the task with the handle, in place, keeping its handle, name and position.
+        /// A task pushed with a marker (prefetching, blocking or checkpointed) keeps it, and its hooks, around the new
+        /// function. A marker given as the new function replaces the marker, if it is of the same kind. </summary>
+        /// <typeparam name="F"> The type of the function. </typeparam>
+        /// <typeparam name="A"> The types of the arguments. </typeparam>
+        /// <param name="taskHandle"> The task's handle. </param>
+        /// <param name="taskFn"> The new function. </param>
+        /// <param name="args"> The arguments to pass to the function (by value). </param>
+        /// <returns> true if replaced, false if no task has the handle or the new function is a marker of another kind. </returns>
+        template <typename F, typename... A>
+        bool ReplaceTask(const TaskHandle taskHandle, const F& taskFn, const A&... args)
+        {
+            TaskInfo* foundTask = FindTask(taskHandle);
+            if (foundTask == nullptr)
+                return false;
+            auto* taskIdentity = foundTask->target<IdentifiedTask>();
+            TaskInfo newTask;
+            if constexpr (sizeof...(args) == 0)
+            {
+                newTask = TaskInfo{taskFn};
+            }
+            else
+            {
+                newTask = TaskInfo([taskFn, args...] { taskFn(args...); });
+            }
+            if (getMarkedTask(newTask) != nullptr)
+            {
+                if (newTask.target_type() != taskIdentity->Task.target_type())
+                    return false;
+                taskIdentity->Task = std::move(newTask);
+            }
+            else if (TaskInfo* markedTask = getMarkedTask(taskIdentity->Task); markedTask != nullptr)
+            {
+                *markedTask = std::move(newTask);
+            }
+            else
+            {
+                taskIdentity->Task = std::move(newTask);
+            }
+            return true;
+        }
+    private:
+        static TaskInfo& getTask(TaskInfo& task) noexcept { return task; }
+        static TaskInfo& getTask(SignalledTaskInfo& signalledTask) noexcept { return signalledTask.Task; }
+
+        // Returns the function inside a task's marker, or nullptr if the task has none.
+        static TaskInfo* getMarkedTask(TaskInfo& task) noexcept
+        {
+            if (auto* prefetchingTask = task.target<PrefetchingTask>(); prefetchingTask != nullptr)
+                return &prefetchingTask->Task;
+            if (auto* blockingTask = task.target<BlockingTask>(); blockingTask != nullptr)
+                return &blockingTask->Task;
+            if (auto* checkpointedTask = task.target<CheckpointedTask>(); checkpointedTask != nullptr)
+                return &checkpointedTask->Task;
+            return nullptr;
+        }
+
+        // Finds the first identified task matching, in list order, and calls onFound with its list and iterator.
+        template<typename Match_t, typename OnFound_t>
+        bool findTask(const Match_t& isMatch, const OnFound_t& onFound)
+        {
+            const auto FindInList = [&](auto& taskList) -> bool
+            {
+                for (auto taskIt = taskList.begin(); taskIt != taskList.end(); ++taskIt)
+                {
+                    if (const auto* taskIdentity = GetTaskIdentity(getTask(*taskIt)); taskIdentity != nullptr && isMatch(*taskIdentity))
+                    {
+                        onFound(taskList, taskIt);
+                        return true;
+                    }
+                }
+                return false;
+            };
+            return FindInList(TaskList) || FindInList(HighPriorityTaskList) || FindInList(SignalledTaskList) || FindInList(IterationEndTaskList);
+        }
 	};
 
 }
\ No newline at end of file
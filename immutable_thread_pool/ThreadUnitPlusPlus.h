@@ -7,8 +7,20 @@
 #include <stop_token>
 #include <memory>
 #include <deque>
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <utility>
 #include "ThreadTaskSource.h"
 #include "BoolCvPack.h"
+#include "TaskSignal.h"
+#include "DispatchOptions.h"
+#include "TaskPrefetch.h"
+#include "TscClock.h"
+#include "UnitTimeSource.h"
+#include "TimerCoalescing.h"
+#include "ThreadPriority.h"
+#include "TaskCheckpoint.h"
 
 namespace imp
 {
@@ -20,9 +32,9 @@ namespace imp
     /// pause conditions, each with their own setter function. Non-copyable, <b>is moveable! (move-construct and move-assign)</b></remarks>
     class ThreadUnitPlusPlus
     {
+    public:
         /// <summary> Constant used to store the loop delay time period when no tasks are present. </summary>
         static constexpr std::chrono::milliseconds EmptyWaitTime{ std::chrono::milliseconds(20) };
-    public:
         using Thread_t = std::jthread;
         using AtomicBool_t = std::atomic<bool>;
         using UniquePtrThread_t = std::unique_ptr<Thread_t>;
@@ -30,6 +42,13 @@ namespace imp
         // Alias for the ThreadTaskSource which provides a container and some operations.
         using TaskOpsProvider_t = imp::ThreadTaskSource;
         using TaskContainer_t = decltype(TaskOpsProvider_t::TaskList);
+        using SignalledTaskContainer_t = decltype(TaskOpsProvider_t::SignalledTaskList);
+        using IterationEndTaskContainer_t = decltype(TaskOpsProvider_t::IterationEndTaskList);
+        using RangeTaskContainer_t = decltype(TaskOpsProvider_t::RangeTaskList);
+        using ReadySetPtr_t = std::shared_ptr<imp::SignalReadySet>;
+        using TaskInfo_t = TaskOpsProvider_t::TaskInfo;
+        // Clock for the work thread's own timing (task durations, time based checks), cheap to read.
+        using Clock_t = imp::TscClock;
 
     private:
         struct ThreadConditionals
@@ -38,6 +57,11 @@ namespace imp
 	        imp::BoolCvPack UnorderedPausePack;
 	        imp::BoolCvPack PauseCompletedPack;
             //BoolCvPack isStopRequested;
+            // One-shot tasks posted to the work thread, run between its tasks. Closed while there is no work thread.
+            std::mutex OneShotMutex;
+            std::vector<TaskInfo_t> OneShotTasks;
+            std::atomic<bool> IsOneShotPending{ false };
+            bool IsOneShotClosed{ true };
             // Waits for both pause requests to be false.
             void WaitForBothPauseRequestsFalse()
             {
@@ -46,9 +70,9 @@ namespace imp
             }
             void Notify()
             {
-                OrderedPausePack.task_running_cv.notify_all();
-                UnorderedPausePack.task_running_cv.notify_all();
-                PauseCompletedPack.task_running_cv.notify_all();
+                OrderedPausePack.NotifyAll();
+                UnorderedPausePack.NotifyAll();
+                PauseCompletedPack.NotifyAll();
             }
             void SetStopSource(const std::stop_source sts)
             {
@@ -57,10 +81,12 @@ namespace imp
                 UnorderedPausePack.stop_source = sts;
             }
         };
+        using ConditionalsPtr_t = std::shared_ptr<ThreadConditionals>;
     private:
 
-        // Pack of items used for pause/unpause/pause-complete "events".
-        ThreadConditionals m_conditionalsPack;
+        // Pack of items used for pause/unpause/pause-complete "events", shared with the work thread so
+        // it remains valid for the thread when this object is moved.
+        ConditionalsPtr_t m_conditionalsPack{ std::make_shared<ThreadConditionals>() };
 
         /// <summary> Smart pointer to the thread to be constructed. </summary>
         UniquePtrThread_t m_workThreadObj{};
@@ -71,11 +97,21 @@ namespace imp
 
         // Stop source for the thread
         std::stop_source m_stopSource{};
+
+        // Ready set of the signalled tasks on the running work thread, shared with the bound signals.
+        ReadySetPtr_t m_readySet{};
+
+        // Options for dispatching the infinite tasks, copied into the work thread at creation.
+        imp::DispatchOptions m_dispatchOptions{};
     public:
-        /// <summary> Ctor creates the thread. </summary>
-        ThreadUnitPlusPlus(const imp::ThreadTaskSource tasks = {})
+        /// <summary> Ctor creates the thread, after restoring the checkpointed tasks' state if <c>CheckpointPath</c> is set. </summary>
+        ThreadUnitPlusPlus(const imp::ThreadTaskSource tasks = {}, const imp::DispatchOptions options = {})
         {
             m_taskList = tasks;
+            m_dispatchOptions = options;
+            // Warm start, the checkpointed tasks restore their state before the work thread starts.
+            if (!m_dispatchOptions.CheckpointPath.empty())
+                RestoreTaskCheckpoint(m_dispatchOptions.CheckpointPath, m_taskList);
             CreateThread(m_taskList, false);
         }
         /// <summary> Dtor destroys the thread. </summary>
@@ -84,22 +120,18 @@ namespace imp
             DestroyThread();
         }
 
-        // Implemented move operations.
+        // Implemented move operations. The moved-from object is left without a thread, as if destroyed.
         ThreadUnitPlusPlus(ThreadUnitPlusPlus&& other) noexcept
-	        : m_conditionalsPack(std::move(other.m_conditionalsPack)),
-	          m_workThreadObj(std::move(other.m_workThreadObj)),
-	          m_taskList(std::move(other.m_taskList)),
-	          m_stopSource(std::move(other.m_stopSource))
         {
+            swapState(other);
         }
         ThreadUnitPlusPlus& operator=(ThreadUnitPlusPlus&& other) noexcept
         {
             if (this == &other)
                 return *this;
-            m_conditionalsPack = std::move(other.m_conditionalsPack);
-            m_workThreadObj = std::move(other.m_workThreadObj);
-            m_taskList = std::move(other.m_taskList);
-            m_stopSource = std::move(other.m_stopSource);
+            // Our own thread must be stopped (and notified, if paused) before it is replaced.
+            DestroyThread();
+            swapState(other);
             return *this;
         }
         // Deleted copy operations.
@@ -112,7 +144,8 @@ namespace imp
         /// <remarks><b>Note:</b> The two different pause states (for <c>true</c> value) are mutually exclusive! Only one may be set at a time. </remarks>
         void SetPauseValueOrdered(const bool enablePause)
         {
-            m_conditionalsPack.OrderedPausePack.UpdateState(enablePause);
+            m_conditionalsPack->OrderedPausePack.UpdateState(enablePause);
+            WakeReadySet();
         }
 
         /// <summary>
@@ -123,7 +156,8 @@ namespace imp
         /// <remarks><b>Note:</b> The two different pause states (for <c>true</c> value) are mutually exclusive! Only one may be set at a time. </remarks>
         void SetPauseValueUnordered(const bool enablePause)
         {
-            m_conditionalsPack.UnorderedPausePack.UpdateState(enablePause);
+            m_conditionalsPack->UnorderedPausePack.UpdateState(enablePause);
+            WakeReadySet();
         }
 
         /// <summary> Generally if the thread is not running, there is an error state or it is destructing. </summary>
@@ -143,28 +177,39 @@ namespace imp
         [[nodiscard]]
         bool GetPauseCompletionStatus() const
         {
-            return m_conditionalsPack.PauseCompletedPack.GetState();
+            return m_conditionalsPack->PauseCompletedPack.GetState();
         }
 
         /// <summary> Called to wait for the thread to enter the "paused" state, after
         /// a call to <c>set_pause_value</c> with <b>true</b>. </summary>
         void WaitForPauseCompleted()
         {
-            const bool pauseReq = m_conditionalsPack.OrderedPausePack.GetState() || m_conditionalsPack.UnorderedPausePack.GetState();
-            const bool needsToWait = !m_conditionalsPack.PauseCompletedPack.GetState();
+            const bool pauseReq = m_conditionalsPack->OrderedPausePack.GetState() || m_conditionalsPack->UnorderedPausePack.GetState();
+            const bool needsToWait = !m_conditionalsPack->PauseCompletedPack.GetState();
             // If pause not yet completed, AND pause is actually requested...
             if (needsToWait && pauseReq)
             {
-                m_conditionalsPack.PauseCompletedPack.WaitForTrue();
+                m_conditionalsPack->PauseCompletedPack.WaitForTrue();
                 //TODO fix the problem of clearing the pause state when a double pause request is made!
             }
         }
 
-        /// <summary> Returns the number of tasks running on the thread task list.</summary>
+        /// <summary> Returns the number of tasks running on the thread task list, including high priority, signalled,
+        /// iteration end and range tasks (an unsized range counts as one task).</summary>
         [[nodiscard]]
     	std::size_t GetNumberOfTasks() const
         {
-            return m_taskList.TaskList.size();
+            return CountTasks(m_taskList);
+        }
+
+        /// <summary> Returns the number of tasks a unit running <c>tasks</c> reports, see <c>GetNumberOfTasks</c>. </summary>
+        [[nodiscard]]
+        static std::size_t CountTasks(const ThreadTaskSource& tasks)
+        {
+            std::size_t rangeTaskCount = 0;
+            for (const auto& rangeTask : tasks.RangeTaskList)
+                rangeTaskCount += rangeTask.TaskCount;
+            return tasks.TaskList.size() + tasks.HighPriorityTaskList.size() + tasks.SignalledTaskList.size() + tasks.IterationEndTaskList.size() + rangeTaskCount;
         }
 
         /// <summary> Returns a copy of the last set immutable task list, it should mirror
@@ -176,14 +221,55 @@ namespace imp
         }
 
         /// <summary> Stops the thread, replaces the task list, creates the thread again. </summary>
+        /// <remarks> The new tasks keep the state they carry, they are not restored from <c>CheckpointPath</c>
+        /// (call <c>RestoreTaskCheckpoint</c> on them first for that). </remarks>
         void SetTaskSource(const ThreadTaskSource newTaskList)
         {
             StartDestruction();
             WaitForDestruction();
+            retireTaskList();
             m_taskList = newTaskList;
             CreateThread(newTaskList);
         }
 
+        /// <summary> Posts a one-shot task to the work thread, run once between its tasks (e.g. to flush thread-local
+        /// caches), before the next task or chunk of <c>CheckEveryTasks</c> tasks. A paused unit runs it when resumed,
+        /// a throttled unit while it waits, and a stopping unit before its work thread exits. </summary>
+        /// <returns> true if posted, false if the unit has no work thread to run it. </returns>
+        bool PostOneShotTask(TaskInfo_t oneShotTask)
+        {
+            {
+                std::lock_guard oneShotLock{ m_conditionalsPack->OneShotMutex };
+                if (m_conditionalsPack->IsOneShotClosed)
+                    return false;
+                m_conditionalsPack->OneShotTasks.emplace_back(std::move(oneShotTask));
+                m_conditionalsPack->IsOneShotPending.store(true, std::memory_order_release);
+            }
+            WakeReadySet();
+            return true;
+        }
+
+        /// <summary> Returns the options the work thread dispatches its tasks with. </summary>
+        [[nodiscard]]
+        auto GetDispatchOptions() const -> imp::DispatchOptions
+        {
+            return m_dispatchOptions;
+        }
+
+        /// <summary> Stops the thread, replaces the dispatch options, creates the thread again with the same task list. </summary>
+        /// <remarks> The stopping thread checkpoints to the old <c>CheckpointPath</c> (if set). A changed, non-empty
+        /// <c>CheckpointPath</c> is restored from before the thread starts again, as on construction. </remarks>
+        void SetDispatchOptions(const imp::DispatchOptions options)
+        {
+            StartDestruction();
+            WaitForDestruction();
+            const bool isCheckpointPathChanged = options.CheckpointPath != m_dispatchOptions.CheckpointPath;
+            m_dispatchOptions = options;
+            if (isCheckpointPathChanged && !m_dispatchOptions.CheckpointPath.empty())
+                RestoreTaskCheckpoint(m_dispatchOptions.CheckpointPath, m_taskList);
+            CreateThread(m_taskList);
+        }
+
         /// <summary> Destructs the running thread after it finishes running the current task it's on
         /// within the task list. Marks the thread func to stop then joins and waits for it to return. </summary>
         /// <remarks><b>WILL CLEAR the task source!</b> To start the thread again, just set a new task source.</remarks>
@@ -191,7 +277,7 @@ namespace imp
         {
             StartDestruction();
             WaitForDestruction();
-            m_taskList.TaskList = {};
+            retireTaskList();
         }
     private:
         /// <summary> Starts the work thread running, to execute each task in the list infinitely. </summary>
@@ -201,15 +287,27 @@ namespace imp
             if (m_workThreadObj == nullptr)
             {
                 //reset some conditionals aka std::condition_variable 
-                m_conditionalsPack.PauseCompletedPack.UpdateState(false);
-                m_conditionalsPack.OrderedPausePack.UpdateState(isPausedOnStart);
-                m_conditionalsPack.UnorderedPausePack.UpdateState(false);
-                //make thread obj
-                m_workThreadObj = std::make_unique<Thread_t>([=, this](std::stop_token st) { threadPoolFunc(st, tasks.TaskList); });
-                //make local handle to stop_source for thread
-                m_stopSource = m_workThreadObj->get_stop_source();
-                //update conditionals pack to have stop handle
-                m_conditionalsPack.SetStopSource(m_stopSource);
+                m_conditionalsPack->PauseCompletedPack.UpdateState(false);
+                m_conditionalsPack->OrderedPausePack.UpdateState(isPausedOnStart);
+                m_conditionalsPack->UnorderedPausePack.UpdateState(false);
+                //make a new stop source, and update conditionals pack to have stop handle before the thread can wait on it
+                m_stopSource = {};
+                m_conditionalsPack->SetStopSource(m_stopSource);
+                {
+                    std::lock_guard oneShotLock{ m_conditionalsPack->OneShotMutex };
+                    m_conditionalsPack->IsOneShotClosed = false;
+                }
+                //make ready set for the signalled tasks, and bind each task's signal to it
+                m_readySet = std::make_shared<imp::SignalReadySet>(tasks.SignalledTaskList.size());
+                for (std::size_t i = 0; i < tasks.SignalledTaskList.size(); i++)
+                    tasks.SignalledTaskList[i].Signal.Bind(m_readySet, i);
+                //make thread obj, the task list is shared with it (immutable) and handed to the reclaimer (if set) when it exits
+                m_workThreadObj = std::make_unique<Thread_t>([tasksPtr = std::make_shared<const ThreadTaskSource>(tasks), options = m_dispatchOptions, conditionals = m_conditionalsPack, readySet = m_readySet, st = m_stopSource.get_token()]() mutable
+                {
+                    threadPoolFunc(st, *tasksPtr, options, readySet, conditionals);
+                    if (options.Reclaimer != nullptr)
+                        options.Reclaimer->Retire(std::move(tasksPtr));
+                });
                 return true;
             }
             return false;
@@ -221,7 +319,35 @@ namespace imp
         void StartDestruction()
         {
             m_stopSource.request_stop();
-            m_conditionalsPack.Notify();
+            m_conditionalsPack->Notify();
+            WakeReadySet();
+        }
+
+        /// <summary> Exchanges the thread and state with another unit, used by the move operations. </summary>
+        void swapState(ThreadUnitPlusPlus& other) noexcept
+        {
+            std::swap(m_conditionalsPack, other.m_conditionalsPack);
+            std::swap(m_workThreadObj, other.m_workThreadObj);
+            std::swap(m_taskList, other.m_taskList);
+            std::swap(m_stopSource, other.m_stopSource);
+            std::swap(m_readySet, other.m_readySet);
+            std::swap(m_dispatchOptions, other.m_dispatchOptions);
+        }
+
+        /// <summary> Clears the task list, handing it to the reclaimer (if set) instead of destroying it on the calling thread. </summary>
+        void retireTaskList()
+        {
+            if (m_dispatchOptions.Reclaimer != nullptr)
+                m_dispatchOptions.Reclaimer->Retire(std::exchange(m_taskList, {}));
+            else
+                m_taskList = {};
+        }
+
+        /// <summary> Wakes the work thread if it is parked waiting for a signalled task. </summary>
+        void WakeReadySet() const
+        {
+            if (m_readySet != nullptr)
+                m_readySet->Wake();
         }
 
         /// <summary> Joins the work thread to the current thread and waits. </summary>
@@ -237,60 +363,471 @@ namespace imp
             }
         }
 
+        /// <summary> Takes the posted one-shot tasks and runs them, closing the mailbox if <c>isClosing</c>. Kept out of
+        /// the dispatch loop, which only loads the pending flag. </summary>
+#if defined(_MSC_VER)
+        __declspec(noinline)
+#else
+        [[gnu::noinline]]
+#endif
+        static void runOneShotTasks(ThreadConditionals& conditionals, const bool isClosing)
+        {
+            std::vector<TaskInfo_t> oneShotTasks;
+            {
+                std::lock_guard oneShotLock{ conditionals.OneShotMutex };
+                oneShotTasks.swap(conditionals.OneShotTasks);
+                conditionals.IsOneShotPending.store(false, std::memory_order_relaxed);
+                conditionals.IsOneShotClosed = conditionals.IsOneShotClosed || isClosing;
+            }
+            for (const auto& oneShotTask : oneShotTasks)
+                oneShotTask();
+        }
+
+        /// <summary> Returns the prefetch function of each task in the list (empty functions for tasks without one),
+        /// or an empty list if no task has a prefetch function. </summary>
+        static auto makePrefetchList(const auto& dispatchList) -> std::vector<TaskInfo_t>
+        {
+            std::vector<TaskInfo_t> prefetches(dispatchList.size());
+            bool isAnyPrefetch = false;
+            for (std::size_t i = 0; i < dispatchList.size(); i++)
+            {
+                if (const auto* taskPrefetch = imp::GetTaskPrefetch(dispatchList[i]); taskPrefetch != nullptr && *taskPrefetch)
+                {
+                    prefetches[i] = *taskPrefetch;
+                    isAnyPrefetch = true;
+                }
+            }
+            if (!isAnyPrefetch)
+                prefetches.clear();
+            return prefetches;
+        }
+
+        /// <summary> Builds the fused dispatch list, runs of consecutive small tasks (by their measured duration) are
+        /// fused into a single dispatch of at most <c>CheckEveryTasks</c> tasks and <c>CheckEveryTime</c> measured time. </summary>
+        static auto makeFusedDispatchList(const TaskContainer_t& tasks, const std::vector<std::chrono::nanoseconds>& taskDurations,
+            const imp::DispatchOptions& options) -> std::vector<TaskInfo_t>
+        {
+            const std::size_t maxFusedTasks = std::max<std::size_t>(options.CheckEveryTasks, 1);
+            const std::chrono::nanoseconds maxFusedTime = options.CheckEveryTime;
+            std::vector<TaskInfo_t> dispatchList;
+            std::vector<TaskInfo_t> currentRun;
+            std::chrono::nanoseconds currentRunTime{};
+            const auto FlushRun = [&]()
+            {
+                if (currentRun.size() == 1)
+                {
+                    dispatchList.emplace_back(std::move(currentRun.front()));
+                }
+                else if (currentRun.size() > 1)
+                {
+                    // Prefetches within the run are issued by the fused dispatch, the first task's by the work thread.
+                    auto runPrefetches = makePrefetchList(currentRun);
+                    if (runPrefetches.empty())
+                    {
+                        dispatchList.emplace_back([run = std::move(currentRun)]() { for (const auto& task : run) task(); });
+                    }
+                    else
+                    {
+                        TaskInfo_t firstPrefetch = runPrefetches.front();
+                        TaskInfo_t fusedRun = [run = std::move(currentRun), runPrefetches = std::move(runPrefetches)]()
+                        {
+                            for (std::size_t i = 0; i < run.size(); i++)
+                            {
+                                if (i + 1 < run.size() && runPrefetches[i + 1])
+                                    runPrefetches[i + 1]();
+                                run[i]();
+                            }
+                        };
+                        dispatchList.emplace_back(firstPrefetch ? TaskInfo_t{ PrefetchingTask{ std::move(fusedRun), std::move(firstPrefetch) } } : std::move(fusedRun));
+                    }
+                }
+                currentRun = {};
+                currentRunTime = {};
+            };
+            for (std::size_t i = 0; i < tasks.size(); i++)
+            {
+                if (taskDurations[i] >= options.SmallTaskThreshold)
+                {
+                    FlushRun();
+                    dispatchList.emplace_back(tasks[i]);
+                    continue;
+                }
+                const bool isTimeFull = maxFusedTime > std::chrono::nanoseconds::zero() && currentRunTime + taskDurations[i] > maxFusedTime;
+                if (currentRun.size() == maxFusedTasks || isTimeFull)
+                    FlushRun();
+                currentRun.emplace_back(tasks[i]);
+                currentRunTime += taskDurations[i];
+            }
+            FlushRun();
+            return dispatchList;
+        }
+
         /// <summary> The worker function, on the created running thread. </summary>
         /// <param name="stopToken"> Passed in the std::jthread automatically at creation. </param>
-        /// <param name="tasks"> List of tasks copied into this worker function, it is not mutated in-use. </param>
-        void threadPoolFunc(const std::stop_token stopToken, const TaskContainer_t tasks)
+        /// <param name="taskSource"> Task lists shared with this worker function, they are not mutated in-use. The task list runs
+        /// every iteration, the high priority lane at the start of each iteration and after every other task, the range
+        /// tasks after the task list, only the ready signalled tasks, and the iteration end tasks at the end of every
+        /// iteration (including the one ended by a stop). </param>
+        /// <param name="options"> Dispatch options, how often the pause/stop state is checked, whether tasks are fused,
+        /// where state change events are posted, where task state is checkpointed, and whether the thread is profiled. </param>
+        /// <param name="readySet"> Ready set the signalled tasks' signals are bound to. </param>
+        /// <param name="conditionals"> Pause/unpause/pause-complete pack shared with the owning unit. </param>
+        static void threadPoolFunc(const std::stop_token stopToken, const ThreadTaskSource& taskSource,
+            const imp::DispatchOptions options, const ReadySetPtr_t readySet, const ConditionalsPtr_t conditionals)
         {
-            const auto TestAndWaitForPauseEither = [](ThreadConditionals& pauseObj)
+            // A profiled thread runs a copy of its tasks that mark themselves for the samples, so the dispatch is unchanged.
+            const auto threadSampler = options.Profiler != nullptr ? options.Profiler->SampleThread(options.UnitName, taskSource) : SamplingProfiler::ThreadSampler{};
+            const bool isProfiling = threadSampler.IsSampling();
+            const ThreadTaskSource profiledTaskSource = isProfiling ? threadSampler.MakeProfiledTasks(taskSource) : ThreadTaskSource{};
+            const ThreadTaskSource& dispatchSource = isProfiling ? profiledTaskSource : taskSource;
+            const TaskContainer_t& tasks = dispatchSource.TaskList;
+            const TaskContainer_t& highPriorityTasks = dispatchSource.HighPriorityTaskList;
+            const RangeTaskContainer_t& rangeTasks = dispatchSource.RangeTaskList;
+            const SignalledTaskContainer_t& signalledTasks = dispatchSource.SignalledTaskList;
+            const IterationEndTaskContainer_t& iterationEndTasks = dispatchSource.IterationEndTaskList;
+            // Checkpoints are written between tasks on this thread, so they never race with the tasks' state.
+            const bool isCheckpointEnabled = !options.CheckpointPath.empty() && HasCheckpointedTasks(taskSource);
+            const auto WriteCheckpoint = [&]()
             {
+                if (isCheckpointEnabled)
+                    WriteTaskCheckpoint(options.CheckpointPath, taskSource);
+            };
+            const auto PostStateEvent = [&options](const UnitStateEvent stateEvent)
+            {
+                if (options.StateEvents != nullptr)
+                    options.StateEvents->Post(stateEvent);
+            };
+            // Runs the one-shot tasks posted since the last call, the flag keeps the check to one atomic load.
+            const auto RunOneShotTasks = [&conditionals](const bool isClosing = false)
+            {
+                if (isClosing || conditionals->IsOneShotPending.load(std::memory_order_acquire))
+                    runOneShotTasks(*conditionals, isClosing);
+            };
+            // The unit's time source (if set), or the aligned real time source, is the time source of this thread and its tasks.
+            const bool isWakeupAligned = options.WakeupAlignment > std::chrono::microseconds::zero();
+            CoalescingTimeSource coalescingSource{ options.WakeupAlignment };
+            std::optional<ScopedTimeSource> scopedTimeSource;
+            if (options.TimeSource != nullptr)
+                scopedTimeSource.emplace(*options.TimeSource);
+            else if (isWakeupAligned)
+                scopedTimeSource.emplace(coalescingSource);
+            TimeSource& timeSource = UnitTime::Current();
+            // A simulated time source schedules this thread, the blocking waits below go through it instead.
+            const bool isTimeSimulated = timeSource.IsSimulated();
+            // Wake checks of the waits on simulated time: a pause, stop or one-shot task request, or a ready signalled task.
+            const std::function<bool()> isResumeRequested = [&]()
+            {
+                return stopToken.stop_requested() || !(conditionals->OrderedPausePack.GetState() || conditionals->UnorderedPausePack.GetState());
+            };
+            const std::function<bool()> isWakeRequested = [&]()
+            {
+                return stopToken.stop_requested() || conditionals->OrderedPausePack.GetState() || conditionals->UnorderedPausePack.GetState()
+                    || conditionals->IsOneShotPending.load(std::memory_order_acquire) || readySet->IsAnyReady();
+            };
+            const auto WaitForResume = [&](ThreadConditionals& pauseObj)
+            {
+                if (isTimeSimulated)
+                    timeSource.WaitUntil(TimeSource::TimePoint_t::max(), isResumeRequested);
+                else
+                    pauseObj.WaitForBothPauseRequestsFalse();
+            };
+            const auto ReportTasksRun = [&](const std::size_t taskCount)
+            {
+                if (isTimeSimulated)
+                    timeSource.OnTasksRun(taskCount);
+            };
+            // Reads the clock for task durations and time based checks, the cheap TSC clock unless time is simulated.
+            const auto ReadTaskClock = [&]() -> std::chrono::nanoseconds
+            {
+                if (isTimeSimulated)
+                    return std::chrono::duration_cast<std::chrono::nanoseconds>(timeSource.Now().time_since_epoch());
+                return Clock_t::now().time_since_epoch();
+            };
+            const auto TestAndWaitForPauseEither = [&](ThreadConditionals& pauseObj)
+            {
+                RunOneShotTasks();
                 // If either ordered or unordered pause set
                 if (pauseObj.OrderedPausePack.GetState() || pauseObj.UnorderedPausePack.GetState())
                 {
+                    // An ordered pause is at the end of an iteration, checkpoint before reporting it complete
+                    if (pauseObj.OrderedPausePack.GetState())
+                        WriteCheckpoint();
                     // Set pause completion event, which sends the notify
                     pauseObj.PauseCompletedPack.UpdateState(true);
+                    PostStateEvent(UnitStateEvent::PauseCompleted);
                     // Wait until the pause state is toggled back to false (both)
-                    pauseObj.WaitForBothPauseRequestsFalse();
+                    WaitForResume(pauseObj);
                     // Reset the pause completed state and continue
                     pauseObj.PauseCompletedPack.UpdateState(false);
+                    if (!stopToken.stop_requested())
+                        PostStateEvent(UnitStateEvent::Resumed);
                 }
             };
-            const auto TestAndWaitForPauseUnordered = [](ThreadConditionals& pauseObj)
+            const auto TestAndWaitForPauseUnordered = [&](ThreadConditionals& pauseObj)
             {
+                RunOneShotTasks();
                 // If either ordered or unordered pause set
                 if (pauseObj.UnorderedPausePack.GetState())
                 {
                     // Set pause completion event, which sends the notify
                     pauseObj.PauseCompletedPack.UpdateState(true);
+                    PostStateEvent(UnitStateEvent::PauseCompleted);
                     // Wait until the pause state is toggled back to false (both)
-                    pauseObj.WaitForBothPauseRequestsFalse();
-                    // Reset the pause completed state and continue
-                    pauseObj.UnorderedPausePack.UpdateState(false);
+                    WaitForResume(pauseObj);
+                    // Reset the pause completed state and continue. The pause request itself is not reset here,
+                    // it is already false and clearing it could drop a new request made since the wait returned.
+                    pauseObj.PauseCompletedPack.UpdateState(false);
+                    if (!stopToken.stop_requested())
+                        PostStateEvent(UnitStateEvent::Resumed);
+                }
+            };
+            const std::size_t checkEveryTasks = std::max<std::size_t>(options.CheckEveryTasks, 1);
+            const bool isTimeCheckEnabled = options.CheckEveryTime > std::chrono::microseconds::zero();
+            const bool isHighLaneEnabled = !highPriorityTasks.empty();
+            // Runs the whole high priority lane, checking the pause/stop state before each task. Returns false if stopped.
+            const auto RunHighPriorityTasks = [&]() -> bool
+            {
+                for (const auto& highTask : highPriorityTasks)
+                {
+                    TestAndWaitForPauseUnordered(*conditionals);
+                    if (stopToken.stop_requested())
+                        return false;
+                    highTask();
+                    ReportTasksRun(1);
+                }
+                return true;
+            };
+            // Runs the task at taskIt, first issuing the prefetch of the task after it (the first task, at the end of the list).
+            const auto RunTaskAt = [](const auto& dispatchList, const auto taskIt, const std::vector<TaskInfo_t>& prefetches)
+            {
+                if (!prefetches.empty())
+                {
+                    auto nextIndex = static_cast<std::size_t>(taskIt - dispatchList.begin()) + 1;
+                    if (nextIndex == prefetches.size())
+                        nextIndex = 0;
+                    if (const auto& nextPrefetch = prefetches[nextIndex])
+                        nextPrefetch();
+                }
+                (*taskIt)();
+            };
+            // The per-dispatch check loop reads no clock and calls no time source hook, so it is only taken without
+            // CheckEveryTime and on real time. A simulated time source is charged for each task by the chunked loops.
+            const bool isFastDispatchEnabled = !isTimeCheckEnabled && !isTimeSimulated;
+            // Runs a dispatch list in chunks of checkEvery dispatches, checking the pause/stop state before each chunk.
+            // With CheckEveryTime set, a chunk also ends once that much time has passed since its check.
+            // Records each dispatch's duration if durations is set. The high priority lane runs after each dispatch.
+            // Returns false if stopped part way through.
+            const auto RunDispatchList = [&](const auto& dispatchList, const std::vector<TaskInfo_t>& prefetches, const std::size_t checkEvery,
+                std::vector<std::chrono::nanoseconds>* durations) -> bool
+            {
+                if (checkEvery == 1 && durations == nullptr && isFastDispatchEnabled)
+                {
+                    for (auto taskIt = dispatchList.begin(); taskIt != dispatchList.end(); ++taskIt)
+                    {
+                        TestAndWaitForPauseUnordered(*conditionals);
+                        if (stopToken.stop_requested())
+                            return false;
+                        RunTaskAt(dispatchList, taskIt, prefetches);
+                        if (isHighLaneEnabled && !RunHighPriorityTasks())
+                            return false;
+                    }
+                    return true;
+                }
+                auto taskIt = dispatchList.begin();
+                const auto endIt = dispatchList.end();
+                while (taskIt != endIt)
+                {
+                    //test for unordered pause request (before the fn call!)
+                    TestAndWaitForPauseUnordered(*conditionals);
+                    //double check outer condition here, as this may be long-running,
+                    //causes destruction to occur unordered.
+                    if (stopToken.stop_requested())
+                        return false;
+                    const auto remaining = static_cast<std::size_t>(endIt - taskIt);
+                    const auto chunkEndIt = taskIt + static_cast<std::ptrdiff_t>(std::min(remaining, checkEvery));
+                    if (durations != nullptr)
+                    {
+                        for (; taskIt != chunkEndIt; ++taskIt)
+                        {
+                            const auto startTime = ReadTaskClock();
+                            RunTaskAt(dispatchList, taskIt, prefetches);
+                            ReportTasksRun(1);
+                            durations->emplace_back(ReadTaskClock() - startTime);
+                            if (isHighLaneEnabled && !RunHighPriorityTasks())
+                                return false;
+                        }
+                    }
+                    else if (isTimeCheckEnabled)
+                    {
+                        const auto checkTime = ReadTaskClock();
+                        for (; taskIt != chunkEndIt; )
+                        {
+                            RunTaskAt(dispatchList, taskIt++, prefetches);
+                            ReportTasksRun(1);
+                            if (isHighLaneEnabled && !RunHighPriorityTasks())
+                                return false;
+                            if (ReadTaskClock() - checkTime >= options.CheckEveryTime)
+                                break;
+                        }
+                    }
+                    else
+                    {
+                        // run the tasks, no control state checks within the chunk
+                        for (; taskIt != chunkEndIt; ++taskIt)
+                        {
+                            RunTaskAt(dispatchList, taskIt, prefetches);
+                            ReportTasksRun(1);
+                            if (isHighLaneEnabled && !RunHighPriorityTasks())
+                                return false;
+                        }
+                    }
+                }
+                return true;
+            };
+            // Runs each range task in place, in chunks of checkEveryTasks tasks with a pause/stop check before each chunk.
+            // With a high priority lane, the chunks are single tasks and the lane runs after each.
+            const std::size_t rangeChunkTasks = isHighLaneEnabled ? 1 : checkEveryTasks;
+            const auto RunRangeTasks = [&]()
+            {
+                for (const auto& rangeTask : rangeTasks)
+                {
+                    auto rangeCursor = rangeTask.MakeCursor();
+                    for (bool isMoreTasks = true; isMoreTasks; )
+                    {
+                        TestAndWaitForPauseUnordered(*conditionals);
+                        if (stopToken.stop_requested())
+                            return;
+                        const auto tasksRun = rangeCursor(rangeChunkTasks);
+                        if (tasksRun > 0)
+                            ReportTasksRun(tasksRun);
+                        isMoreTasks = tasksRun == rangeChunkTasks;
+                        if (isHighLaneEnabled && !RunHighPriorityTasks())
+                            return;
+                    }
                 }
             };
+            // Fused dispatch list, built from the task durations of the first complete iteration if fusion is enabled.
+            std::vector<TaskInfo_t> fusedTasks;
+            // Prefetch functions of the tasks (or of the fused dispatches), empty if no task has one.
+            const std::vector<TaskInfo_t> taskPrefetches = makePrefetchList(taskSource.TaskList);
+            std::vector<TaskInfo_t> fusedPrefetches;
+            std::vector<std::chrono::nanoseconds> taskDurations;
+            // A fused dispatch runs several tasks, a profiled thread runs them one by one to tell them apart.
+            bool isFusionPending = options.IsTaskFusionEnabled && !tasks.empty() && !isProfiling;
+            if (options.IsLowPriority)
+                SetCurrentThreadLowPriority();
+            // Timer slack and wakeup alignment apply to this thread's waits, and its tasks' UnitTime sleeps.
+            if (options.TimerSlack > std::chrono::nanoseconds::zero())
+                SetThreadTimerSlack(options.TimerSlack);
+            // Indices of the signalled tasks taken from the ready set, reused each iteration.
+            std::vector<std::size_t> readyIndices;
+            readyIndices.reserve(signalledTasks.size());
+            if (isTimeSimulated)
+                timeSource.OnThreadStarted(stopToken);
             // While not is stop requested.
             while (!stopToken.stop_requested())
             {
                 //test for ordered pause
-                TestAndWaitForPauseEither(m_conditionalsPack);
+                TestAndWaitForPauseEither(*conditionals);
+                // Cache the iteration start time, tasks read it with UnitTime::IterationNow().
+                UnitTime::detail::IterationTime() = UnitTime::Now();
 
-                if (tasks.empty())
+                if (tasks.empty() && highPriorityTasks.empty() && rangeTasks.empty() && signalledTasks.empty())
                 {
-                    std::this_thread::sleep_for(EmptyWaitTime);
+                    // Parked on the ready set so a pause or stop request wakes the thread without waiting out the period.
+                    if (isTimeSimulated)
+                    {
+                        timeSource.WaitUntil(AlignWakeup(timeSource.Now() + EmptyWaitTime, options.WakeupAlignment), isWakeRequested);
+                    }
+                    else if (isWakeupAligned)
+                    {
+                        const auto waitStart = timeSource.Now();
+                        readySet->WaitForReady(AlignWakeup(waitStart + EmptyWaitTime, options.WakeupAlignment) - waitStart);
+                    }
+                    else
+                    {
+                        readySet->WaitForReady(EmptyWaitTime);
+                    }
                 }
+                if (isHighLaneEnabled)
+                    RunHighPriorityTasks();
                 // Iterate task list, running tasks set for this thread.
-                for (const auto& currentTask : tasks)
+                if (!fusedTasks.empty())
                 {
-                    //test for unordered pause request (before the fn call!)
-                    TestAndWaitForPauseUnordered(m_conditionalsPack);
-                    //double check outer condition here, as this may be long-running,
-                    //causes destruction to occur unordered.
-                    if (stopToken.stop_requested())
-                        break;
-                    // run the task
-                    currentTask();
+                    // Each fused dispatch already holds at most CheckEveryTasks tasks, check before every one.
+                    RunDispatchList(fusedTasks, fusedPrefetches, 1, nullptr);
+                }
+                else if (isFusionPending)
+                {
+                    taskDurations.clear();
+                    if (RunDispatchList(tasks, taskPrefetches, checkEveryTasks, &taskDurations))
+                    {
+                        fusedTasks = makeFusedDispatchList(tasks, taskDurations, options);
+                        fusedPrefetches = makePrefetchList(fusedTasks);
+                        isFusionPending = false;
+                    }
+                }
+                else
+                {
+                    RunDispatchList(tasks, taskPrefetches, checkEveryTasks, nullptr);
+                }
+                if (!rangeTasks.empty())
+                    RunRangeTasks();
+                if (!signalledTasks.empty())
+                {
+                    // With no infinite tasks to run, park until a signalled task is ready (or woken for pause/stop).
+                    if (tasks.empty() && highPriorityTasks.empty() && rangeTasks.empty())
+                    {
+                        if (isTimeSimulated)
+                            timeSource.WaitUntil(TimeSource::TimePoint_t::max(), isWakeRequested);
+                        else
+                            readySet->WaitForReady();
+                    }
+                    // Run only the signalled tasks that are ready, cost is proportional to the active tasks.
+                    readySet->TakeReady(readyIndices);
+                    for (const auto taskIndex : readyIndices)
+                    {
+                        TestAndWaitForPauseUnordered(*conditionals);
+                        if (stopToken.stop_requested())
+                            break;
+                        signalledTasks[taskIndex].Task();
+                        ReportTasksRun(1);
+                        if (isHighLaneEnabled)
+                            RunHighPriorityTasks();
+                    }
+                }
+                // Iteration end tasks run without pause/stop checks, so work batched by the tasks is not left behind by a stop.
+                for (const auto& endTask : iterationEndTasks)
+                {
+                    endTask();
+                    ReportTasksRun(1);
+                }
+                PostStateEvent(UnitStateEvent::IterationCompleted);
+                if (isTimeSimulated)
+                    timeSource.OnIterationCompleted();
+                if (options.Throttle != nullptr)
+                {
+                    // Polled while throttled, so one-shot tasks are not held up by the throttle.
+                    const auto IsThrottleInterrupted = [&]()
+                    {
+                        RunOneShotTasks();
+                        return conditionals->OrderedPausePack.GetState() || conditionals->UnorderedPausePack.GetState();
+                    };
+                    if (isTimeSimulated)
+                        options.Throttle->WaitWhileThrottled(stopToken, IsThrottleInterrupted, timeSource);
+                    else
+                        options.Throttle->WaitWhileThrottled(stopToken, IsThrottleInterrupted);
                 }
             }
+            WriteCheckpoint();
+            // Close the one-shot tasks, running those posted before, so none is left waiting on an exited thread.
+            RunOneShotTasks(true);
+            // The fused dispatch list holds copies of the tasks, reclaim it with the task list.
+            if (options.Reclaimer != nullptr && !fusedTasks.empty())
+                options.Reclaimer->Retire(std::make_shared<const std::vector<TaskInfo_t>>(std::move(fusedTasks)));
+            PostStateEvent(UnitStateEvent::Stopped);
+            if (isTimeSimulated)
+                timeSource.OnThreadExiting();
         }
     };
 }
\ No newline at end of file
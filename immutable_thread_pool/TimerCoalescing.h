@@ -0,0 +1,62 @@
+#pragma once
+#include <chrono>
+#include <thread>
+#include "UnitTimeSource.h"
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+namespace imp
+{
+    /// <summary> Rounds a wakeup deadline up to the next multiple of <c>alignment</c> since the steady clock's
+    /// epoch. Every thread (and process) aligning to the same period wakes on the same ticks, so nearby deadlines
+    /// coalesce into one wakeup of the CPU instead of many. Zero alignment returns the deadline unchanged. </summary>
+    [[nodiscard]]
+    inline TimeSource::TimePoint_t AlignWakeup(const TimeSource::TimePoint_t deadline, const std::chrono::nanoseconds alignment)
+    {
+        if (alignment <= std::chrono::nanoseconds::zero())
+            return deadline;
+        const auto alignmentTicks = std::chrono::duration_cast<TimeSource::Duration_t>(alignment).count();
+        if (alignmentTicks <= 0)
+            return deadline;
+        const auto sinceEpoch = deadline.time_since_epoch().count();
+        const auto alignedTicks = (sinceEpoch + alignmentTicks - 1) / alignmentTicks * alignmentTicks;
+        return TimeSource::TimePoint_t{ TimeSource::Duration_t{ alignedTicks } };
+    }
+
+    /// <summary> Sets the calling thread's timer slack, the time the kernel may defer its timer expiries by to
+    /// group them with others (Linux <c>prctl(PR_SET_TIMERSLACK)</c>). </summary>
+    /// <returns> true if set, false on failure or if the platform has no timer slack control. </returns>
+    inline bool SetThreadTimerSlack(const std::chrono::nanoseconds timerSlack)
+    {
+#if defined(__linux__)
+        return timerSlack > std::chrono::nanoseconds::zero()
+            && ::prctl(PR_SET_TIMERSLACK, static_cast<unsigned long>(timerSlack.count()), 0, 0, 0) == 0;
+#else
+        (void)timerSlack;
+        return false;
+#endif
+    }
+
+    /// <summary> Real time source whose sleeps end on the next <c>AlignWakeup</c> tick after the requested time,
+    /// so the sleeps of every unit using the same alignment coalesce. A sleep is lengthened by less than one
+    /// alignment period, for background units that tolerate that. </summary>
+    class CoalescingTimeSource final : public TimeSource
+    {
+        std::chrono::nanoseconds m_alignment;
+    public:
+        explicit CoalescingTimeSource(const std::chrono::nanoseconds alignment)
+            : m_alignment(alignment)
+        {
+        }
+        [[nodiscard]] TimePoint_t Now() const override
+        {
+            return Clock_t::now();
+        }
+        void SleepFor(const Duration_t sleepTime) override
+        {
+            std::this_thread::sleep_until(AlignWakeup(Clock_t::now() + sleepTime, m_alignment));
+        }
+        [[nodiscard]] std::chrono::nanoseconds GetAlignment() const { return m_alignment; }
+    };
+}
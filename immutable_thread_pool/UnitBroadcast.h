@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <utility>
+#include "ThreadUnitPlusPlus.h"
+
+namespace imp
+{
+    /// <summary> Runs <c>broadcastFn</c> once on the work thread of every unit in <c>units</c>, between their tasks
+    /// (see <c>ThreadUnitPlusPlus::PostOneShotTask</c>), e.g. to flush thread-local caches or sample per-thread state.
+    /// Returns at once, the future completes when every unit has run it. </summary>
+    /// <remarks> Units without a work thread are skipped. If a call throws, the future holds the first exception
+    /// once every unit has run the function. A paused unit runs it when resumed, so waiting on the future while a
+    /// unit stays paused does not return. </remarks>
+    /// <param name="units"> The units (e.g. a std::vector of <c>ThreadUnitPlusPlus</c>, or a group's units). </param>
+    /// <param name="broadcastFn"> The function, called concurrently on the work threads. </param>
+    template<std::ranges::range Units_t>
+    [[nodiscard]]
+    std::future<void> BroadcastToUnits(Units_t& units, std::function<void()> broadcastFn)
+    {
+        struct BroadcastState
+        {
+            std::function<void()> BroadcastFn;
+            std::atomic<std::size_t> RemainingUnits{};
+            std::promise<void> CompletedPromise{};
+            std::mutex ErrorMutex{};
+            std::exception_ptr FirstError{};
+
+            void CompleteUnit()
+            {
+                if (RemainingUnits.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                    return;
+                if (FirstError != nullptr)
+                    CompletedPromise.set_exception(FirstError);
+                else
+                    CompletedPromise.set_value();
+            }
+        };
+        auto broadcastState = std::make_shared<BroadcastState>();
+        broadcastState->BroadcastFn = std::move(broadcastFn);
+        auto completedFuture = broadcastState->CompletedPromise.get_future();
+        // One extra count, held until every unit has been posted to, so an early finish cannot complete the broadcast.
+        broadcastState->RemainingUnits.store(1, std::memory_order_relaxed);
+        for (auto& unit : units)
+        {
+            broadcastState->RemainingUnits.fetch_add(1, std::memory_order_relaxed);
+            const bool isPosted = unit.PostOneShotTask([broadcastState]()
+                {
+                    try
+                    {
+                        broadcastState->BroadcastFn();
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard errorLock{ broadcastState->ErrorMutex };
+                        if (broadcastState->FirstError == nullptr)
+                            broadcastState->FirstError = std::current_exception();
+                    }
+                    broadcastState->CompleteUnit();
+                });
+            if (!isPosted)
+                broadcastState->CompleteUnit();
+        }
+        broadcastState->CompleteUnit();
+        return completedFuture;
+    }
+}
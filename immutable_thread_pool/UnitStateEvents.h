@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#if defined(__linux__)
+#include <cerrno>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace imp
+{
+    /// <summary> State change events posted by a unit's work thread, combined into a bit mask. </summary>
+    enum class UnitStateEvent : std::uint32_t
+    {
+        PauseCompleted = 1u << 0,
+        Resumed = 1u << 1,
+        Stopped = 1u << 2,
+        IterationCompleted = 1u << 3,
+        All = PauseCompleted | Resumed | Stopped | IterationCompleted
+    };
+
+    /// <summary> Collects the state change events of one or more units (set in their <c>DispatchOptions::StateEvents</c>),
+    /// and exposes them through an eventfd that is readable while events are pending, so a controller's epoll (or
+    /// poll/select) event loop can watch units with no waiting thread of its own. On readable, call <c>TakeEvents</c>. </summary>
+    /// <remarks> Events are coalesced: the mask holds each event posted since the last <c>TakeEvents</c>, and the eventfd
+    /// is only written when the mask goes from empty to non-empty, so frequent events (e.g. <c>IterationCompleted</c>)
+    /// cost a work thread an atomic operation, not a system call. Share one instance between the units of a group to
+    /// watch the group with one descriptor. The eventfd is Linux only, elsewhere <c>GetFd</c> returns -1 and the events
+    /// are polled with <c>TakeEvents</c>. Thread-safe. Non-copyable, non-movable, held by shared_ptr. </remarks>
+    class UnitStateEvents
+    {
+        std::uint32_t m_eventMask{};
+        std::atomic<std::uint32_t> m_pendingEvents{};
+        int m_eventFd{ -1 };
+    public:
+        /// <summary> Ctor. </summary>
+        /// <param name="eventMask"> The events to collect (a mask of <c>UnitStateEvent</c> values), others are ignored. </param>
+        explicit UnitStateEvents(const std::uint32_t eventMask = static_cast<std::uint32_t>(UnitStateEvent::All))
+            : m_eventMask(eventMask)
+        {
+#if defined(__linux__)
+            m_eventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+        }
+        UnitStateEvents(const UnitStateEvents&) = delete;
+        UnitStateEvents& operator=(const UnitStateEvents&) = delete;
+        ~UnitStateEvents()
+        {
+#if defined(__linux__)
+            if (m_eventFd >= 0)
+                ::close(m_eventFd);
+#endif
+        }
+    public:
+        /// <summary> Returns the eventfd to watch for readability, -1 if none could be made (or not on Linux). </summary>
+        [[nodiscard]] int GetFd() const { return m_eventFd; }
+
+        /// <summary> Posts an event, called by the work threads. </summary>
+        void Post(const UnitStateEvent stateEvent)
+        {
+            const auto eventBit = static_cast<std::uint32_t>(stateEvent) & m_eventMask;
+            if (eventBit == 0)
+                return;
+            // Only the post that makes the mask non-empty signals the eventfd, the rest are already visible to TakeEvents.
+            if ((m_pendingEvents.load(std::memory_order_relaxed) & eventBit) != 0)
+                return;
+            if (m_pendingEvents.fetch_or(eventBit, std::memory_order_acq_rel) == 0)
+                signalFd();
+        }
+
+        /// <summary> Takes the pending events, clearing them (and the eventfd's readability). </summary>
+        /// <returns> A mask of the <c>UnitStateEvent</c> values posted since the last call, zero if none (a readable
+        /// eventfd may rarely find none, when a racing post was already taken by the previous call). </returns>
+        std::uint32_t TakeEvents()
+        {
+            // Clear the eventfd before the mask, a post after the exchange signals it again.
+            clearFd();
+            return m_pendingEvents.exchange(0, std::memory_order_acq_rel);
+        }
+
+        /// <summary> Returns true if <c>stateEvent</c> is set in an event mask returned by <c>TakeEvents</c>. </summary>
+        [[nodiscard]]
+        static constexpr bool HasEvent(const std::uint32_t events, const UnitStateEvent stateEvent) noexcept
+        {
+            return (events & static_cast<std::uint32_t>(stateEvent)) != 0;
+        }
+    private:
+        void signalFd() const
+        {
+#if defined(__linux__)
+            if (m_eventFd < 0)
+                return;
+            const std::uint64_t increment = 1;
+            while (::write(m_eventFd, &increment, sizeof(increment)) < 0 && errno == EINTR) {}
+#endif
+        }
+
+        void clearFd() const
+        {
+#if defined(__linux__)
+            if (m_eventFd < 0)
+                return;
+            std::uint64_t counter{};
+            while (::read(m_eventFd, &counter, sizeof(counter)) < 0 && errno == EINTR) {}
+#endif
+        }
+    };
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <stop_token>
+#include "UnitTimeSource.h"
+
+namespace imp
+{
+    /// <summary> Throttle shared by a controller (e.g. <c>PressureMonitor</c>) and any number of background units,
+    /// set in their <c>DispatchOptions::Throttle</c>. At the end of each iteration the work thread waits
+    /// <c>SlowDelay</c> at <c>Level::Slow</c>, and until the level drops at <c>Level::Pause</c>. </summary>
+    /// <remarks> Independent of the unit's own pause state, so a controller can throttle units it does not own.
+    /// A throttled work thread still stops at once on a stop request, and observes a pause request within
+    /// <c>PollSlice</c>. Non-copyable, non-movable, held by shared_ptr. </remarks>
+    class UnitThrottle
+    {
+    public:
+        enum class Level : int { None, Slow, Pause };
+        static constexpr std::chrono::milliseconds PollSlice{ 10 };
+        static constexpr std::chrono::milliseconds DefaultSlowDelay{ 10 };
+    private:
+        std::atomic<Level> m_level{ Level::None };
+        std::chrono::nanoseconds m_slowDelay{};
+        std::mutex m_levelMutex{};
+        std::condition_variable_any m_levelChangedCv{};
+    public:
+        explicit UnitThrottle(const std::chrono::nanoseconds slowDelay = DefaultSlowDelay)
+            : m_slowDelay(slowDelay)
+        {
+        }
+        UnitThrottle(const UnitThrottle&) = delete;
+        UnitThrottle& operator=(const UnitThrottle&) = delete;
+    public:
+        /// <summary> Sets the throttle level, a lowered level releases the waiting work threads at once. </summary>
+        void SetLevel(const Level level)
+        {
+            {
+                std::lock_guard levelLock{ m_levelMutex };
+                m_level.store(level, std::memory_order_release);
+            }
+            m_levelChangedCv.notify_all();
+        }
+
+        [[nodiscard]] Level GetLevel() const { return m_level.load(std::memory_order_acquire); }
+        [[nodiscard]] std::chrono::nanoseconds GetSlowDelay() const { return m_slowDelay; }
+
+        /// <summary> Called by the work thread at the end of an iteration, waits as the level requires. </summary>
+        /// <param name="stopToken"> The work thread's stop token, a stop request ends the wait. </param>
+        /// <param name="isInterrupted"> Checked every <c>PollSlice</c> without the throttle's lock held, returns true to end the wait (e.g. on a pause request). </param>
+        template<typename Pred_t>
+        void WaitWhileThrottled(const std::stop_token& stopToken, const Pred_t& isInterrupted)
+        {
+            if (GetLevel() == Level::None)
+                return;
+            using Clock_t = std::chrono::steady_clock;
+            const auto slowEndTime = Clock_t::now() + m_slowDelay;
+            std::unique_lock levelLock{ m_levelMutex, std::defer_lock };
+            // The predicate may run the unit's work (e.g. one-shot tasks, which may set the level), so it is
+            // called without the lock, which is shared by every unit using this throttle.
+            while (!stopToken.stop_requested() && !isInterrupted())
+            {
+                levelLock.lock();
+                const Level level = GetLevel();
+                const auto currentTime = Clock_t::now();
+                if (level == Level::None || (level == Level::Slow && currentTime >= slowEndTime))
+                    return;
+                auto waitEndTime = currentTime + PollSlice;
+                if (level == Level::Slow)
+                    waitEndTime = std::min(waitEndTime, slowEndTime);
+                m_levelChangedCv.wait_until(levelLock, stopToken, waitEndTime, [this, level]() { return GetLevel() != level; });
+                levelLock.unlock();
+            }
+        }
+
+        /// <summary> As above, for a work thread on simulated time (see <c>TimeSource::IsSimulated</c>), the delay and the
+        /// <c>PollSlice</c> polls are in the time of <c>timeSource</c>, which the thread waits through. </summary>
+        template<typename Pred_t>
+        void WaitWhileThrottled(const std::stop_token& stopToken, const Pred_t& isInterrupted, TimeSource& timeSource)
+        {
+            if (GetLevel() == Level::None)
+                return;
+            const auto slowEndTime = timeSource.Now() + m_slowDelay;
+            while (!stopToken.stop_requested() && !isInterrupted())
+            {
+                const Level level = GetLevel();
+                const auto currentTime = timeSource.Now();
+                if (level == Level::None || (level == Level::Slow && currentTime >= slowEndTime))
+                    return;
+                auto waitEndTime = currentTime + PollSlice;
+                if (level == Level::Slow)
+                    waitEndTime = std::min(waitEndTime, slowEndTime);
+                timeSource.WaitUntil(waitEndTime, [this, level, &stopToken]() { return stopToken.stop_requested() || GetLevel() != level; });
+            }
+        }
+    };
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <stop_token>
+#include <thread>
+
+namespace imp
+{
+    /// <summary> Clock and sleep abstraction used by tasks and unit internals, so timing dependent behaviour
+    /// can run against simulated time (see <c>VirtualTimeScheduler</c>) instead of real time. </summary>
+    class TimeSource
+    {
+    public:
+        using Clock_t = std::chrono::steady_clock;
+        using TimePoint_t = Clock_t::time_point;
+        using Duration_t = Clock_t::duration;
+    public:
+        virtual ~TimeSource() = default;
+        /// <summary> Returns the current time of this source. </summary>
+        [[nodiscard]] virtual TimePoint_t Now() const = 0;
+        /// <summary> Blocks (or, for simulated time, advances) the calling unit for <c>sleepTime</c>. </summary>
+        virtual void SleepFor(Duration_t sleepTime) = 0;
+
+        /// <summary> Returns true if this source simulates time. A work thread with a simulated source (set in its
+        /// <c>DispatchOptions::TimeSource</c>) makes its blocking waits through <c>WaitUntil</c>, and calls the hooks
+        /// below, so the source can schedule it. Real sources return false, and their hooks are not called. </summary>
+        [[nodiscard]] virtual bool IsSimulated() const { return false; }
+
+        /// <summary> Blocks the calling thread until <c>isWoken()</c> (if set) returns true, or the time of this source
+        /// reaches <c>deadline</c>. <c>isWoken</c> only reads state, and may be called on other threads. The default
+        /// polls with <c>SleepFor</c>. </summary>
+        virtual void WaitUntil(const TimePoint_t deadline, const std::function<bool()>& isWoken)
+        {
+            constexpr Duration_t PollPeriod{ std::chrono::milliseconds(1) };
+            for (auto currentTime = Now(); currentTime < deadline && !(isWoken && isWoken()); currentTime = Now())
+                SleepFor(std::min<Duration_t>(deadline - currentTime, PollPeriod));
+        }
+
+        /// <summary> Hook, the work thread has started (with its <c>stopToken</c>) and is about to run its first iteration. </summary>
+        virtual void OnThreadStarted(const std::stop_token& stopToken) { (void)stopToken; }
+        /// <summary> Hook, the work thread ran <c>taskCount</c> tasks (a fused run of tasks counts as one). </summary>
+        virtual void OnTasksRun(const std::size_t taskCount) { (void)taskCount; }
+        /// <summary> Hook, the work thread completed an iteration. </summary>
+        virtual void OnIterationCompleted() {}
+        /// <summary> Hook, the work thread is about to exit. </summary>
+        virtual void OnThreadExiting() {}
+    };
+
+    /// <summary> The real time source, <c>std::chrono::steady_clock</c> and <c>std::this_thread::sleep_for</c>. </summary>
+    class SteadyTimeSource final : public TimeSource
+    {
+    public:
+        [[nodiscard]] TimePoint_t Now() const override
+        {
+            return Clock_t::now();
+        }
+        void SleepFor(const Duration_t sleepTime) override
+        {
+            std::this_thread::sleep_for(sleepTime);
+        }
+    };
+
+    /// <summary> Functions for tasks to get the time and sleep through the time source injected for the
+    /// current thread, real time unless a <c>ScopedTimeSource</c> is active on the thread. </summary>
+    namespace UnitTime
+    {
+        namespace detail
+        {
+            inline TimeSource*& CurrentSourcePtr()
+            {
+                thread_local TimeSource* currentSource{ nullptr };
+                return currentSource;
+            }
+
+            // The time the calling work thread's current iteration started, max() outside a work thread.
+            inline TimeSource::TimePoint_t& IterationTime()
+            {
+                thread_local TimeSource::TimePoint_t iterationTime{ TimeSource::TimePoint_t::max() };
+                return iterationTime;
+            }
+        }
+
+        /// <summary> Returns the time source for the calling thread. </summary>
+        [[nodiscard]]
+        inline TimeSource& Current()
+        {
+            static SteadyTimeSource steadySource;
+            TimeSource* currentSource = detail::CurrentSourcePtr();
+            return currentSource != nullptr ? *currentSource : steadySource;
+        }
+
+        /// <summary> Returns the current time of the calling thread's time source. </summary>
+        [[nodiscard]]
+        inline TimeSource::TimePoint_t Now()
+        {
+            return Current().Now();
+        }
+
+        /// <summary> Returns the time the calling unit's current iteration started, read once per iteration by the
+        /// work thread so tasks can timestamp without reading the clock. It lags the current time by the time spent
+        /// in the iteration so far. Outside a unit's work thread, returns <c>Now()</c>. </summary>
+        [[nodiscard]]
+        inline TimeSource::TimePoint_t IterationNow()
+        {
+            const auto iterationTime = detail::IterationTime();
+            return iterationTime != TimeSource::TimePoint_t::max() ? iterationTime : Now();
+        }
+
+        /// <summary> Sleeps for <c>sleepTime</c> with the calling thread's time source. </summary>
+        template<typename Rep_t, typename Period_t>
+        void SleepFor(const std::chrono::duration<Rep_t, Period_t> sleepTime)
+        {
+            Current().SleepFor(std::chrono::duration_cast<TimeSource::Duration_t>(sleepTime));
+        }
+    }
+
+    /// <summary> Injects a time source for the calling thread for the lifetime of this object,
+    /// restoring the previous one on destruction. Non-copyable, non-movable. </summary>
+    class ScopedTimeSource
+    {
+        TimeSource* m_previousSource;
+    public:
+        explicit ScopedTimeSource(TimeSource& timeSource)
+            : m_previousSource(UnitTime::detail::CurrentSourcePtr())
+        {
+            UnitTime::detail::CurrentSourcePtr() = &timeSource;
+        }
+        ~ScopedTimeSource()
+        {
+            UnitTime::detail::CurrentSourcePtr() = m_previousSource;
+        }
+        ScopedTimeSource(const ScopedTimeSource&) = delete;
+        ScopedTimeSource& operator=(const ScopedTimeSource&) = delete;
+    };
+}
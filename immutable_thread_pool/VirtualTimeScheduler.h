@@ -0,0 +1,384 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <utility>
+#include <vector>
+#include "DispatchOptions.h"
+#include "ThreadTaskSource.h"
+#include "ThreadUnitPlusPlus.h"
+#include "UnitTimeSource.h"
+
+namespace imp
+{
+    /// <summary> Deterministic, simulated-time scheduler for testing timing dependent unit behaviour.
+    /// Each virtual unit is a <c>ThreadUnitPlusPlus</c> whose work thread runs on the unit's own virtual clock (set as
+    /// its <c>DispatchOptions::TimeSource</c>). One work thread runs at a time, always the one due at the earliest
+    /// virtual time (ties go to the unit added first), so a run is fully reproducible. The tasks' sleeps through
+    /// <c>UnitTime</c>, and the work thread's own waits (empty list period, parking, pause, throttle), advance
+    /// virtual time instantly, so hours of virtual time take seconds. </summary>
+    /// <remarks> The units run the real work loop, so their dispatch options (pause/stop checks, task fusion, throttle,
+    /// state events, checkpoints) and one-shot tasks behave as on real time. A task must not block other than through
+    /// <c>UnitTime</c> (e.g. on a lock held by a task of another unit), the other units do not run meanwhile. Control
+    /// calls are made while the scheduler is not running, and take effect at its current virtual time.
+    /// Non-copyable, non-movable (units refer back to their scheduler). </remarks>
+    class VirtualTimeScheduler
+    {
+    public:
+        using TimePoint_t = TimeSource::TimePoint_t;
+        using Duration_t = TimeSource::Duration_t;
+    private:
+        /// <summary> A unit's virtual clock, the time source of its work thread. The thread runs only when the scheduler
+        /// gives it the turn, and gives the turn back at each wait, to run again when the wait ends. </summary>
+        class UnitClock final : public TimeSource
+        {
+            friend class VirtualTimeScheduler;
+            enum class ThreadState { Starting, Waiting, Running, Exited };
+            VirtualTimeScheduler* m_scheduler;
+            TimePoint_t m_localTime;
+            ThreadState m_threadState{ ThreadState::Starting };
+            std::condition_variable m_turnCv{};
+            // The wait in progress: its deadline, its wake check, and the time the check was first seen true.
+            TimePoint_t m_deadline{};
+            const std::function<bool()>* m_isWoken{};
+            std::optional<TimePoint_t> m_wokenTime{};
+            // Set while the unit stops its thread, which leaves the schedule and runs to its exit once stop requested.
+            bool m_isReleased{};
+            std::stop_token m_stopToken{};
+            std::optional<std::stop_callback<std::function<void()>>> m_stopCallback{};
+            std::atomic<std::uint64_t> m_tasksRun{};
+            std::atomic<std::uint64_t> m_iterations{};
+        public:
+            UnitClock(VirtualTimeScheduler& scheduler, const TimePoint_t startTime)
+                : m_scheduler(&scheduler), m_localTime(startTime)
+            {
+            }
+            [[nodiscard]] TimePoint_t Now() const override
+            {
+                return m_localTime;
+            }
+            void SleepFor(const Duration_t sleepTime) override
+            {
+                if (sleepTime > Duration_t::zero())
+                    m_scheduler->waitUntil(*this, m_localTime + sleepTime, {});
+            }
+            [[nodiscard]] bool IsSimulated() const override
+            {
+                return true;
+            }
+            void WaitUntil(const TimePoint_t deadline, const std::function<bool()>& isWoken) override
+            {
+                m_scheduler->waitUntil(*this, deadline, isWoken);
+            }
+            void OnThreadStarted(const std::stop_token& stopToken) override
+            {
+                m_scheduler->startThread(*this, stopToken);
+            }
+            void OnTasksRun(const std::size_t taskCount) override
+            {
+                m_tasksRun.fetch_add(taskCount, std::memory_order_relaxed);
+                if (m_scheduler->m_taskCost > Duration_t::zero())
+                    m_scheduler->waitUntil(*this, m_localTime + m_scheduler->m_taskCost * static_cast<Duration_t::rep>(taskCount), {});
+            }
+            void OnIterationCompleted() override
+            {
+                m_iterations.fetch_add(1, std::memory_order_relaxed);
+            }
+            void OnThreadExiting() override
+            {
+                m_scheduler->exitThread(*this);
+            }
+        };
+        using ClockPtr_t = std::shared_ptr<UnitClock>;
+    public:
+        /// <summary> A unit run by the <c>VirtualTimeScheduler</c>, a <c>ThreadUnitPlusPlus</c> on virtual time with the
+        /// same control API. Waiting for a pause runs the scheduler until the pause completes. </summary>
+        /// <remarks> Owned by the scheduler, non-copyable, non-movable. </remarks>
+        class VirtualThreadUnit
+        {
+            friend class VirtualTimeScheduler;
+        private:
+            VirtualTimeScheduler* m_scheduler;
+            ClockPtr_t m_clock;
+            ThreadUnitPlusPlus m_unit;
+            bool m_isOrderedPauseRequested{};
+            bool m_isUnorderedPauseRequested{};
+        public:
+            VirtualThreadUnit(VirtualTimeScheduler& scheduler, const ThreadTaskSource& tasks, DispatchOptions options)
+                : m_scheduler(&scheduler),
+                m_clock(scheduler.addClock()),
+                m_unit(tasks, withClock(std::move(options), m_clock))
+            {
+                m_scheduler->waitForThreadStart(*m_clock);
+            }
+            ~VirtualThreadUnit()
+            {
+                m_scheduler->releaseThread(*m_clock);
+            }
+            VirtualThreadUnit(const VirtualThreadUnit&) = delete;
+            VirtualThreadUnit& operator=(const VirtualThreadUnit&) = delete;
+        public:
+            void SetPauseValueOrdered(const bool enablePause)
+            {
+                m_isOrderedPauseRequested = enablePause;
+                m_unit.SetPauseValueOrdered(enablePause);
+            }
+            void SetPauseValueUnordered(const bool enablePause)
+            {
+                m_isUnorderedPauseRequested = enablePause;
+                m_unit.SetPauseValueUnordered(enablePause);
+            }
+            [[nodiscard]] bool IsRunning() const { return m_unit.IsRunning(); }
+            [[nodiscard]] bool GetPauseCompletionStatus() const { return m_unit.GetPauseCompletionStatus(); }
+
+            /// <summary> Runs the simulation until this unit completes its pause, if a pause is requested
+            /// (or until no unit can make progress). </summary>
+            void WaitForPauseCompleted()
+            {
+                m_scheduler->runWhile([this]()
+                    {
+                        return (m_isOrderedPauseRequested || m_isUnorderedPauseRequested) && !m_unit.GetPauseCompletionStatus() && m_unit.IsRunning();
+                    }, TimePoint_t::max());
+            }
+
+            [[nodiscard]] std::size_t GetNumberOfTasks() const { return m_unit.GetNumberOfTasks(); }
+            [[nodiscard]] auto GetTaskSource() const -> ThreadTaskSource { return m_unit.GetTaskSource(); }
+
+            /// <summary> Stops the unit, replaces the task list, and starts it again at the scheduler's current time. </summary>
+            void SetTaskSource(const ThreadTaskSource& newTaskList)
+            {
+                DestroyThread();
+                m_scheduler->restartClock(*m_clock);
+                m_unit.SetTaskSource(newTaskList);
+                m_scheduler->waitForThreadStart(*m_clock);
+            }
+
+            /// <summary> Posts a one-shot task to the work thread, see <c>ThreadUnitPlusPlus::PostOneShotTask</c>. </summary>
+            bool PostOneShotTask(ThreadTaskSource::TaskInfo oneShotTask)
+            {
+                return m_unit.PostOneShotTask(std::move(oneShotTask));
+            }
+
+            /// <summary> Stops the unit at the wait its work thread is in, <b>WILL CLEAR the task source!</b> </summary>
+            void DestroyThread()
+            {
+                m_scheduler->releaseThread(*m_clock);
+                m_unit.DestroyThread();
+                m_isOrderedPauseRequested = false;
+                m_isUnorderedPauseRequested = false;
+            }
+
+            /// <summary> Returns the virtual time the unit has reached. </summary>
+            [[nodiscard]] TimePoint_t GetLocalTime() const { return m_scheduler->getLocalTime(*m_clock); }
+            /// <summary> Returns the number of tasks the unit has run (a fused run of tasks counts as one). </summary>
+            [[nodiscard]] std::uint64_t GetTasksRun() const { return m_clock->m_tasksRun.load(std::memory_order_relaxed); }
+            /// <summary> Returns the number of task list iterations the unit has completed. </summary>
+            [[nodiscard]] std::uint64_t GetIterations() const { return m_clock->m_iterations.load(std::memory_order_relaxed); }
+        private:
+            static DispatchOptions withClock(DispatchOptions options, const ClockPtr_t& unitClock)
+            {
+                options.TimeSource = unitClock;
+                return options;
+            }
+        };
+    private:
+        std::mutex m_scheduleMutex{};
+        // Notified when the turn comes back to the controller, and when a work thread starts.
+        std::condition_variable m_scheduleCv{};
+        // The units' clocks in the order the units were added, the order ties are broken in.
+        std::vector<ClockPtr_t> m_clocks{};
+        // The clock of the work thread that has the turn, nullptr while the controller has it.
+        UnitClock* m_runningClock{};
+        bool m_isRunActive{};
+        std::function<bool()> m_runCondition{};
+        TimePoint_t m_endTime{};
+        TimePoint_t m_now{};
+        Duration_t m_taskCost{};
+        // Last, so the units (and their work threads) are destroyed before the schedule they wait on.
+        std::deque<VirtualThreadUnit> m_units{};
+    public:
+        /// <summary> Ctor. </summary>
+        /// <param name="taskCost"> Virtual time each task takes in addition to any virtual sleeps it makes, must be
+        /// greater than zero for a unit with tasks that never sleep to advance. </param>
+        explicit VirtualTimeScheduler(const Duration_t taskCost = std::chrono::microseconds(1))
+            : m_taskCost(taskCost)
+        {
+        }
+        VirtualTimeScheduler(const VirtualTimeScheduler&) = delete;
+        VirtualTimeScheduler& operator=(const VirtualTimeScheduler&) = delete;
+    public:
+        /// <summary> Adds a unit running <c>tasks</c> with <c>options</c> (the unit's clock is set as their
+        /// <c>TimeSource</c>), starting at the current virtual time. </summary>
+        VirtualThreadUnit& AddUnit(const ThreadTaskSource& tasks = {}, DispatchOptions options = {})
+        {
+            return m_units.emplace_back(*this, tasks, std::move(options));
+        }
+
+        /// <summary> Returns the scheduler's current virtual time. </summary>
+        [[nodiscard]] TimePoint_t Now() const { return m_now; }
+
+        /// <summary> Runs the units until none is due at or before <c>endTime</c>, or none can make progress. </summary>
+        void RunUntil(const TimePoint_t endTime)
+        {
+            runWhile([]() { return true; }, endTime);
+            m_now = std::max(m_now, endTime);
+        }
+
+        /// <summary> Runs the units for <c>duration</c> of virtual time from now. </summary>
+        template<typename Rep_t, typename Period_t>
+        void RunFor(const std::chrono::duration<Rep_t, Period_t> duration)
+        {
+            RunUntil(m_now + std::chrono::duration_cast<Duration_t>(duration));
+        }
+    private:
+        /// <summary> Gives the turn to the units while <c>shouldContinue()</c> is true (checked at every change of turn),
+        /// until no unit is due at or before <c>endTime</c>. </summary>
+        void runWhile(std::function<bool()> shouldContinue, const TimePoint_t endTime)
+        {
+            std::unique_lock scheduleLock{ m_scheduleMutex };
+            m_runCondition = std::move(shouldContinue);
+            m_endTime = endTime;
+            m_isRunActive = true;
+            // Control calls made since the last run count as made at the current time.
+            handOff(m_now, nullptr);
+            m_scheduleCv.wait(scheduleLock, [this]() { return m_runningClock == nullptr; });
+            m_isRunActive = false;
+            m_runCondition = {};
+        }
+
+        // Gives the turn to the waiting work thread due first, or back to the controller if none is due. A wake check
+        // first seen true here wakes its thread at signalTime, the time of the thread giving up the turn.
+        void handOff(const TimePoint_t signalTime, UnitClock* const yieldingClock)
+        {
+            UnitClock* nextClock = nullptr;
+            TimePoint_t nextTime{};
+            if (m_isRunActive && m_runCondition())
+            {
+                for (const auto& unitClock : m_clocks)
+                {
+                    if (unitClock->m_threadState != UnitClock::ThreadState::Waiting || unitClock->m_isReleased)
+                        continue;
+                    if (unitClock->m_isWoken != nullptr && !unitClock->m_wokenTime && (*unitClock->m_isWoken)())
+                        unitClock->m_wokenTime = std::max(unitClock->m_localTime, signalTime);
+                    const auto wakeTime = unitClock->m_wokenTime ? std::min(*unitClock->m_wokenTime, unitClock->m_deadline) : unitClock->m_deadline;
+                    if (wakeTime != TimePoint_t::max() && wakeTime <= m_endTime && (nextClock == nullptr || wakeTime < nextTime))
+                    {
+                        nextClock = unitClock.get();
+                        nextTime = wakeTime;
+                    }
+                }
+            }
+            m_runningClock = nextClock;
+            if (nextClock == nullptr)
+            {
+                m_scheduleCv.notify_all();
+                return;
+            }
+            nextClock->m_localTime = nextTime;
+            nextClock->m_threadState = UnitClock::ThreadState::Running;
+            m_now = std::max(m_now, nextTime);
+            if (nextClock != yieldingClock)
+                nextClock->m_turnCv.notify_one();
+        }
+
+        // Called on a work thread, waits for the turn, or (released) for the stop request, then runs.
+        void waitForTurn(std::unique_lock<std::mutex>& scheduleLock, UnitClock& unitClock)
+        {
+            unitClock.m_turnCv.wait(scheduleLock, [&unitClock]()
+                {
+                    return unitClock.m_threadState == UnitClock::ThreadState::Running || (unitClock.m_isReleased && unitClock.m_stopToken.stop_requested());
+                });
+            unitClock.m_threadState = UnitClock::ThreadState::Running;
+            unitClock.m_isWoken = nullptr;
+            unitClock.m_wokenTime.reset();
+        }
+
+        void waitUntil(UnitClock& unitClock, const TimePoint_t deadline, const std::function<bool()>& isWoken)
+        {
+            std::unique_lock scheduleLock{ m_scheduleMutex };
+            if (!unitClock.m_isReleased)
+            {
+                unitClock.m_deadline = deadline;
+                unitClock.m_isWoken = isWoken ? &isWoken : nullptr;
+                unitClock.m_wokenTime.reset();
+                unitClock.m_threadState = UnitClock::ThreadState::Waiting;
+                handOff(unitClock.m_localTime, &unitClock);
+                waitForTurn(scheduleLock, unitClock);
+            }
+            // A released thread's waits end at once, its sleeps still take their time.
+            if (unitClock.m_isReleased && deadline != TimePoint_t::max())
+                unitClock.m_localTime = std::max(unitClock.m_localTime, deadline);
+        }
+
+        void startThread(UnitClock& unitClock, const std::stop_token& stopToken)
+        {
+            // Wakes the thread if it is stopped while waiting for the turn (the unit releases it first).
+            unitClock.m_stopCallback.emplace(stopToken, [this, &unitClock]()
+                {
+                    std::lock_guard scheduleLock{ m_scheduleMutex };
+                    unitClock.m_turnCv.notify_all();
+                });
+            std::unique_lock scheduleLock{ m_scheduleMutex };
+            unitClock.m_stopToken = stopToken;
+            unitClock.m_deadline = unitClock.m_localTime;
+            unitClock.m_threadState = UnitClock::ThreadState::Waiting;
+            m_scheduleCv.notify_all();
+            waitForTurn(scheduleLock, unitClock);
+        }
+
+        void exitThread(UnitClock& unitClock)
+        {
+            {
+                std::lock_guard scheduleLock{ m_scheduleMutex };
+                unitClock.m_threadState = UnitClock::ThreadState::Exited;
+                if (m_runningClock == &unitClock)
+                    handOff(unitClock.m_localTime, nullptr);
+            }
+            // Outside the lock, the callback takes it, and destroying the callback waits for a call in progress.
+            unitClock.m_stopCallback.reset();
+        }
+
+        auto addClock() -> ClockPtr_t
+        {
+            std::lock_guard scheduleLock{ m_scheduleMutex };
+            return m_clocks.emplace_back(std::make_shared<UnitClock>(*this, m_now));
+        }
+
+        void waitForThreadStart(UnitClock& unitClock)
+        {
+            std::unique_lock scheduleLock{ m_scheduleMutex };
+            m_scheduleCv.wait(scheduleLock, [&unitClock]() { return unitClock.m_threadState != UnitClock::ThreadState::Starting; });
+        }
+
+        // Takes a unit's work thread out of the schedule, before the unit stops it.
+        void releaseThread(UnitClock& unitClock)
+        {
+            std::lock_guard scheduleLock{ m_scheduleMutex };
+            unitClock.m_isReleased = true;
+        }
+
+        // Readies a stopped unit's clock for its next work thread, which starts at the current time.
+        void restartClock(UnitClock& unitClock)
+        {
+            std::lock_guard scheduleLock{ m_scheduleMutex };
+            unitClock.m_isReleased = false;
+            unitClock.m_threadState = UnitClock::ThreadState::Starting;
+            unitClock.m_localTime = std::max(unitClock.m_localTime, m_now);
+        }
+
+        [[nodiscard]] TimePoint_t getLocalTime(UnitClock& unitClock)
+        {
+            std::lock_guard scheduleLock{ m_scheduleMutex };
+            return unitClock.m_localTime;
+        }
+    };
+}
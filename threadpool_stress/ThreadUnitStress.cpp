@@ -0,0 +1,340 @@
+// Soak and stress harness for ThreadUnitPlusPlus control operations (Linux, or any C++20 toolchain).
+// Hammers a set of units with randomized interleavings of ordered/unordered pause, resume, wait,
+// task source swaps, moves and destroys from multiple controller threads. Reports operations per second,
+// and if any single control operation exceeds the timeout, dumps the state of every controller and exits
+// with a non-zero code (a hang).
+//
+// Build: g++ -std=c++20 -O2 -pthread -I../immutable_thread_pool ThreadUnitStress.cpp -o thread_unit_stress
+// Usage: thread_unit_stress [--ops N] [--units N] [--controllers N] [--timeout-ms N] [--seed N]
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <syncstream>
+#include <thread>
+#include <vector>
+
+#include "ThreadUnitPlusPlus.h"
+
+namespace
+{
+    using Clock_t = std::chrono::steady_clock;
+
+    enum class ControlOp : int
+    {
+        None,
+        PauseOrdered,
+        PauseUnordered,
+        ResumeOrdered,
+        ResumeUnordered,
+        WaitForPause,
+        SwapTaskSource,
+        MoveThroughTemporary,
+        MoveBetweenUnits,
+        Destroy,
+        Recreate,
+        Count
+    };
+
+    constexpr std::array<std::string_view, static_cast<int>(ControlOp::Count)> OpNames{
+        "None", "PauseOrdered", "PauseUnordered", "ResumeOrdered", "ResumeUnordered", "WaitForPause",
+        "SwapTaskSource", "MoveThroughTemporary", "MoveBetweenUnits", "Destroy", "Recreate" };
+
+    // Relative weight of each op when chosen at random, the cheap control calls dominate.
+    constexpr std::array<int, static_cast<int>(ControlOp::Count)> OpWeights{
+        0, 20, 20, 20, 20, 15, 3, 3, 3, 2, 2 };
+
+    struct Options
+    {
+        std::uint64_t TotalOps{ 2'000'000 };
+        std::size_t Units{ 8 };
+        std::size_t Controllers{ 4 };
+        std::chrono::milliseconds Timeout{ 5000 };
+        std::uint64_t Seed{ 1 };
+    };
+
+    // A unit slot, the unit is only touched with the slot mutex held since the unit's control API is
+    // not meant to be called concurrently on one unit. The pause flags model what the controllers requested.
+    struct UnitSlot
+    {
+        std::mutex SlotMutex;
+        imp::ThreadUnitPlusPlus Unit;
+        std::atomic<bool> IsOrderedRequested{ false };
+        std::atomic<bool> IsUnorderedRequested{ false };
+    };
+
+    // Published by each controller so the watchdog can tell what it is doing and for how long.
+    struct ControllerStatus
+    {
+        std::atomic<int> CurrentOp{ static_cast<int>(ControlOp::None) };
+        std::atomic<std::size_t> SlotIndex{ 0 };
+        std::atomic<std::int64_t> OpStartNs{ 0 };
+        std::atomic<std::uint64_t> OpsDone{ 0 };
+        std::array<std::atomic<std::uint64_t>, static_cast<int>(ControlOp::Count)> OpCounts{};
+    };
+
+    std::int64_t NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock_t::now().time_since_epoch()).count();
+    }
+
+    // Builds a small random task source of cheap, spinning, yielding, sleeping and signalled tasks.
+    imp::ThreadTaskSource MakeTaskSource(std::mt19937_64& rng)
+    {
+        imp::ThreadTaskSource tts;
+        const auto taskCount = std::uniform_int_distribution<int>{ 0, 6 }(rng);
+        imp::TaskSignal signal;
+        for (int i = 0; i < taskCount; i++)
+        {
+            switch (std::uniform_int_distribution<int>{ 0, 4 }(rng))
+            {
+            case 0:
+                tts.PushInfiniteTaskBack([]() {});
+                break;
+            case 1:
+                tts.PushInfiniteTaskBack([](const int spins)
+                    {
+                        volatile int sink = 0;
+                        for (int s = 0; s < spins; s++)
+                            sink = sink + s;
+                    }, std::uniform_int_distribution<int>{ 10, 2000 }(rng));
+                break;
+            case 2:
+                tts.PushInfiniteTaskBack([]() { std::this_thread::yield(); });
+                break;
+            case 3:
+                tts.PushInfiniteTaskBack([](const int us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); },
+                    std::uniform_int_distribution<int>{ 1, 100 }(rng));
+                break;
+            default:
+                tts.PushInfiniteTaskBack([signal]() { signal.Set(); });
+                tts.PushSignalledTaskBack(signal, []() {});
+                break;
+            }
+        }
+        return tts;
+    }
+
+    void DumpState(const std::vector<std::unique_ptr<ControllerStatus>>& controllers, const std::vector<std::unique_ptr<UnitSlot>>& slots)
+    {
+        std::osyncstream os(std::cerr);
+        const auto now = NowNs();
+        os << "\n=== HANG DETECTED, state dump ===\n";
+        for (std::size_t i = 0; i < controllers.size(); i++)
+        {
+            const auto& status = *controllers[i];
+            const auto op = status.CurrentOp.load();
+            os << "controller " << i << ": op=" << OpNames[static_cast<std::size_t>(op)]
+                << " slot=" << status.SlotIndex.load()
+                << " elapsed_ms=" << (op == static_cast<int>(ControlOp::None) ? 0 : (now - status.OpStartNs.load()) / 1'000'000)
+                << " ops_done=" << status.OpsDone.load() << '\n';
+        }
+        for (std::size_t i = 0; i < slots.size(); i++)
+        {
+            // Requested state only, the unit itself may be mid-operation under another thread's lock.
+            os << "slot " << i << ": ordered_requested=" << slots[i]->IsOrderedRequested.load()
+                << " unordered_requested=" << slots[i]->IsUnorderedRequested.load() << '\n';
+        }
+        os.emit();
+    }
+
+    void RunControlOp(const ControlOp op, std::vector<std::unique_ptr<UnitSlot>>& slots, const std::size_t slotIndex, std::mt19937_64& rng)
+    {
+        auto& slot = *slots[slotIndex];
+        if (op == ControlOp::MoveBetweenUnits)
+        {
+            const auto otherIndex = std::uniform_int_distribution<std::size_t>{ 0, slots.size() - 1 }(rng);
+            if (otherIndex == slotIndex)
+                return;
+            auto& other = *slots[otherIndex];
+            std::scoped_lock bothLock{ slot.SlotMutex, other.SlotMutex };
+            imp::ThreadUnitPlusPlus temp{ std::move(slot.Unit) };
+            slot.Unit = std::move(other.Unit);
+            other.Unit = std::move(temp);
+            const bool ordered = slot.IsOrderedRequested.exchange(other.IsOrderedRequested.load());
+            const bool unordered = slot.IsUnorderedRequested.exchange(other.IsUnorderedRequested.load());
+            other.IsOrderedRequested = ordered;
+            other.IsUnorderedRequested = unordered;
+            return;
+        }
+        std::lock_guard slotLock{ slot.SlotMutex };
+        switch (op)
+        {
+        case ControlOp::PauseOrdered:
+            slot.Unit.SetPauseValueOrdered(true);
+            slot.IsOrderedRequested = true;
+            break;
+        case ControlOp::PauseUnordered:
+            slot.Unit.SetPauseValueUnordered(true);
+            slot.IsUnorderedRequested = true;
+            break;
+        case ControlOp::ResumeOrdered:
+            slot.Unit.SetPauseValueOrdered(false);
+            slot.IsOrderedRequested = false;
+            break;
+        case ControlOp::ResumeUnordered:
+            slot.Unit.SetPauseValueUnordered(false);
+            slot.IsUnorderedRequested = false;
+            break;
+        case ControlOp::WaitForPause:
+            // Only wait when a pause is requested on a running unit, otherwise it could never complete.
+            if (slot.Unit.IsRunning() && (slot.IsOrderedRequested || slot.IsUnorderedRequested))
+                slot.Unit.WaitForPauseCompleted();
+            break;
+        case ControlOp::SwapTaskSource:
+            slot.Unit.SetTaskSource(MakeTaskSource(rng));
+            slot.IsOrderedRequested = false;
+            slot.IsUnorderedRequested = false;
+            break;
+        case ControlOp::MoveThroughTemporary:
+        {
+            imp::ThreadUnitPlusPlus temp{ std::move(slot.Unit) };
+            slot.Unit = std::move(temp);
+            break;
+        }
+        case ControlOp::Destroy:
+            slot.Unit.DestroyThread();
+            slot.IsOrderedRequested = false;
+            slot.IsUnorderedRequested = false;
+            break;
+        case ControlOp::Recreate:
+            slot.Unit = imp::ThreadUnitPlusPlus{ MakeTaskSource(rng) };
+            slot.IsOrderedRequested = false;
+            slot.IsUnorderedRequested = false;
+            break;
+        default:
+            break;
+        }
+    }
+
+    void ControllerFunc(const Options& options, std::vector<std::unique_ptr<UnitSlot>>& slots, ControllerStatus& status,
+        std::atomic<std::int64_t>& opsRemaining, const std::uint64_t seed)
+    {
+        std::mt19937_64 rng{ seed };
+        std::discrete_distribution<int> opDistribution{ OpWeights.begin(), OpWeights.end() };
+        std::uniform_int_distribution<std::size_t> slotDistribution{ 0, options.Units - 1 };
+        while (opsRemaining.fetch_sub(1) > 0)
+        {
+            const auto op = static_cast<ControlOp>(opDistribution(rng));
+            const auto slotIndex = slotDistribution(rng);
+            status.SlotIndex = slotIndex;
+            status.OpStartNs = NowNs();
+            status.CurrentOp = static_cast<int>(op);
+            RunControlOp(op, slots, slotIndex, rng);
+            status.CurrentOp = static_cast<int>(ControlOp::None);
+            status.OpCounts[static_cast<std::size_t>(op)].fetch_add(1, std::memory_order_relaxed);
+            status.OpsDone.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    Options ParseOptions(const int argc, char** argv)
+    {
+        Options options;
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            const std::string_view name{ argv[i] };
+            const auto value = std::strtoull(argv[i + 1], nullptr, 10);
+            if (name == "--ops")
+                options.TotalOps = value;
+            else if (name == "--units")
+                options.Units = value > 0 ? value : 1;
+            else if (name == "--controllers")
+                options.Controllers = value > 0 ? value : 1;
+            else if (name == "--timeout-ms")
+                options.Timeout = std::chrono::milliseconds(value);
+            else if (name == "--seed")
+                options.Seed = value;
+        }
+        return options;
+    }
+}
+
+int main(const int argc, char** argv)
+{
+    const Options options = ParseOptions(argc, argv);
+    std::mt19937_64 seedRng{ options.Seed };
+
+    std::vector<std::unique_ptr<UnitSlot>> slots;
+    for (std::size_t i = 0; i < options.Units; i++)
+    {
+        slots.emplace_back(std::make_unique<UnitSlot>());
+        slots.back()->Unit.SetTaskSource(MakeTaskSource(seedRng));
+    }
+    std::vector<std::unique_ptr<ControllerStatus>> controllers;
+    for (std::size_t i = 0; i < options.Controllers; i++)
+        controllers.emplace_back(std::make_unique<ControllerStatus>());
+
+    std::cout << "ops=" << options.TotalOps << " units=" << options.Units << " controllers=" << options.Controllers
+        << " timeout_ms=" << options.Timeout.count() << " seed=" << options.Seed << std::endl;
+
+    // Signed so that controllers racing past zero see a non-positive count and stop.
+    std::atomic<std::int64_t> opsRemaining{ static_cast<std::int64_t>(options.TotalOps) };
+    const auto startTime = Clock_t::now();
+    std::vector<std::jthread> controllerThreads;
+    for (std::size_t i = 0; i < options.Controllers; i++)
+    {
+        controllerThreads.emplace_back([&, i, seed = seedRng()]()
+            {
+                ControllerFunc(options, slots, *controllers[i], opsRemaining, seed);
+            });
+    }
+
+    // Watchdog and progress reporting, on this thread.
+    std::uint64_t lastOps = 0;
+    auto lastReport = Clock_t::now();
+    for (;;)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::uint64_t opsDone = 0;
+        bool isAnyActive = false;
+        const auto now = NowNs();
+        for (const auto& status : controllers)
+        {
+            opsDone += status->OpsDone.load();
+            if (status->CurrentOp.load() != static_cast<int>(ControlOp::None))
+            {
+                isAnyActive = true;
+                if (now - status->OpStartNs.load() > std::chrono::nanoseconds(options.Timeout).count())
+                {
+                    DumpState(controllers, slots);
+                    std::_Exit(2);
+                }
+            }
+        }
+        if (Clock_t::now() - lastReport >= std::chrono::seconds(1))
+        {
+            const auto seconds = std::chrono::duration<double>(Clock_t::now() - lastReport).count();
+            std::cout << "progress: " << opsDone << " ops, " << static_cast<std::uint64_t>((opsDone - lastOps) / seconds) << " ops/s" << std::endl;
+            lastOps = opsDone;
+            lastReport = Clock_t::now();
+        }
+        if (opsDone >= options.TotalOps && !isAnyActive)
+            break;
+    }
+    controllerThreads.clear();
+    const auto seconds = std::chrono::duration<double>(Clock_t::now() - startTime).count();
+
+    std::array<std::uint64_t, static_cast<int>(ControlOp::Count)> opTotals{};
+    std::uint64_t totalOps = 0;
+    for (const auto& status : controllers)
+    {
+        for (std::size_t op = 0; op < opTotals.size(); op++)
+            opTotals[op] += status->OpCounts[op].load();
+        totalOps += status->OpsDone.load();
+    }
+    for (std::size_t op = 1; op < opTotals.size(); op++)
+        std::cout << OpNames[op] << ": " << opTotals[op] << '\n';
+    std::cout << "total: " << totalOps << " ops in " << seconds << " s, " << static_cast<std::uint64_t>(totalOps / seconds) << " ops/s" << std::endl;
+
+    // Destroy every unit (resuming first is not required, destruction notifies paused threads).
+    for (auto& slot : slots)
+        slot->Unit.DestroyThread();
+    return 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../immutable_thread_pool/KeyedTaskPlacement.h"
+#include "../immutable_thread_pool/ThreadUnitPlusPlus.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace threadpooltests
+{
+	TEST_CLASS(keyedtaskplacementtests)
+	{
+	public:
+
+		TEST_METHOD(TestMinimalMovement)
+		{
+			static constexpr std::uint64_t KeyCount{ 10000 };
+			std::uint64_t movedKeys{};
+			for (std::uint64_t key = 0; key < KeyCount; key++)
+			{
+				const auto fromUnit = imp::KeyedTaskPlacement::GetUnitForKey(key, 4);
+				const auto toUnit = imp::KeyedTaskPlacement::GetUnitForKey(key, 5);
+				Assert::IsTrue(fromUnit < 4 && toUnit < 5);
+				// growing the set only moves keys onto the new unit
+				if (fromUnit != toUnit)
+				{
+					Assert::AreEqual(std::size_t{ 4 }, toUnit, L"Key moved between existing units.");
+					movedKeys++;
+				}
+			}
+			// about 1/5 of the keys move
+			Assert::IsTrue(movedKeys > KeyCount / 6 && movedKeys < KeyCount / 4, L"Moved fraction is not minimal.");
+		}
+
+		TEST_METHOD(TestApplyTo)
+		{
+			imp::KeyedTaskPlacement placement{};
+			for (std::uint64_t key = 0; key < 20; key++)
+				placement.PushKeyedTaskBack(imp::KeyedTaskPlacement::HashKey("tenant" + std::to_string(key)), []() {});
+			std::vector<imp::ThreadUnitPlusPlus> units(3);
+			Assert::AreEqual(std::size_t{ 3 }, placement.ApplyTo(units));
+			// nothing changed, nothing restarted
+			Assert::AreEqual(std::size_t{ 0 }, placement.ApplyTo(units));
+			std::size_t taskCount{};
+			for (const auto& unit : units)
+				taskCount += unit.GetNumberOfTasks();
+			Assert::AreEqual(std::size_t{ 20 }, taskCount);
+			for (auto& unit : units)
+				unit.DestroyThread();
+		}
+	};
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../immutable_thread_pool/MappedRecordStream.h"
+#include "../immutable_thread_pool/ThreadUnitPlusPlus.h"
+
+#if defined(__unix__)
+#include <filesystem>
+#include <fstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace threadpooltests
+{
+	TEST_CLASS(mappedrecordstreamtests)
+	{
+	public:
+		static std::string MakeTestPath(const std::string& name)
+		{
+			auto path = (std::filesystem::temp_directory_path() / ("imp_record_stream_" + std::to_string(::getpid()) + "_" + name)).string();
+			std::filesystem::remove(path);
+			return path;
+		}
+		static void AppendToFile(const std::string& path, const std::string& bytes)
+		{
+			std::ofstream file{ path, std::ios::binary | std::ios::app };
+			file << bytes;
+		}
+		static std::string MakeLines(const std::size_t lineCount, const char fill)
+		{
+			std::string lines;
+			for (std::size_t i = 0; i < lineCount; i++)
+				lines += std::string(99, fill) + '\n';
+			return lines;
+		}
+		// Makes a stream of lines into records, returns the task that streams them.
+		static auto MakeLineStream(std::vector<std::string> files, std::vector<std::string>& records, const std::size_t maxRecordsPerCall = imp::MappedRecordStream::DefaultMaxRecordsPerCall)
+		{
+			return imp::MappedRecordStream{ std::move(files), imp::MappedRecordStream::DelimitedRecords(),
+				[&records](const imp::MappedRecordStream::Record_t record) { records.emplace_back(reinterpret_cast<const char*>(record.data()), record.size()); },
+				maxRecordsPerCall };
+		}
+
+		TEST_METHOD(TestGrowingFile)
+		{
+			const auto path = MakeTestPath("growing");
+			std::vector<std::string> records;
+			const auto stream = MakeLineStream({ path }, records);
+			const auto streamTask = stream.MakeTask();
+			// the file does not exist yet, it is retried each call
+			streamTask();
+			Assert::IsTrue(records.empty());
+			// a record left incomplete across the first page, and at the end of the mapping
+			AppendToFile(path, MakeLines(40, 'a') + std::string(2000, 'x'));
+			streamTask();
+			Assert::AreEqual(std::size_t{ 40 }, records.size());
+			Assert::AreEqual(std::uint64_t{ 4000 }, stream.GetBytesDelivered());
+			// the file grows (the mapping is extended), the record spanning the old mapped end is delivered whole
+			AppendToFile(path, std::string(3000, 'x') + "\n" + MakeLines(100, 'b'));
+			streamTask();
+			Assert::AreEqual(std::size_t{ 141 }, records.size());
+			Assert::AreEqual(std::string(5000, 'x') + "\n", records[40]);
+			Assert::AreEqual(MakeLines(1, 'b'), records.back());
+			// caught up with nothing appended, the last file is followed
+			streamTask();
+			Assert::AreEqual(std::size_t{ 141 }, records.size());
+			Assert::AreEqual(std::size_t{ 1 }, stream.GetPendingFileCount());
+			Assert::AreEqual(std::uint64_t{ 0 }, stream.GetFilesCompleted());
+			Assert::AreEqual(std::filesystem::file_size(path), stream.GetBytesDelivered());
+			std::filesystem::remove(path);
+		}
+
+		TEST_METHOD(TestRollover)
+		{
+			const auto firstPath = MakeTestPath("first");
+			const auto secondPath = MakeTestPath("second");
+			AppendToFile(firstPath, MakeLines(30, 'a') + "tail");
+			AppendToFile(secondPath, MakeLines(5, 'b'));
+			std::vector<std::string> records;
+			const auto stream = MakeLineStream({ firstPath }, records, 20);
+			const auto streamTask = stream.MakeTask();
+			// bounded per call
+			streamTask();
+			Assert::AreEqual(std::size_t{ 20 }, records.size());
+			streamTask();
+			Assert::AreEqual(std::size_t{ 30 }, records.size());
+			// the trailing partial record is held while the file is the last one
+			streamTask();
+			Assert::AreEqual(std::size_t{ 30 }, records.size());
+			stream.AppendFile(secondPath);
+			Assert::AreEqual(std::size_t{ 2 }, stream.GetPendingFileCount());
+			// once the writer has moved on, the last appends to the file are picked up, then its partial record is
+			// delivered as its last, and the stream moves on
+			AppendToFile(firstPath, "ed\n" + MakeLines(1, 'c') + "end");
+			streamTask();
+			Assert::AreEqual(std::size_t{ 33 }, records.size());
+			Assert::AreEqual(std::string{ "tailed\n" }, records[30]);
+			Assert::AreEqual(std::string{ "end" }, records.back());
+			Assert::AreEqual(std::uint64_t{ 1 }, stream.GetFilesCompleted());
+			Assert::AreEqual(std::size_t{ 1 }, stream.GetPendingFileCount());
+			streamTask();
+			Assert::AreEqual(std::size_t{ 38 }, records.size());
+			Assert::AreEqual(MakeLines(1, 'b'), records.back());
+			std::filesystem::remove(firstPath);
+			std::filesystem::remove(secondPath);
+		}
+
+		TEST_METHOD(TestStreamOnUnit)
+		{
+			const auto path = MakeTestPath("unit");
+			AppendToFile(path, MakeLines(1000, 'a'));
+			auto recordBytes = std::make_shared<std::atomic<std::uint64_t>>();
+			const imp::MappedRecordStream stream{ { path }, imp::MappedRecordStream::FixedSizeRecords(100),
+				[recordBytes](const imp::MappedRecordStream::Record_t record) { (*recordBytes) += record.size(); }, 64 };
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack(stream.MakeTask());
+			imp::ThreadUnitPlusPlus tup{ tts };
+			for (int i = 0; i < 200 && stream.GetRecordsDelivered() < 1000; i++)
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			AppendToFile(path, MakeLines(10, 'b'));
+			for (int i = 0; i < 200 && stream.GetRecordsDelivered() < 1010; i++)
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			tup.DestroyThread();
+			Assert::AreEqual(std::uint64_t{ 1010 }, stream.GetRecordsDelivered());
+			Assert::AreEqual(std::uint64_t{ 101000 }, recordBytes->load());
+			std::filesystem::remove(path);
+		}
+	};
+}
+#endif
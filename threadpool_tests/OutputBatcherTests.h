@@ -0,0 +1,270 @@
+#pragma once
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../immutable_thread_pool/OutputBatcher.h"
+#include "../immutable_thread_pool/ThreadUnitPlusPlus.h"
+
+#if defined(__linux__)
+#include <csignal>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <pthread.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace threadpooltests
+{
+	TEST_CLASS(outputbatchertests)
+	{
+	public:
+		// Reads the whole of a file from the start.
+		static std::string ReadFile(const int fd)
+		{
+			std::string contents;
+			char readBuffer[4096];
+			::lseek(fd, 0, SEEK_SET);
+			for (ssize_t readBytes; (readBytes = ::read(fd, readBuffer, sizeof(readBuffer))) > 0; )
+				contents.append(readBuffer, static_cast<std::size_t>(readBytes));
+			return contents;
+		}
+
+		TEST_METHOD(TestFlushThreshold)
+		{
+			std::FILE* firstFile = std::tmpfile();
+			std::FILE* secondFile = std::tmpfile();
+			const int firstFd = ::fileno(firstFile);
+			const int secondFd = ::fileno(secondFile);
+			{
+				imp::OutputBatcher batcher{ 100, false };
+				batcher.Append(firstFd, std::string(60, 'a'));
+				batcher.Append(secondFd, "second");
+				Assert::AreEqual(std::uint64_t{ 0 }, batcher.GetWriteCalls());
+				Assert::AreEqual(std::size_t{ 66 }, batcher.GetPendingBytes());
+				// reaching the threshold flushes every destination, one writev each
+				batcher.Append(firstFd, std::string(40, 'b'));
+				Assert::AreEqual(std::uint64_t{ 2 }, batcher.GetWriteCalls());
+				Assert::AreEqual(std::size_t{ 0 }, batcher.GetPendingBytes());
+				Assert::AreEqual(std::string(60, 'a') + std::string(40, 'b'), ReadFile(firstFd));
+				// below the threshold, written on destruction
+				batcher.Append(secondFd, " more");
+				batcher.Append(firstFd, "");
+				Assert::AreEqual(std::size_t{ 5 }, batcher.GetPendingBytes());
+			}
+			Assert::AreEqual(std::string{ "second more" }, ReadFile(secondFd));
+			// a failed destination is dropped and counted, the others are still written
+			imp::OutputBatcher batcher{ 0, false };
+			batcher.Append(firstFd, "c");
+			batcher.Append(-1, "lost");
+			batcher.Append(firstFd, "d");
+			Assert::IsFalse(batcher.Flush());
+			Assert::AreEqual(std::uint64_t{ 1 }, batcher.GetWriteErrors());
+			Assert::AreEqual(std::string(60, 'a') + std::string(40, 'b') + "cd", ReadFile(firstFd));
+			Assert::IsTrue(batcher.Flush());
+			std::fclose(firstFile);
+			std::fclose(secondFile);
+		}
+
+		TEST_METHOD(TestIterationEndFlush)
+		{
+			std::FILE* outputFile = std::tmpfile();
+			const int outputFd = ::fileno(outputFile);
+			auto batcher = std::make_shared<imp::OutputBatcher>(0);
+			auto iterations = std::make_shared<std::uint64_t>();
+			imp::ThreadTaskSource tts{};
+			for (const char* output : { "a", "b", "c" })
+				tts.PushInfiniteTaskBack([batcher, outputFd, output]() { batcher->Append(outputFd, output); });
+			tts.PushIterationEndTaskBack([batcher, iterations]() { batcher->Flush(); (*iterations)++; });
+			imp::ThreadUnitPlusPlus tup{ tts };
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			tup.SetPauseValueOrdered(true);
+			tup.WaitForPauseCompleted();
+			// one writev per iteration, holding the whole iteration's output
+			Assert::IsTrue(*iterations > 0);
+			Assert::AreEqual(*iterations, batcher->GetWriteCalls());
+			const auto output = ReadFile(outputFd);
+			Assert::AreEqual(static_cast<std::size_t>(*iterations * 3), output.size());
+			for (std::size_t i = 0; i < output.size(); i++)
+				Assert::AreEqual("abc"[i % 3], output[i]);
+			tup.DestroyThread();
+			std::fclose(outputFile);
+		}
+
+		TEST_METHOD(TestInterruptedAndPartialWrites)
+		{
+			using namespace std::chrono_literals;
+			int pipeFds[2]{};
+			Assert::AreEqual(0, ::pipe(pipeFds));
+			// a single page pipe, filled so the flush blocks before writing anything
+			const int pipeSize = ::fcntl(pipeFds[1], F_SETPIPE_SZ, 4096);
+			Assert::IsTrue(pipeSize > 0);
+			::fcntl(pipeFds[1], F_SETFL, O_NONBLOCK);
+			std::size_t fillerBytes = 0;
+			for (const std::string filler(256, 'f'); ; )
+			{
+				const auto written = ::write(pipeFds[1], filler.data(), filler.size());
+				if (written <= 0)
+					break;
+				fillerBytes += static_cast<std::size_t>(written);
+			}
+			::fcntl(pipeFds[1], F_SETFL, 0);
+			// signals interrupt the blocked writev instead of restarting it
+			struct sigaction interruptAction{};
+			struct sigaction previousAction{};
+			interruptAction.sa_handler = [](int) {};
+			sigemptyset(&interruptAction.sa_mask);
+			::sigaction(SIGUSR1, &interruptAction, &previousAction);
+
+			std::string expectedOutput;
+			imp::OutputBatcher batcher{ 0, false };
+			for (int i = 0; i < 4; i++)
+			{
+				std::string buffer(static_cast<std::size_t>(pipeSize) * 3 / 4, static_cast<char>('0' + i));
+				expectedOutput += buffer;
+				batcher.Append(pipeFds[1], std::move(buffer));
+			}
+			std::atomic<bool> isFlushed{ false };
+			pthread_t writerThread{};
+			std::atomic<bool> isWriterStarted{ false };
+			std::thread writer{ [&]()
+				{
+					writerThread = ::pthread_self();
+					isWriterStarted = true;
+					isFlushed = batcher.Flush();
+				} };
+			while (!isWriterStarted)
+				std::this_thread::yield();
+			const auto ReadBytes = [&pipeFds](const std::size_t byteCount)
+			{
+				std::string readBytes;
+				char readBuffer[4096];
+				while (readBytes.size() < byteCount)
+				{
+					const auto readCount = ::read(pipeFds[0], readBuffer, std::min(sizeof(readBuffer), byteCount - readBytes.size()));
+					if (readCount <= 0)
+						break;
+					readBytes.append(readBuffer, static_cast<std::size_t>(readCount));
+				}
+				return readBytes;
+			};
+			// interrupted before writing anything, retried
+			std::this_thread::sleep_for(20ms);
+			::pthread_kill(writerThread, SIGUSR1);
+			std::this_thread::sleep_for(20ms);
+			// room for part of the output, interrupted after a partial write, continued from within a buffer
+			Assert::AreEqual(std::string(fillerBytes, 'f'), ReadBytes(fillerBytes));
+			std::this_thread::sleep_for(20ms);
+			::pthread_kill(writerThread, SIGUSR1);
+			const auto output = ReadBytes(expectedOutput.size());
+			writer.join();
+			::sigaction(SIGUSR1, &previousAction, nullptr);
+			Assert::IsTrue(isFlushed.load());
+			Assert::IsTrue(output == expectedOutput, L"Output was not written in order and complete.");
+			Assert::IsTrue(batcher.GetWriteCalls() >= 3, L"The writes were not interrupted.");
+			Assert::AreEqual(std::uint64_t{ 0 }, batcher.GetWriteErrors());
+			::close(pipeFds[0]);
+			::close(pipeFds[1]);
+		}
+
+		TEST_METHOD(TestWouldBlockKeepsPending)
+		{
+			for (const bool isIoUringEnabled : { false, true })
+			{
+				// two single page non-blocking pipes, each taking part of its output (written with writev, also when
+				// io_uring is enabled, as io_uring would wait for them)
+				int pipeFds[2][2]{};
+				std::string expectedOutput[2];
+				imp::OutputBatcher batcher{ 0, isIoUringEnabled };
+				for (int p = 0; p < 2; p++)
+				{
+					Assert::AreEqual(0, ::pipe2(pipeFds[p], O_NONBLOCK));
+					Assert::IsTrue(::fcntl(pipeFds[p][1], F_SETPIPE_SZ, 4096) > 0);
+					for (int i = 0; i < 3; i++)
+					{
+						std::string buffer(3000, static_cast<char>('a' + p * 3 + i));
+						expectedOutput[p] += buffer;
+						batcher.Append(pipeFds[p][1], std::move(buffer));
+					}
+				}
+				const auto GetPipedBytes = [&pipeFds]()
+				{
+					std::size_t pipedBytes = 0;
+					for (const auto& fds : pipeFds)
+					{
+						int available = 0;
+						::ioctl(fds[0], FIONREAD, &available);
+						pipedBytes += static_cast<std::size_t>(available);
+					}
+					return pipedBytes;
+				};
+				// the unwritten tails stay pending, nothing is dropped
+				Assert::IsFalse(batcher.Flush());
+				Assert::AreEqual(std::uint64_t{ 0 }, batcher.GetWriteErrors());
+				Assert::IsTrue(batcher.GetPendingBytes() > 0);
+				Assert::AreEqual(std::size_t{ 18000 } - GetPipedBytes(), batcher.GetPendingBytes());
+				// drained, the next flushes continue from the first unwritten byte
+				std::string output[2];
+				const auto ReadAvailable = [&pipeFds, &output]()
+				{
+					char readBuffer[4096];
+					for (int p = 0; p < 2; p++)
+					{
+						for (ssize_t readBytes; (readBytes = ::read(pipeFds[p][0], readBuffer, sizeof(readBuffer))) > 0; )
+							output[p].append(readBuffer, static_cast<std::size_t>(readBytes));
+					}
+				};
+				for (int flushes = 0; !batcher.Flush(); flushes++)
+				{
+					Assert::IsTrue(flushes < 10, L"The pending output was not written.");
+					ReadAvailable();
+				}
+				ReadAvailable();
+				Assert::AreEqual(std::size_t{ 0 }, batcher.GetPendingBytes());
+				Assert::AreEqual(std::uint64_t{ 0 }, batcher.GetWriteErrors());
+				for (int p = 0; p < 2; p++)
+				{
+					Assert::IsTrue(output[p] == expectedOutput[p], L"Output was not written in order and complete.");
+					::close(pipeFds[p][0]);
+					::close(pipeFds[p][1]);
+				}
+			}
+		}
+
+		TEST_METHOD(TestIoUringDestinations)
+		{
+			std::FILE* files[3]{ std::tmpfile(), std::tmpfile(), std::tmpfile() };
+			imp::OutputBatcher batcher{ 0 };
+			for (int round = 0; round < 2; round++)
+			{
+				for (int f = 0; f < 3; f++)
+				{
+					batcher.Append(::fileno(files[f]), std::string(100, static_cast<char>('a' + f)));
+					batcher.Append(::fileno(files[f]), std::string(50, static_cast<char>('A' + f)));
+				}
+			}
+			batcher.Append(-1, "lost");
+			const auto writeCalls = batcher.GetWriteCalls();
+			// a failed destination is dropped and counted, the others are still written
+			Assert::IsFalse(batcher.Flush());
+			Assert::AreEqual(std::uint64_t{ 1 }, batcher.GetWriteErrors());
+			Assert::AreEqual(std::size_t{ 0 }, batcher.GetPendingBytes());
+			for (int f = 0; f < 3; f++)
+			{
+				const std::string line = std::string(100, static_cast<char>('a' + f)) + std::string(50, static_cast<char>('A' + f));
+				Assert::AreEqual(line + line, ReadFile(::fileno(files[f])));
+			}
+			if (batcher.IsIoUringActive())
+			{
+				// the writes of all the destinations are submitted with a single io_uring_enter
+				Assert::AreEqual(writeCalls + 1, batcher.GetWriteCalls());
+			}
+			else
+			{
+				Assert::AreEqual(writeCalls + 4, batcher.GetWriteCalls());
+			}
+			for (std::FILE* file : files)
+				std::fclose(file);
+		}
+	};
+}
+#endif
@@ -0,0 +1,162 @@
+#pragma once
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../immutable_thread_pool/PluginTask.h"
+#include "../immutable_thread_pool/ThreadUnitPlusPlus.h"
+
+// Unix only, so the MSVC test project does not build these tests, the Linux test job (.github/workflows/linux-tests.yml)
+// builds and runs them, with the two versions of the test plugin library (TestTaskPlugin.cpp) in IMP_TEST_PLUGIN_DIR.
+#if defined(__unix__)
+#include <dlfcn.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace threadpooltests
+{
+	TEST_CLASS(plugintasktests)
+	{
+	public:
+		// Built-in versions of a task set, each task records the version that ran into the context.
+		using VersionRecord_t = std::vector<std::uint32_t>;
+		template<std::uint32_t Version>
+		static void RecordVersion(void* context)
+		{
+			static_cast<VersionRecord_t*>(context)->emplace_back(Version);
+		}
+		template<std::uint32_t Version>
+		static imp::TaskPluginRunFn_t FindVersionTask(const char* taskName)
+		{
+			return std::string_view{ taskName } == "first" || std::string_view{ taskName } == "second" ? &RecordVersion<Version> : nullptr;
+		}
+		template<std::uint32_t Version>
+		static const imp::TaskPluginDescriptor* GetVersionDescriptor()
+		{
+			static const imp::TaskPluginDescriptor descriptor{ imp::TaskPluginApiVersion, Version, &FindVersionTask<Version> };
+			return &descriptor;
+		}
+
+		TEST_METHOD(TestPluginReload)
+		{
+			using namespace std::chrono_literals;
+			imp::TaskPluginLoader loader{};
+			Assert::IsTrue(loader.LoadBuiltIn(GetVersionDescriptor<1>(), "v1"));
+			auto record = std::make_shared<VersionRecord_t>();
+			const auto latch = loader.MakeLatch();
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack(loader.MakeTask(latch, "first", record));
+			tts.PushInfiniteTaskBack(loader.MakeTask(latch, "second", record));
+			tts.PushInfiniteTaskBack(loader.MakeTask(latch, "missing", record));
+			tts.PushIterationEndTaskBack(loader.MakeLatchTask(latch));
+			imp::ThreadUnitPlusPlus tup{ tts };
+			// reloads land part way through iterations, each iteration still runs a single version
+			for (int i = 0; i < 200; i++)
+			{
+				if (i % 2 == 0)
+					Assert::IsTrue(loader.LoadBuiltIn(GetVersionDescriptor<2>(), "v2"));
+				else
+					Assert::IsTrue(loader.LoadBuiltIn(GetVersionDescriptor<1>(), "v1"));
+				std::this_thread::sleep_for(100us);
+			}
+			tup.SetPauseValueOrdered(true);
+			tup.WaitForPauseCompleted();
+			Assert::IsTrue(record->size() % 2 == 0 && !record->empty());
+			bool isReloaded{ false };
+			for (std::size_t i = 0; i < record->size(); i += 2)
+			{
+				Assert::AreEqual((*record)[i], (*record)[i + 1], L"An iteration mixed plugin versions.");
+				isReloaded = isReloaded || (*record)[i] != record->front();
+			}
+			Assert::IsTrue(isReloaded, L"Tasks did not swap to the reloaded version.");
+			// the latch swaps at the end of the next iteration
+			Assert::IsTrue(loader.LoadBuiltIn(GetVersionDescriptor<2>(), "v2"));
+			record->clear();
+			tup.SetPauseValueOrdered(false);
+			std::this_thread::sleep_for(20ms);
+			tup.SetPauseValueOrdered(true);
+			tup.WaitForPauseCompleted();
+			Assert::AreEqual(std::uint32_t{ 2 }, record->back());
+			Assert::AreEqual(std::uint32_t{ 2 }, latch->GetPlugin()->GetPluginVersion());
+		}
+
+		TEST_METHOD(TestPluginFailedReload)
+		{
+			using namespace std::chrono_literals;
+			imp::TaskPluginLoader loader{};
+			auto record = std::make_shared<VersionRecord_t>();
+			const auto latch = loader.MakeLatch();
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack(loader.MakeTask(latch, "first", record));
+			tts.PushIterationEndTaskBack(loader.MakeLatchTask(latch));
+			tts.PushIterationEndTaskBack([]() { std::this_thread::sleep_for(100us); });
+			imp::ThreadUnitPlusPlus tup{ tts, {} };
+			// nothing runs until a version is loaded
+			std::this_thread::sleep_for(10ms);
+			tup.SetPauseValueOrdered(true);
+			tup.WaitForPauseCompleted();
+			Assert::IsTrue(record->empty());
+			Assert::IsTrue(loader.LoadBuiltIn(GetVersionDescriptor<1>(), "v1"));
+			// failed loads leave the current version published and running
+			Assert::IsFalse(loader.Load("/nonexistent/libimp_tasks.so.2"));
+			const imp::TaskPluginDescriptor incompatible{ imp::TaskPluginApiVersion + 1, 2, &FindVersionTask<2> };
+			Assert::IsFalse(loader.LoadBuiltIn(&incompatible, "incompatible"));
+			Assert::IsFalse(loader.LoadBuiltIn(nullptr, "null"));
+			Assert::AreEqual(std::string{ "v1" }, loader.GetCurrentPlugin()->GetPath());
+			tup.SetPauseValueOrdered(false);
+			std::this_thread::sleep_for(20ms);
+			tup.SetPauseValueOrdered(true);
+			tup.WaitForPauseCompleted();
+			Assert::IsFalse(record->empty());
+			for (const auto version : *record)
+				Assert::AreEqual(std::uint32_t{ 1 }, version);
+		}
+
+#if defined(IMP_TEST_PLUGIN_DIR)
+		TEST_METHOD(TestPluginLibrarySwap)
+		{
+			using namespace std::chrono_literals;
+			const std::string firstPath{ IMP_TEST_PLUGIN_DIR "/libimp_test_plugin.so.1" };
+			const std::string secondPath{ IMP_TEST_PLUGIN_DIR "/libimp_test_plugin.so.2" };
+			// RTLD_NOLOAD only returns a handle if the library is still loaded
+			const auto IsLoaded = [](const std::string& path)
+			{
+				void* libraryHandle = ::dlopen(path.c_str(), RTLD_NOW | RTLD_NOLOAD);
+				if (libraryHandle != nullptr)
+					::dlclose(libraryHandle);
+				return libraryHandle != nullptr;
+			};
+			imp::TaskPluginLoader loader{};
+			Assert::IsFalse(IsLoaded(firstPath));
+			Assert::IsTrue(loader.Load(firstPath));
+			Assert::IsTrue(IsLoaded(firstPath));
+			auto record = std::make_shared<VersionRecord_t>();
+			const auto latch = loader.MakeLatch();
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack(loader.MakeTask(latch, "first", record));
+			tts.PushInfiniteTaskBack(loader.MakeTask(latch, "second", record));
+			tts.PushIterationEndTaskBack(loader.MakeLatchTask(latch));
+			imp::ThreadUnitPlusPlus tup{ tts };
+			std::this_thread::sleep_for(10ms);
+			// loaded part way through an iteration, the unit swaps to it at the iteration boundary
+			Assert::IsTrue(loader.Load(secondPath));
+			Assert::AreEqual(std::uint32_t{ 2 }, loader.GetCurrentPlugin()->GetPluginVersion());
+			std::this_thread::sleep_for(20ms);
+			tup.SetPauseValueOrdered(true);
+			tup.WaitForPauseCompleted();
+			Assert::IsTrue(record->size() % 2 == 0 && !record->empty());
+			Assert::AreEqual(std::uint32_t{ 1 }, record->front());
+			Assert::AreEqual(std::uint32_t{ 2 }, record->back());
+			for (std::size_t i = 0; i < record->size(); i += 2)
+			{
+				Assert::AreEqual((*record)[i], (*record)[i + 1], L"An iteration mixed plugin versions.");
+				Assert::IsTrue(i == 0 || (*record)[i - 1] <= (*record)[i], L"Tasks ran an older version after the swap.");
+			}
+			Assert::AreEqual(std::uint32_t{ 2 }, latch->GetPlugin()->GetPluginVersion());
+			// no latch references the first version anymore, so it was unloaded
+			Assert::IsFalse(IsLoaded(firstPath), L"The previous plugin version was not unloaded.");
+			Assert::IsTrue(IsLoaded(secondPath));
+			tup.DestroyThread();
+		}
+#endif
+	};
+}
+#endif
@@ -0,0 +1,150 @@
+#pragma once
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../immutable_thread_pool/PressureMonitor.h"
+
+#if defined(__linux__)
+#include <filesystem>
+#include <fstream>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace threadpooltests
+{
+	TEST_CLASS(pressuremonitortests)
+	{
+	public:
+		static std::string MakeTestPath(const std::string& name)
+		{
+			return (std::filesystem::temp_directory_path() / ("imp_pressure_" + std::to_string(::getpid()) + "_" + name)).string();
+		}
+		// Replaces the file in one step, so a concurrent reader sees the old or the new text.
+		static void WritePressureFile(const std::string& path, const std::string& text)
+		{
+			{
+				std::ofstream pressureFile{ path + ".tmp", std::ios::trunc };
+				pressureFile << text;
+			}
+			std::filesystem::rename(path + ".tmp", path);
+		}
+		static std::string MakePsiText(const double someAvg10, const double fullAvg10 = 0.0)
+		{
+			return "some avg10=" + std::to_string(someAvg10) + " avg60=1.50 avg300=0.25 total=123456\n"
+				+ "full avg10=" + std::to_string(fullAvg10) + " avg60=0.75 avg300=0.00 total=6543\n";
+		}
+
+		TEST_METHOD(TestReadPressureFile)
+		{
+			const auto path = MakeTestPath("parse");
+			WritePressureFile(path, "some avg10=12.34 avg60=5.67 avg300=1.00 total=987654321\nfull avg10=3.21 avg60=0.50 avg300=0.10 total=12345\n");
+			const auto stats = imp::PressureMonitor::ReadPressureFile(path);
+			Assert::IsTrue(stats.has_value());
+			Assert::AreEqual(12.34, stats->SomeAvg10);
+			Assert::AreEqual(5.67, stats->SomeAvg60);
+			Assert::AreEqual(3.21, stats->FullAvg10);
+			Assert::AreEqual(0.50, stats->FullAvg60);
+			// the CPU file of older kernels has no "full" line
+			WritePressureFile(path, "some avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+			Assert::IsTrue(imp::PressureMonitor::ReadPressureFile(path).has_value());
+			// no "some" line, malformed text, or no file at all, read as no PSI support
+			WritePressureFile(path, "full avg10=3.21 avg60=0.50 avg300=0.10 total=12345\n");
+			Assert::IsFalse(imp::PressureMonitor::ReadPressureFile(path).has_value());
+			WritePressureFile(path, "some avg10=high\n");
+			Assert::IsFalse(imp::PressureMonitor::ReadPressureFile(path).has_value());
+			std::filesystem::remove(path);
+			Assert::IsFalse(imp::PressureMonitor::ReadPressureFile(path).has_value());
+
+			// the pressure is the larger of CPU and memory, either may be missing
+			imp::PressureMonitorOptions options{};
+			options.CpuPressurePath = MakeTestPath("cpu");
+			options.MemoryPressurePath = MakeTestPath("memory");
+			options.PollInterval = {};
+			imp::PressureMonitor monitor{ options };
+			Assert::IsFalse(monitor.ReadPressure().has_value());
+			WritePressureFile(options.MemoryPressurePath, MakePsiText(30.0, 90.0));
+			Assert::AreEqual(30.0, *monitor.ReadPressure());
+			WritePressureFile(options.CpuPressurePath, MakePsiText(45.5));
+			Assert::AreEqual(45.5, *monitor.ReadPressure());
+			Assert::IsFalse(monitor.GetLastPressure().has_value());
+			std::filesystem::remove(options.CpuPressurePath);
+			std::filesystem::remove(options.MemoryPressurePath);
+			const auto cgroupOptions = imp::PressureMonitorOptions::ForCgroup("/sys/fs/cgroup/app");
+			Assert::AreEqual(std::string{ "/sys/fs/cgroup/app/cpu.pressure" }, cgroupOptions.CpuPressurePath);
+			Assert::AreEqual(std::string{ "/sys/fs/cgroup/app/memory.pressure" }, cgroupOptions.MemoryPressurePath);
+		}
+
+		TEST_METHOD(TestThrottleHysteresis)
+		{
+			using Level = imp::UnitThrottle::Level;
+			const imp::PressureThresholds thresholds{ 20.0, 50.0, 5.0 };
+			// levels are entered at their thresholds
+			Assert::IsTrue(imp::PressureMonitor::GetThrottleLevel(Level::None, 19.9, thresholds) == Level::None);
+			Assert::IsTrue(imp::PressureMonitor::GetThrottleLevel(Level::None, 20.0, thresholds) == Level::Slow);
+			Assert::IsTrue(imp::PressureMonitor::GetThrottleLevel(Level::None, 50.0, thresholds) == Level::Pause);
+			// and only left once the pressure is past the hysteresis
+			Assert::IsTrue(imp::PressureMonitor::GetThrottleLevel(Level::Pause, 45.0, thresholds) == Level::Pause);
+			Assert::IsTrue(imp::PressureMonitor::GetThrottleLevel(Level::Pause, 44.9, thresholds) == Level::Slow);
+			Assert::IsTrue(imp::PressureMonitor::GetThrottleLevel(Level::Slow, 45.0, thresholds) == Level::Slow);
+			Assert::IsTrue(imp::PressureMonitor::GetThrottleLevel(Level::Slow, 15.0, thresholds) == Level::Slow);
+			Assert::IsTrue(imp::PressureMonitor::GetThrottleLevel(Level::Slow, 14.9, thresholds) == Level::None);
+			Assert::IsTrue(imp::PressureMonitor::GetThrottleLevel(Level::Pause, 10.0, thresholds) == Level::None);
+
+			// each registered throttle follows the pressure with its own thresholds
+			imp::PressureMonitorOptions options{};
+			options.PollInterval = {};
+			imp::PressureMonitor monitor{ options };
+			auto throttle = std::make_shared<imp::UnitThrottle>();
+			auto eagerThrottle = std::make_shared<imp::UnitThrottle>();
+			monitor.AddThrottle(throttle, thresholds);
+			monitor.AddThrottle(eagerThrottle, imp::PressureThresholds{ 5.0, 10.0, 2.0 });
+			const std::vector<std::tuple<double, Level, Level>> updates{
+				{ 12.0, Level::None, Level::Pause },
+				{ 21.0, Level::Slow, Level::Pause },
+				{ 16.0, Level::Slow, Level::Pause },
+				{ 55.0, Level::Pause, Level::Pause },
+				{ 46.0, Level::Pause, Level::Pause },
+				{ 8.5, Level::None, Level::Pause },
+				{ 7.5, Level::None, Level::Slow },
+				{ 3.5, Level::None, Level::Slow },
+				{ 2.9, Level::None, Level::None } };
+			for (const auto& [pressure, level, eagerLevel] : updates)
+			{
+				monitor.Update(pressure);
+				Assert::IsTrue(throttle->GetLevel() == level);
+				Assert::IsTrue(eagerThrottle->GetLevel() == eagerLevel);
+				Assert::AreEqual(pressure, *monitor.GetLastPressure());
+			}
+		}
+
+		TEST_METHOD(TestPressurePolling)
+		{
+			using namespace std::chrono_literals;
+			using Level = imp::UnitThrottle::Level;
+			imp::PressureMonitorOptions options{};
+			options.CpuPressurePath = MakeTestPath("poll_cpu");
+			options.MemoryPressurePath = MakeTestPath("poll_memory");
+			options.PollInterval = 5ms;
+			WritePressureFile(options.CpuPressurePath, MakePsiText(1.0));
+			auto throttle = std::make_shared<imp::UnitThrottle>();
+			imp::PressureMonitor monitor{ options };
+			monitor.AddThrottle(throttle);
+			const auto WaitForLevel = [&throttle](const Level level)
+			{
+				for (int i = 0; i < 400 && throttle->GetLevel() != level; i++)
+					std::this_thread::sleep_for(5ms);
+				return throttle->GetLevel() == level;
+			};
+			// the poll thread reads the files and sets the level
+			WritePressureFile(options.MemoryPressurePath, MakePsiText(70.0));
+			Assert::IsTrue(WaitForLevel(Level::Pause), L"Throttle not paused by high pressure.");
+			WritePressureFile(options.MemoryPressurePath, MakePsiText(25.0));
+			Assert::IsTrue(WaitForLevel(Level::Slow), L"Throttle not slowed as pressure subsided.");
+			WritePressureFile(options.MemoryPressurePath, MakePsiText(0.0));
+			Assert::IsTrue(WaitForLevel(Level::None), L"Throttle not lifted.");
+			Assert::AreEqual(1.0, *monitor.GetLastPressure());
+			std::filesystem::remove(options.CpuPressurePath);
+			std::filesystem::remove(options.MemoryPressurePath);
+		}
+	};
+}
+#endif
@@ -0,0 +1,220 @@
+#pragma once
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../immutable_thread_pool/ProcessUnitHost.h"
+
+#if defined(__linux__)
+#include <csignal>
+#include <fstream>
+#include <sys/mman.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace threadpooltests
+{
+	TEST_CLASS(processunithosttests)
+	{
+	public:
+		// Polls isDone until it returns true or the timeout elapses, returns the last result.
+		template<typename Pred_t>
+		static bool WaitFor(const Pred_t& isDone, const std::chrono::milliseconds timeout = std::chrono::seconds(10))
+		{
+			const auto endTime = std::chrono::steady_clock::now() + timeout;
+			while (!isDone())
+			{
+				if (std::chrono::steady_clock::now() >= endTime)
+					return isDone();
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			return true;
+		}
+
+		static imp::ThreadTaskSource MakeSleepingTasks()
+		{
+			imp::ThreadTaskSource tts{};
+			for (int i = 0; i < 4; i++)
+				tts.PushInfiniteTaskBack([]() { std::this_thread::sleep_for(std::chrono::microseconds(200)); });
+			return tts;
+		}
+
+		TEST_METHOD(TestProcessUnitPauseResume)
+		{
+			using namespace std::chrono_literals;
+			imp::ProcessUnitHost host{};
+			host.RegisterTaskSet("sleepers", &MakeSleepingTasks);
+			auto unit = host.SpawnUnit("sleepers");
+			Assert::IsTrue(unit.has_value() && unit->IsRunning());
+			Assert::IsTrue(WaitFor([&]() { return unit->GetTasksRun() > 0; }), L"Worker never ran a task.");
+			Assert::AreEqual(std::size_t{ 4 }, unit->GetNumberOfTasks());
+
+			const auto IsStalled = [&]()
+			{
+				const auto tasksRun = unit->GetTasksRun();
+				std::this_thread::sleep_for(50ms);
+				return tasksRun == unit->GetTasksRun();
+			};
+			const auto IsAdvancing = [&]()
+			{
+				const auto tasksRun = unit->GetTasksRun();
+				return WaitFor([&]() { return unit->GetTasksRun() > tasksRun; });
+			};
+
+			// ordered pause stops at an iteration boundary
+			unit->SetPauseValueOrdered(true);
+			unit->WaitForPauseCompleted();
+			Assert::IsTrue(unit->GetPauseCompletionStatus());
+			Assert::AreEqual(std::uint64_t{ 0 }, unit->GetTasksRun() % 4, L"Ordered pause stopped mid-list.");
+			Assert::IsTrue(IsStalled(), L"Paused worker kept running tasks.");
+			unit->SetPauseValueOrdered(false);
+			Assert::IsTrue(IsAdvancing(), L"Worker did not resume.");
+
+			// unordered pause, then resumed and requested again at once, the second request is not lost
+			for (int i = 0; i < 20; i++)
+			{
+				unit->SetPauseValueUnordered(true);
+				unit->WaitForPauseCompleted();
+				Assert::IsTrue(unit->GetPauseCompletionStatus());
+				unit->SetPauseValueUnordered(false);
+				unit->SetPauseValueUnordered(true);
+				unit->WaitForPauseCompleted();
+				Assert::IsTrue(unit->GetPauseCompletionStatus(), L"Pause request lost.");
+				Assert::IsTrue(IsStalled(), L"Paused worker kept running tasks.");
+				unit->SetPauseValueUnordered(false);
+				Assert::IsTrue(IsAdvancing(), L"Worker did not resume.");
+			}
+
+			unit->DestroyThread();
+			Assert::IsFalse(unit->IsRunning());
+			Assert::IsTrue(WIFEXITED(unit->GetExitStatus()) && WEXITSTATUS(unit->GetExitStatus()) == 0);
+		}
+
+		TEST_METHOD(TestProcessUnitCrashRespawn)
+		{
+			// the factory runs in the forked worker, so it sees the value at spawn time
+			bool isCrashing{ true };
+			imp::ProcessUnitHost host{};
+			host.RegisterTaskSet("crasher", [&isCrashing]()
+			{
+				auto tts = MakeSleepingTasks();
+				if (isCrashing)
+					tts.PushInfiniteTaskBack([runCount = 0]() mutable { if (++runCount == 10) std::abort(); });
+				return tts;
+			});
+			auto unit = host.SpawnUnit("crasher");
+			Assert::IsTrue(unit.has_value());
+			Assert::IsTrue(WaitFor([&]() { return !unit->IsRunning(); }), L"Crashing worker still running.");
+			Assert::IsTrue(WIFSIGNALED(unit->GetExitStatus()) && WTERMSIG(unit->GetExitStatus()) == SIGABRT);
+			Assert::AreEqual(std::uint64_t{ 9 }, unit->GetHeartbeat());
+			// waiting on a dead worker returns
+			unit->SetPauseValueOrdered(true);
+			unit->WaitForPauseCompleted();
+			Assert::IsFalse(unit->GetPauseCompletionStatus());
+
+			// respawn in place of the crashed worker
+			isCrashing = false;
+			unit = host.SpawnUnit("crasher");
+			Assert::IsTrue(unit.has_value() && unit->IsRunning());
+			Assert::IsTrue(WaitFor([&]() { return unit->GetHeartbeat() > 20; }), L"Respawned worker not running.");
+			Assert::IsTrue(unit->IsRunning());
+			Assert::IsFalse(host.SpawnUnit("unknown").has_value());
+		}
+
+		TEST_METHOD(TestProcessUnitGroup)
+		{
+			using namespace std::chrono_literals;
+			// counters in memory shared with the worker, one per kind of task
+			struct SharedCounters
+			{
+				std::atomic<std::uint64_t> Infinite, HighPriority, IterationEnd, Range;
+			};
+			void* mapping = mmap(nullptr, sizeof(SharedCounters), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+			Assert::IsTrue(mapping != MAP_FAILED);
+			auto* counters = new (mapping) SharedCounters{};
+			imp::ProcessUnitHost host{};
+			// two units in one worker process, using every kind of task list but the signalled one
+			host.RegisterTaskGroup("group", [counters]()
+			{
+				imp::ThreadTaskSource first = MakeSleepingTasks();
+				first.PushInfiniteTaskBack([counters]() { counters->Infinite.fetch_add(1); });
+				first.PushHighPriorityTaskBack([counters]() { counters->HighPriority.fetch_add(1); });
+				first.PushIterationEndTaskBack([counters]() { counters->IterationEnd.fetch_add(1); });
+				imp::ThreadTaskSource second{};
+				second.PushRangeTasksBack(std::make_shared<std::vector<std::function<void()>>>(3, [counters]()
+				{
+					counters->Range.fetch_add(1);
+					std::this_thread::sleep_for(std::chrono::microseconds(200));
+				}));
+				return std::vector<imp::ThreadTaskSource>{ first, second };
+			});
+			// paused on start, no task runs until it is resumed
+			auto unit = host.SpawnUnit("group", true);
+			Assert::IsTrue(unit.has_value());
+			unit->WaitForPauseCompleted();
+			Assert::IsTrue(unit->GetPauseCompletionStatus());
+			Assert::AreEqual(std::size_t{ 5 + 1 + 1 + 3 }, unit->GetNumberOfTasks());
+			std::this_thread::sleep_for(50ms);
+			Assert::AreEqual(std::uint64_t{ 0 }, counters->Infinite.load() + counters->Range.load() + unit->GetHeartbeat());
+			unit->SetPauseValueOrdered(false);
+			Assert::IsTrue(WaitFor([&]() { return counters->Infinite > 10 && counters->HighPriority > 10 && counters->IterationEnd > 10 && counters->Range > 30; }),
+				L"Not every task list ran in the worker.");
+			Assert::IsTrue(WaitFor([&]() { return unit->GetHeartbeat() > 20 && unit->GetTasksRun() > 0; }));
+
+			// an ordered pause completes once both units have paused at the end of an iteration
+			unit->SetPauseValueOrdered(true);
+			unit->WaitForPauseCompleted();
+			Assert::IsTrue(unit->GetPauseCompletionStatus());
+			const auto infiniteCount = counters->Infinite.load();
+			const auto rangeCount = counters->Range.load();
+			Assert::AreEqual(infiniteCount, counters->IterationEnd.load());
+			Assert::AreEqual(std::uint64_t{ 0 }, rangeCount % 3);
+			std::this_thread::sleep_for(50ms);
+			Assert::AreEqual(infiniteCount, counters->Infinite.load(), L"Paused worker kept running tasks.");
+			Assert::AreEqual(rangeCount, counters->Range.load(), L"Paused worker kept running tasks.");
+			unit->SetPauseValueOrdered(false);
+			Assert::IsTrue(WaitFor([&]() { return counters->Infinite > infiniteCount && counters->Range > rangeCount; }), L"Worker did not resume.");
+			unit->DestroyThread();
+			Assert::IsTrue(WIFEXITED(unit->GetExitStatus()) && WEXITSTATUS(unit->GetExitStatus()) == 0);
+			munmap(mapping, sizeof(SharedCounters));
+		}
+
+		TEST_METHOD(TestProcessUnitHostDeath)
+		{
+			// a host process that spawns a worker and exits without stopping it
+			int pidPipe[2]{};
+			Assert::AreEqual(0, pipe(pidPipe));
+			const pid_t hostPid = fork();
+			Assert::IsTrue(hostPid >= 0);
+			if (hostPid == 0)
+			{
+				imp::ProcessUnitHost host{};
+				host.RegisterTaskSet("sleepers", &MakeSleepingTasks);
+				auto unit = host.SpawnUnit("sleepers");
+				const pid_t workerPid = unit.has_value() ? unit->GetWorkerPid() : -1;
+				// written by the host only, once its worker is running
+				while (unit.has_value() && unit->GetTasksRun() == 0)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				(void)!write(pidPipe[1], &workerPid, sizeof(workerPid));
+				_exit(0);
+			}
+			close(pidPipe[1]);
+			pid_t workerPid{ -1 };
+			Assert::AreEqual(static_cast<ssize_t>(sizeof(workerPid)), read(pidPipe[0], &workerPid, sizeof(workerPid)));
+			close(pidPipe[0]);
+			int hostStatus{};
+			waitpid(hostPid, &hostStatus, 0);
+			Assert::IsTrue(workerPid > 0);
+			// the orphaned worker exits (it is left a zombie if nothing reaps orphans)
+			const auto IsWorkerExited = [workerPid]()
+			{
+				std::ifstream statFile{ "/proc/" + std::to_string(workerPid) + "/stat" };
+				std::string stat;
+				if (!std::getline(statFile, stat))
+					return true;
+				const auto stateIndex = stat.rfind(')') + 2;
+				return stateIndex < stat.size() && (stat[stateIndex] == 'Z' || stat[stateIndex] == 'X');
+			};
+			Assert::IsTrue(WaitFor(IsWorkerExited), L"Worker kept running after its host exited.");
+		}
+	};
+}
+#endif
@@ -0,0 +1,26 @@
+// Task plugin library used by PluginTaskTests.h, built as two versions (distinct paths) by the Linux test job:
+// g++ -std=c++20 -shared -fPIC -DIMP_TEST_PLUGIN_VERSION=1 threadpool_tests/TestTaskPlugin.cpp -o plugins/libimp_test_plugin.so.1
+// Its tasks "first" and "second" record the plugin version into the context, a std::vector<std::uint32_t>.
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "../immutable_thread_pool/PluginTask.h"
+
+#if !defined(IMP_TEST_PLUGIN_VERSION)
+#error Define IMP_TEST_PLUGIN_VERSION to the version of the plugin being built.
+#endif
+
+namespace
+{
+	void RecordVersion(void* context)
+	{
+		static_cast<std::vector<std::uint32_t>*>(context)->emplace_back(IMP_TEST_PLUGIN_VERSION);
+	}
+
+	imp::TaskPluginRunFn_t FindTask(const char* taskName)
+	{
+		return std::strcmp(taskName, "first") == 0 || std::strcmp(taskName, "second") == 0 ? &RecordVersion : nullptr;
+	}
+}
+
+IMP_DEFINE_TASK_PLUGIN(IMP_TEST_PLUGIN_VERSION, &FindTask)
@@ -2,6 +2,10 @@
 #include "pch.h"
 #include "CppUnitTest.h"
 #include "../immutable_thread_pool/ThreadUnitPlusPlus.h"
+#include "../immutable_thread_pool/BlockingUnitGroup.h"
+#include "../immutable_thread_pool/ConcurrentTaskListBuilder.h"
+#include "../immutable_thread_pool/SlabBufferPool.h"
+#include "../immutable_thread_pool/SamplingProfiler.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -71,5 +75,643 @@ namespace threadpooltests
 			// test pause completion status
 			Assert::IsFalse(tu.GetPauseCompletionStatus(), L"Paused reported as completed incorrectly.");
 		}
+
+		TEST_METHOD(TestSignalledTasks)
+		{
+			using namespace std::chrono_literals;
+			const auto WaitForCount = [](const std::atomic<std::size_t>& count, const std::size_t expected)
+			{
+				for (int i = 0; i < 200 && count.load() < expected; i++)
+					std::this_thread::sleep_for(10ms);
+				return count.load();
+			};
+			std::atomic<std::size_t> runCount{};
+			imp::TaskSignal signal;
+			imp::ThreadTaskSource tts{};
+			tts.PushSignalledTaskBack(signal, [&runCount]() { ++runCount; });
+			imp::ThreadUnitPlusPlus tu{ tts };
+			Assert::AreEqual(std::size_t{ 1 }, tu.GetNumberOfTasks(), L"Signalled task not counted.");
+			// signalled tasks run once at start
+			Assert::AreEqual(std::size_t{ 1 }, WaitForCount(runCount, 1), L"Signalled task did not run at start.");
+			// and not again until signalled
+			std::this_thread::sleep_for(50ms);
+			Assert::AreEqual(std::size_t{ 1 }, runCount.load(), L"Signalled task ran without the signal being set.");
+			signal.Set();
+			Assert::AreEqual(std::size_t{ 2 }, WaitForCount(runCount, 2), L"Signalled task did not run after the signal was set.");
+			// pause and destroy while parked on the ready set
+			tu.SetPauseValueOrdered(true);
+			tu.WaitForPauseCompleted();
+			Assert::IsTrue(tu.GetPauseCompletionStatus(), L"Paused reported as uncompleted incorrectly.");
+			tu.DestroyThread();
+			Assert::IsFalse(tu.IsRunning());
+		}
+
+		TEST_METHOD(TestMovePaused)
+		{
+			using namespace std::chrono_literals;
+			std::atomic<std::size_t> runCount{};
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack([&runCount]() { ++runCount; std::this_thread::sleep_for(1ms); });
+			imp::ThreadUnitPlusPlus tu{ tts };
+			tu.SetPauseValueOrdered(true);
+			tu.WaitForPauseCompleted();
+			// move the paused unit, the work thread must follow the pause state of the new owner
+			imp::ThreadUnitPlusPlus movedTo{ std::move(tu) };
+			Assert::IsFalse(tu.IsRunning(), L"Moved-from unit reported as running.");
+			Assert::IsTrue(movedTo.GetPauseCompletionStatus(), L"Paused reported as uncompleted incorrectly.");
+			const auto pausedCount = runCount.load();
+			movedTo.SetPauseValueOrdered(false);
+			for (int i = 0; i < 200 && runCount.load() == pausedCount; i++)
+				std::this_thread::sleep_for(10ms);
+			Assert::IsTrue(runCount.load() > pausedCount, L"Moved unit did not resume.");
+			// move-assign over a running unit, then destroy both
+			imp::ThreadUnitPlusPlus other{ tts };
+			other = std::move(movedTo);
+			Assert::IsTrue(other.IsRunning());
+			other.DestroyThread();
+			tu.DestroyThread();
+		}
+
+		TEST_METHOD(TestBatchedDispatchAndFusion)
+		{
+			using namespace std::chrono_literals;
+			static constexpr std::size_t TaskCount{ 10 };
+			// the tasks record their order, which must not change when checks are batched or tasks are fused
+			auto runOrder = std::make_shared<std::vector<std::size_t>>();
+			imp::ThreadTaskSource tts{};
+			for (std::size_t i = 0; i < TaskCount; i++)
+				tts.PushInfiniteTaskBack([runOrder](const std::size_t taskNumber) { runOrder->emplace_back(taskNumber); }, i);
+			imp::DispatchOptions options{};
+			options.CheckEveryTasks = 4;
+			options.IsTaskFusionEnabled = true;
+			options.SmallTaskThreshold = 1s;
+			imp::ThreadUnitPlusPlus tu{ tts, options };
+			Assert::AreEqual(std::size_t{ 4 }, tu.GetDispatchOptions().CheckEveryTasks);
+			std::this_thread::sleep_for(20ms);
+			tu.SetPauseValueOrdered(true);
+			tu.WaitForPauseCompleted();
+			Assert::IsTrue(tu.GetPauseCompletionStatus(), L"Paused reported as uncompleted incorrectly.");
+			// ordered pause, so only whole iterations have run
+			Assert::IsTrue(runOrder->size() >= TaskCount * 2, L"Fused task list did not run.");
+			Assert::AreEqual(std::size_t{ 0 }, runOrder->size() % TaskCount, L"Ordered pause completed mid-iteration.");
+			for (std::size_t i = 0; i < runOrder->size(); i++)
+				Assert::AreEqual(i % TaskCount, (*runOrder)[i], L"Tasks ran out of order.");
+			// an unordered pause is observed within a chunk of CheckEveryTasks tasks
+			tu.SetPauseValueOrdered(false);
+			tu.SetPauseValueUnordered(true);
+			tu.WaitForPauseCompleted();
+			Assert::IsTrue(tu.GetPauseCompletionStatus(), L"Paused reported as uncompleted incorrectly.");
+			tu.DestroyThread();
+		}
+
+		TEST_METHOD(TestPrefetchedTasks)
+		{
+			using namespace std::chrono_literals;
+			// each task's prefetch function runs just before the task ahead of it, so the counts track each other
+			auto prefetchCount = std::make_shared<std::atomic<std::size_t>>();
+			auto taskCount = std::make_shared<std::atomic<std::size_t>>();
+			const std::vector<int> taskData(1024, 1);
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack([taskCount]() { (*taskCount)++; });
+			tts.PushPrefetchedTaskBack([prefetchCount, &taskData]()
+				{
+					imp::PrefetchRange{ taskData.data(), taskData.size() * sizeof(int) }();
+					(*prefetchCount)++;
+				}, [taskCount]() { (*taskCount)++; });
+			Assert::IsNotNull(imp::GetTaskPrefetch(tts.TaskList.back()), L"Prefetch function not found on the task.");
+			Assert::IsNull(imp::GetTaskPrefetch(tts.TaskList.front()), L"Prefetch function found on a plain task.");
+			imp::ThreadUnitPlusPlus tu{ tts };
+			std::this_thread::sleep_for(20ms);
+			tu.SetPauseValueOrdered(true);
+			tu.WaitForPauseCompleted();
+			Assert::IsTrue(prefetchCount->load() > 0, L"Prefetch function did not run.");
+			Assert::AreEqual(taskCount->load() / 2, prefetchCount->load(), L"Prefetch function not issued once per iteration.");
+			tu.DestroyThread();
+		}
+
+		TEST_METHOD(TestIterationEndTasks)
+		{
+			using namespace std::chrono_literals;
+			static constexpr std::size_t TaskCount{ 5 };
+			// the iteration end task runs once after every pass over the task list
+			auto tasksRun = std::make_shared<std::atomic<std::size_t>>();
+			auto endTasksRun = std::make_shared<std::atomic<std::size_t>>();
+			auto isEndedMidIteration = std::make_shared<std::atomic<bool>>();
+			imp::ThreadTaskSource tts{};
+			for (std::size_t i = 0; i < TaskCount; i++)
+				tts.PushInfiniteTaskBack([tasksRun]() { (*tasksRun)++; });
+			tts.PushIterationEndTaskBack([tasksRun, endTasksRun, isEndedMidIteration]()
+				{
+					if (tasksRun->load() % TaskCount != 0)
+						*isEndedMidIteration = true;
+					(*endTasksRun)++;
+				});
+			imp::ThreadUnitPlusPlus tu{ tts };
+			Assert::AreEqual(TaskCount + 1, tu.GetNumberOfTasks());
+			std::this_thread::sleep_for(20ms);
+			tu.SetPauseValueOrdered(true);
+			tu.WaitForPauseCompleted();
+			Assert::IsTrue(endTasksRun->load() > 0, L"Iteration end task did not run.");
+			Assert::IsFalse(isEndedMidIteration->load(), L"Iteration end task ran mid-iteration.");
+			Assert::AreEqual(tasksRun->load() / TaskCount, endTasksRun->load(), L"Iteration end task not run once per iteration.");
+			// a stop during an unordered pause still ends the iteration, running the iteration end task
+			tu.SetPauseValueOrdered(false);
+			tu.SetPauseValueUnordered(true);
+			tu.WaitForPauseCompleted();
+			const auto endTasksBeforeStop = endTasksRun->load();
+			tu.DestroyThread();
+			Assert::AreEqual(endTasksBeforeStop + 1, endTasksRun->load(), L"Iteration end task not run on stop.");
+		}
+
+		TEST_METHOD(TestRangeTasks)
+		{
+			using namespace std::chrono_literals;
+			static_assert(imp::IsFnRange<std::vector<std::function<void()>>>);
+			static_assert(!imp::IsFnRange<std::vector<int>>);
+			// the tasks are made from the parameter array as they run, none are stored
+			const std::vector<std::size_t> taskParams{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+			auto paramSum = std::make_shared<std::atomic<std::size_t>>();
+			imp::ThreadTaskSource tts{};
+			tts.PushRangeTasksBack(taskParams | std::views::transform([paramSum](const std::size_t param)
+				{
+					return [paramSum, param]() { (*paramSum) += param; };
+				}));
+			Assert::AreEqual(std::size_t{ 0 }, tts.TaskList.size());
+			imp::DispatchOptions options{};
+			options.CheckEveryTasks = 4;
+			imp::ThreadUnitPlusPlus tu{ tts, options };
+			Assert::AreEqual(taskParams.size(), tu.GetNumberOfTasks());
+			std::this_thread::sleep_for(20ms);
+			tu.SetPauseValueOrdered(true);
+			tu.WaitForPauseCompleted();
+			// ordered pause, so only whole passes over the range have run
+			Assert::IsTrue(paramSum->load() > 0, L"Range tasks did not run.");
+			Assert::AreEqual(std::size_t{ 0 }, paramSum->load() % 55, L"Ordered pause completed mid-range.");
+			tu.DestroyThread();
+		}
+
+		TEST_METHOD(TestBlockingTaskRouting)
+		{
+			using namespace std::chrono_literals;
+			auto blockingRuns = std::make_shared<std::atomic<std::size_t>>();
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack([]() {});
+			for (std::size_t i = 0; i < 5; i++)
+				tts.PushBlockingTaskBack([blockingRuns]() { std::this_thread::sleep_for(1ms); (*blockingRuns)++; });
+			Assert::IsTrue(imp::IsBlockingTask(tts.TaskList.back()));
+			imp::BlockingUnitGroup group{ 2, 8 };
+			const auto cpuTasks = group.RouteBlockingTasks(tts);
+			// only the CPU-bound task is left, the blocking tasks are spread two per unit
+			Assert::AreEqual(std::size_t{ 1 }, cpuTasks.TaskList.size());
+			Assert::AreEqual(std::size_t{ 3 }, group.GetUnitCount());
+			Assert::AreEqual(std::size_t{ 5 }, group.GetNumberOfTasks());
+			for (int i = 0; i < 200 && blockingRuns->load() < 5; i++)
+				std::this_thread::sleep_for(10ms);
+			Assert::IsTrue(blockingRuns->load() >= 5, L"Blocking tasks did not run on the group.");
+			group.SetPauseValueOrdered(true);
+			group.WaitForPauseCompleted();
+			group.Clear();
+			Assert::AreEqual(std::size_t{ 0 }, group.GetUnitCount());
+		}
+
+		TEST_METHOD(TestBlockingGroupShrink)
+		{
+			using namespace std::chrono_literals;
+			auto blockingRuns = std::make_shared<std::vector<std::atomic<std::size_t>>>(6);
+			std::vector<imp::BlockingUnitGroup::TaskInfo> blockingTasks;
+			for (std::size_t i = 0; i < blockingRuns->size(); i++)
+				blockingTasks.emplace_back([blockingRuns, i]() { std::this_thread::sleep_for(1ms); (*blockingRuns)[i]++; });
+			imp::BlockingUnitGroup group{ 2, 8, imp::BlockingUnitGroup::MakeDefaultUnitOptions(), 2 };
+			group.AddBlockingTasks(blockingTasks);
+			Assert::AreEqual(std::size_t{ 3 }, group.GetUnitCount());
+			// nothing to retire
+			group.Shrink();
+			Assert::AreEqual(std::size_t{ 3 }, group.GetUnitCount());
+			// removing three tasks leaves two units' worth, the last unit's tasks move onto the others
+			int removeCount = 0;
+			Assert::AreEqual(std::size_t{ 3 }, group.RemoveBlockingTasks([&removeCount](const auto&) { return removeCount++ % 2 == 0; }));
+			Assert::AreEqual(std::size_t{ 2 }, group.GetUnitCount());
+			Assert::AreEqual(std::size_t{ 3 }, group.GetNumberOfTasks());
+			// the remaining tasks keep running
+			std::vector<std::size_t> runsBefore;
+			for (const auto& runs : *blockingRuns)
+				runsBefore.emplace_back(runs.load());
+			std::this_thread::sleep_for(50ms);
+			std::size_t runningTasks = 0;
+			for (std::size_t i = 0; i < runsBefore.size(); i++)
+				runningTasks += (*blockingRuns)[i].load() > runsBefore[i] ? 1 : 0;
+			Assert::AreEqual(std::size_t{ 3 }, runningTasks);
+			// the group does not shrink below its floor
+			Assert::AreEqual(std::size_t{ 3 }, group.RemoveBlockingTasks([](const auto&) { return true; }));
+			Assert::AreEqual(std::size_t{ 2 }, group.GetUnitCount());
+			Assert::AreEqual(std::size_t{ 0 }, group.GetNumberOfTasks());
+		}
+
+		TEST_METHOD(TestUnitThrottle)
+		{
+			using namespace std::chrono_literals;
+			using Level = imp::UnitThrottle::Level;
+			auto runs = std::make_shared<std::atomic<std::size_t>>();
+			auto throttle = std::make_shared<imp::UnitThrottle>(20ms);
+			imp::DispatchOptions options{};
+			options.Throttle = throttle;
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack([runs]() { (*runs)++; });
+			imp::ThreadUnitPlusPlus tup{ tts, options };
+			throttle->SetLevel(Level::Pause);
+			std::this_thread::sleep_for(50ms);
+			const auto pausedRuns = runs->load();
+			std::this_thread::sleep_for(100ms);
+			Assert::AreEqual(pausedRuns, runs->load());
+			// a pause request is still observed while throttled
+			tup.SetPauseValueOrdered(true);
+			tup.WaitForPauseCompleted();
+			tup.SetPauseValueOrdered(false);
+			throttle->SetLevel(Level::None);
+			for (int i = 0; i < 200 && runs->load() <= pausedRuns; i++)
+				std::this_thread::sleep_for(5ms);
+			Assert::IsTrue(runs->load() > pausedRuns, L"Unit did not resume when the throttle was lifted.");
+			// a one-shot task run by the throttled unit can lift the throttle, while another unit waits on it
+			throttle->SetLevel(Level::Pause);
+			imp::ThreadUnitPlusPlus otherTup{ tts, options };
+			std::this_thread::sleep_for(50ms);
+			const auto throttledRuns = runs->load();
+			std::promise<void> liftedPromise;
+			auto lifted = liftedPromise.get_future();
+			Assert::IsTrue(tup.PostOneShotTask([&]() { throttle->SetLevel(Level::None); liftedPromise.set_value(); }));
+			Assert::IsTrue(lifted.wait_for(5s) == std::future_status::ready, L"One-shot task deadlocked on the throttle.");
+			for (int i = 0; i < 200 && runs->load() <= throttledRuns; i++)
+				std::this_thread::sleep_for(5ms);
+			Assert::IsTrue(runs->load() > throttledRuns, L"Units did not resume when the throttle was lifted.");
+			otherTup.DestroyThread();
+			// a stop request ends the wait at once
+			throttle->SetLevel(Level::Pause);
+			tup.DestroyThread();
+		}
+
+		TEST_METHOD(TestStateEvents)
+		{
+			using namespace std::chrono_literals;
+			using Event = imp::UnitStateEvent;
+			auto stateEvents = std::make_shared<imp::UnitStateEvents>();
+			imp::DispatchOptions options{};
+			options.StateEvents = stateEvents;
+			const auto WaitForEvent = [&stateEvents](const Event stateEvent)
+			{
+				for (int i = 0; i < 200; i++)
+				{
+					if (imp::UnitStateEvents::HasEvent(stateEvents->TakeEvents(), stateEvent))
+						return true;
+					std::this_thread::sleep_for(5ms);
+				}
+				return false;
+			};
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack([]() { std::this_thread::sleep_for(1ms); });
+			imp::ThreadUnitPlusPlus tup{ tts, options };
+			Assert::IsTrue(WaitForEvent(Event::IterationCompleted));
+			tup.SetPauseValueOrdered(true);
+			Assert::IsTrue(WaitForEvent(Event::PauseCompleted));
+			tup.SetPauseValueOrdered(false);
+			Assert::IsTrue(WaitForEvent(Event::Resumed));
+			tup.DestroyThread();
+			Assert::IsTrue(imp::UnitStateEvents::HasEvent(stateEvents->TakeEvents(), Event::Stopped));
+			Assert::AreEqual(std::uint32_t{ 0 }, stateEvents->TakeEvents());
+		}
+
+		TEST_METHOD(TestTaskListReclaimer)
+		{
+			// records the thread that destroys the last copy of a task's state
+			struct DestroyRecorder
+			{
+				std::shared_ptr<std::vector<std::thread::id>> DestroyThreads;
+				~DestroyRecorder() { DestroyThreads->emplace_back(std::this_thread::get_id()); }
+			};
+			auto destroyThreads = std::make_shared<std::vector<std::thread::id>>();
+			auto reclaimer = std::make_shared<imp::TaskListReclaimer>();
+			imp::DispatchOptions options{};
+			options.Reclaimer = reclaimer;
+			imp::ThreadUnitPlusPlus tup{ {}, options };
+			{
+				imp::ThreadTaskSource tts{};
+				auto recorder = std::shared_ptr<DestroyRecorder>(new DestroyRecorder{ destroyThreads });
+				tts.PushInfiniteTaskBack([recorder]() {});
+				tup.SetTaskSource(tts);
+			}
+			tup.SetTaskSource({});
+			tup.DestroyThread();
+			reclaimer->WaitForReclaimed();
+			Assert::AreEqual(std::uint64_t{ 0 }, reclaimer->GetPendingCount());
+			// the task state is destroyed once, off the calling thread
+			Assert::AreEqual(std::size_t{ 1 }, destroyThreads->size());
+			Assert::IsTrue(destroyThreads->front() != std::this_thread::get_id(), L"Task list was destroyed on the controller.");
+		}
+
+		TEST_METHOD(TestConcurrentTaskListBuilder)
+		{
+			static constexpr std::size_t SegmentCount{ 16 };
+			// uneven segments, so the segments' places in the merged list differ from a fixed stride
+			const auto GetSegmentStart = [](const std::size_t segment) { return segment * 500 + (segment * segment - segment) / 2 * 100; };
+			// merged on the calling thread (below the default per-thread tasks), and by four threads with a low per-thread
+			// count, so the parallel resize-and-move merge runs on any machine, even with a single CPU
+			for (const auto& [maxMergeThreads, mergeTasksPerThread, expectedMergeThreads] : { std::tuple<std::size_t, std::size_t, std::size_t>{ 0, imp::ConcurrentTaskListBuilder::ParallelMergeTasksPerThread, 1 }, { 4, 100, 4 } })
+			{
+				auto runOrder = std::make_shared<std::vector<std::size_t>>();
+				imp::ConcurrentTaskListBuilder builder{ maxMergeThreads, mergeTasksPerThread };
+				{
+					// segments are added from several threads, in no particular order
+					std::atomic<std::size_t> nextSegment{};
+					std::vector<std::jthread> builders;
+					for (int i = 0; i < 4; i++)
+					{
+						builders.emplace_back([&]()
+							{
+								for (std::size_t segment = nextSegment++; segment < SegmentCount; segment = nextSegment++)
+								{
+									auto& segmentTasks = builder.AddSegment(segment);
+									for (std::size_t task = GetSegmentStart(segment); task < GetSegmentStart(segment + 1); task++)
+										segmentTasks.PushInfiniteTaskBack([runOrder](const std::size_t taskNumber) { runOrder->emplace_back(taskNumber); }, task);
+									segmentTasks.PushIterationEndTaskBack([]() {});
+								}
+							});
+					}
+				}
+				const auto tts = builder.Build();
+				Assert::AreEqual(expectedMergeThreads, builder.GetLastMergeThreads());
+				Assert::AreEqual(std::size_t{ 0 }, builder.GetSegmentCount());
+				Assert::AreEqual(GetSegmentStart(SegmentCount), tts.TaskList.size());
+				Assert::AreEqual(SegmentCount, tts.IterationEndTaskList.size());
+				// an ordered build concatenates the segments by key
+				for (const auto& task : tts.TaskList)
+					task();
+				Assert::AreEqual(tts.TaskList.size(), runOrder->size());
+				for (std::size_t i = 0; i < runOrder->size(); i++)
+					Assert::AreEqual(i, (*runOrder)[i], L"Tasks built out of order.");
+			}
+		}
+
+		TEST_METHOD(TestTaskCheckpoint)
+		{
+			const auto checkpointPath = (std::filesystem::temp_directory_path() / "imp_task_checkpoint_test.bin").string();
+			std::filesystem::remove(checkpointPath);
+			// a task building up state, with hooks sharing it
+			const auto MakeTasks = [](const std::shared_ptr<std::atomic<std::uint64_t>>& runCount)
+			{
+				imp::ThreadTaskSource tts{};
+				tts.PushCheckpointedTaskBack("counter",
+					[runCount]() { return std::to_string(runCount->load()); },
+					[runCount](const std::string_view savedState) { runCount->store(std::stoull(std::string{ savedState })); },
+					[runCount]() { (*runCount)++; });
+				return tts;
+			};
+			imp::DispatchOptions options{};
+			options.CheckpointPath = checkpointPath;
+			auto runCount = std::make_shared<std::atomic<std::uint64_t>>();
+			imp::ThreadUnitPlusPlus tup{ MakeTasks(runCount), options };
+			while (runCount->load() < 100)
+				std::this_thread::yield();
+			tup.SetPauseValueOrdered(true);
+			tup.WaitForPauseCompleted();
+			// the checkpoint is written before the pause completes
+			Assert::IsTrue(std::filesystem::exists(checkpointPath));
+			const auto pausedCount = runCount->load();
+			tup.DestroyThread();
+			// a new unit restores the saved state before it runs
+			auto restoredCount = std::make_shared<std::atomic<std::uint64_t>>();
+			{
+				imp::ThreadUnitPlusPlus restoredUnit{ MakeTasks(restoredCount), options };
+				restoredUnit.SetPauseValueOrdered(true);
+				restoredUnit.WaitForPauseCompleted();
+			}
+			Assert::IsTrue(restoredCount->load() >= pausedCount, L"Task state was not restored.");
+			Assert::AreEqual(std::size_t{ 1 }, imp::RestoreTaskCheckpoint(checkpointPath, MakeTasks(restoredCount)));
+			Assert::IsFalse(std::filesystem::exists(checkpointPath + ".tmp"));
+			// a unit given a checkpoint path later restores from it before restarting
+			auto laterCount = std::make_shared<std::atomic<std::uint64_t>>();
+			imp::ThreadUnitPlusPlus laterUnit{ MakeTasks(laterCount) };
+			laterUnit.SetPauseValueOrdered(true);
+			laterUnit.WaitForPauseCompleted();
+			const auto checkpointedCount = restoredCount->load();
+			Assert::IsTrue(laterCount->load() < checkpointedCount);
+			laterUnit.SetDispatchOptions(options);
+			Assert::IsTrue(laterCount->load() >= checkpointedCount, L"Task state was not restored for the new checkpoint path.");
+			laterUnit.DestroyThread();
+			std::filesystem::remove(checkpointPath);
+		}
+
+		TEST_METHOD(TestBroadcast)
+		{
+			using namespace std::chrono_literals;
+			// a thread-local counter each unit's tasks increment, read by the broadcast on each work thread
+			static thread_local std::size_t localRuns{};
+			auto sampledRuns = std::make_shared<std::atomic<std::size_t>>();
+			auto sampledThreads = std::make_shared<std::vector<std::thread::id>>();
+			auto sampleMutex = std::make_shared<std::mutex>();
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack([]() { localRuns++; std::this_thread::sleep_for(1ms); });
+			std::vector<imp::ThreadUnitPlusPlus> units;
+			for (int i = 0; i < 3; i++)
+				units.emplace_back(tts);
+			// a unit with only signalled tasks is parked, the broadcast wakes it
+			imp::ThreadTaskSource signalledTts{};
+			signalledTts.PushSignalledTaskBack(imp::TaskSignal{}, []() {});
+			units.emplace_back(signalledTts);
+			std::this_thread::sleep_for(20ms);
+			auto broadcastDone = imp::BroadcastToUnits(units, [=]()
+				{
+					(*sampledRuns) += localRuns;
+					std::lock_guard sampleLock{ *sampleMutex };
+					sampledThreads->emplace_back(std::this_thread::get_id());
+				});
+			Assert::IsTrue(broadcastDone.wait_for(5s) == std::future_status::ready, L"Broadcast did not complete.");
+			broadcastDone.get();
+			Assert::AreEqual(units.size(), sampledThreads->size());
+			Assert::IsTrue(sampledRuns->load() > 0, L"Broadcast did not run on the work threads.");
+			for (const auto threadId : *sampledThreads)
+				Assert::IsTrue(threadId != std::this_thread::get_id());
+			// an exception is passed to the future, a unit without a work thread is skipped
+			units.front().DestroyThread();
+			Assert::IsFalse(units.front().PostOneShotTask([]() {}));
+			auto failedBroadcast = imp::BroadcastToUnits(units, []() { throw std::runtime_error("broadcast"); });
+			Assert::ExpectException<std::runtime_error>([&failedBroadcast]() { failedBroadcast.get(); });
+		}
+
+		TEST_METHOD(TestTaskHandles)
+		{
+			imp::ThreadTaskSource tts{};
+			const auto firstHandle = tts.PushNamedTaskBack("first", []() {});
+			tts.PushPrefetchedTaskBack([]() {}, []() {});
+			const auto prefetchedHandle = imp::ThreadTaskSource::IdentifyTask(tts.TaskList.back(), "prefetched");
+			// the handles stay with their tasks as tasks are pushed in front and the source is copied
+			tts.PushInfiniteTaskFront([]() {});
+			const auto frontHandle = tts.PushNamedTaskFront("front", []() {});
+			const imp::ThreadTaskSource copiedTts = tts;
+			auto editedTts = copiedTts;
+			Assert::IsTrue(firstHandle != prefetchedHandle && firstHandle != frontHandle && static_cast<bool>(firstHandle));
+			Assert::IsTrue(editedTts.FindTaskHandle("prefetched") == prefetchedHandle);
+			Assert::IsTrue(editedTts.FindTask(firstHandle) == &editedTts.TaskList[2]);
+			Assert::AreEqual(std::string{ "front" }, imp::GetTaskIdentity(*editedTts.FindTask(frontHandle))->Name);
+			// markers are still found through the identity
+			Assert::IsNotNull(imp::GetTaskPrefetch(*editedTts.FindTask(prefetchedHandle)));
+			// targeted removal and replacement, in place
+			int replacedRuns = 0;
+			Assert::IsTrue(editedTts.ReplaceTask(firstHandle, [&replacedRuns](const int runs) { replacedRuns += runs; }, 2));
+			Assert::IsTrue(editedTts.RemoveTask(frontHandle));
+			Assert::IsFalse(editedTts.RemoveTask(frontHandle));
+			Assert::AreEqual(std::size_t{ 3 }, editedTts.TaskList.size());
+			Assert::IsNull(editedTts.FindTask(frontHandle));
+			(*editedTts.FindTask(firstHandle))();
+			Assert::AreEqual(2, replacedRuns);
+			Assert::AreEqual(std::string{ "first" }, imp::GetTaskIdentity(*editedTts.FindTask(firstHandle))->Name);
+			Assert::AreEqual(std::size_t{ 4 }, copiedTts.TaskList.size());
+			// a marked task keeps its marker around the replaced function
+			int prefetches = 0;
+			imp::ThreadTaskSource markedTts{};
+			markedTts.PushPrefetchedTaskBack([&prefetches]() { prefetches++; }, []() {});
+			const auto markedPrefetchHandle = imp::ThreadTaskSource::IdentifyTask(markedTts.TaskList.back());
+			markedTts.PushBlockingTaskBack([]() {});
+			const auto markedBlockingHandle = imp::ThreadTaskSource::IdentifyTask(markedTts.TaskList.back());
+			markedTts.PushCheckpointedTaskBack("marked", []() { return std::string{ "saved" }; }, [](std::string_view) {}, []() {});
+			const auto markedCheckpointHandle = imp::ThreadTaskSource::IdentifyTask(markedTts.TaskList.back());
+			Assert::IsTrue(markedTts.ReplaceTask(markedPrefetchHandle, [&replacedRuns]() { replacedRuns++; }));
+			Assert::IsTrue(markedTts.ReplaceTask(markedBlockingHandle, [&replacedRuns]() { replacedRuns++; }));
+			Assert::IsTrue(markedTts.ReplaceTask(markedCheckpointHandle, [&replacedRuns]() { replacedRuns++; }));
+			const auto* replacedPrefetch = imp::GetTaskPrefetch(*markedTts.FindTask(markedPrefetchHandle));
+			Assert::IsNotNull(replacedPrefetch);
+			(*replacedPrefetch)();
+			Assert::AreEqual(1, prefetches);
+			Assert::IsTrue(imp::IsBlockingTask(*markedTts.FindTask(markedBlockingHandle)));
+			Assert::AreEqual(std::string{ "saved" }, imp::GetTaskCheckpoint(*markedTts.FindTask(markedCheckpointHandle))->Save());
+			for (const auto& task : markedTts.TaskList)
+				task();
+			Assert::AreEqual(5, replacedRuns);
+			// a marker of another kind is rejected, one of the same kind replaces the marker
+			Assert::IsFalse(markedTts.ReplaceTask(markedBlockingHandle, imp::PrefetchingTask{ []() {}, []() {} }));
+			Assert::IsFalse(editedTts.ReplaceTask(firstHandle, imp::BlockingTask{ []() {} }));
+			Assert::IsTrue(imp::IsBlockingTask(*markedTts.FindTask(markedBlockingHandle)));
+			Assert::IsTrue(markedTts.ReplaceTask(markedPrefetchHandle, imp::PrefetchingTask{ []() {}, [&prefetches]() { prefetches += 10; } }));
+			(*imp::GetTaskPrefetch(*markedTts.FindTask(markedPrefetchHandle)))();
+			Assert::AreEqual(11, prefetches);
+			// per-task statistics keyed by handle
+			std::unordered_map<imp::TaskHandle, int> taskRuns{ { firstHandle, 1 } };
+			Assert::AreEqual(1, taskRuns[firstHandle]);
+		}
+
+		TEST_METHOD(TestSlabBufferPool)
+		{
+			using namespace std::chrono_literals;
+			imp::SlabBufferPool pool{ 1000, 2, 64, 8 };
+			Assert::AreEqual(std::size_t{ 1024 }, pool.GetBufferSize());
+			// a producer unit hands buffers to a consumer unit through a queue, the consumer releases them to its cache
+			struct Handoff
+			{
+				std::mutex QueueMutex;
+				std::deque<imp::PooledBuffer> Queue;
+				std::atomic<std::size_t> Consumed{};
+				std::atomic<bool> IsCorrupt{};
+			};
+			auto handoff = std::make_shared<Handoff>();
+			auto& producerCache = pool.GetUnitCache(0);
+			auto& consumerCache = pool.GetUnitCache(1);
+			imp::ThreadTaskSource producerTasks{};
+			producerTasks.PushInfiniteTaskBack([handoff, &producerCache]()
+				{
+					std::lock_guard queueLock{ handoff->QueueMutex };
+					if (handoff->Queue.size() >= 16)
+						return;
+					auto buffer = producerCache.Acquire();
+					const auto marker = static_cast<std::byte>(handoff->Queue.size());
+					std::fill_n(buffer.GetData(), 100, marker);
+					buffer.SetSize(100);
+					handoff->Queue.emplace_back(std::move(buffer));
+				});
+			imp::ThreadTaskSource consumerTasks{};
+			consumerTasks.PushInfiniteTaskBack([handoff, &consumerCache]()
+				{
+					imp::PooledBuffer buffer{};
+					{
+						std::lock_guard queueLock{ handoff->QueueMutex };
+						if (handoff->Queue.empty())
+							return;
+						buffer = std::move(handoff->Queue.front());
+						handoff->Queue.pop_front();
+					}
+					const auto data = buffer.GetSpan();
+					if (data.size() != 100 || buffer.GetHomeUnit() != 0 || std::ranges::count(data, data.front()) != 100)
+						handoff->IsCorrupt = true;
+					consumerCache.Release(std::move(buffer));
+					handoff->Consumed++;
+				});
+			consumerTasks.PushIterationEndTaskBack([&consumerCache]() { consumerCache.FlushReturns(); });
+			{
+				imp::ThreadUnitPlusPlus producer{ producerTasks };
+				imp::ThreadUnitPlusPlus consumer{ consumerTasks };
+				while (handoff->Consumed.load() < 2000)
+					std::this_thread::sleep_for(1ms);
+			}
+			Assert::IsFalse(handoff->IsCorrupt.load(), L"Buffer data was not handed over intact.");
+			// the buffers are recycled through batched returns, instead of more slabs being allocated
+			Assert::IsTrue(pool.GetSlabCount() <= 2, L"Released buffers were not reused.");
+			Assert::IsTrue(producerCache.GetReturnBatchCount() > 0);
+			Assert::IsTrue(producerCache.GetReturnBatchCount() < handoff->Consumed.load());
+			handoff->Queue.clear();
+		}
+
+		TEST_METHOD(TestSamplingProfiler)
+		{
+			using namespace std::chrono_literals;
+			auto profiler = std::make_shared<imp::SamplingProfiler>(1000us);
+			// spins a fixed amount of work, not wall time, as the samples are taken on thread CPU time and a spin
+			// preempted part way through would use less CPU time than its length
+			const auto Spin = [](const std::size_t spinCount)
+			{
+				volatile std::size_t spinCounter{};
+				for (std::size_t i{}; i < spinCount; ++i)
+					spinCounter = spinCounter + 1;
+			};
+			// a cold task and a hot task, the hot one spins nine times as long
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack(Spin, std::size_t{ 100'000 });
+			tts.PushNamedTaskBack("hot", Spin, std::size_t{ 900'000 });
+			imp::DispatchOptions options{};
+			options.Profiler = profiler;
+			options.UnitName = "profiled";
+			{
+				imp::ThreadUnitPlusPlus tup{ tts, options };
+				std::this_thread::sleep_for(500ms);
+			}
+			if (!imp::SamplingProfiler::IsSupported())
+			{
+				Assert::AreEqual(std::uint64_t{ 0 }, profiler->GetSampleCount());
+				return;
+			}
+			Assert::IsTrue(profiler->GetSampleCount() > 50, L"Too few samples taken.");
+			// the samples are attributed to the task running, rooted at the unit
+			std::istringstream folded{ [&profiler]() { std::ostringstream out; profiler->WriteFoldedStacks(out); return out.str(); }() };
+			std::uint64_t hotSamples{}, coldSamples{};
+			for (std::string line; std::getline(folded, line); )
+			{
+				Assert::IsTrue(line.starts_with("profiled;"));
+				const auto sampleCount = std::stoull(line.substr(line.rfind(' ') + 1));
+				if (line.starts_with("profiled;TaskList[1] hot;"))
+					hotSamples += sampleCount;
+				else if (line.starts_with("profiled;TaskList[0];"))
+					coldSamples += sampleCount;
+			}
+			Assert::IsTrue(hotSamples > coldSamples * 3, L"Samples were not attributed to the hot task.");
+			Assert::AreEqual(std::size_t{ 1 }, profiler->GetUnitNames().size());
+			// the profiles of stopped threads are released once collected, restarts do not accumulate them
+			const auto droppedCount = profiler->GetDroppedCount();
+			Assert::AreEqual(std::size_t{ 0 }, profiler->GetProfiledThreadCount());
+			imp::ThreadUnitPlusPlus restartedTup{ tts, options };
+			for (int i = 0; i < 20; i++)
+				restartedTup.SetDispatchOptions(options);
+			restartedTup.SetPauseValueOrdered(true);
+			restartedTup.WaitForPauseCompleted();
+			Assert::AreEqual(std::size_t{ 1 }, profiler->GetProfiledThreadCount());
+			restartedTup.DestroyThread();
+			Assert::AreEqual(std::size_t{ 0 }, profiler->GetProfiledThreadCount());
+			Assert::IsTrue(profiler->GetDroppedCount() >= droppedCount);
+		}
 	};
 }
@@ -0,0 +1,117 @@
+#pragma once
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../immutable_thread_pool/TimerCoalescing.h"
+#include "../immutable_thread_pool/ThreadUnitPlusPlus.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace threadpooltests
+{
+	TEST_CLASS(timercoalescingtests)
+	{
+	public:
+		// Time source that only moves when slept on, or set.
+		class ManualTimeSource final : public imp::TimeSource
+		{
+		public:
+			TimePoint_t CurrentTime{};
+			[[nodiscard]] TimePoint_t Now() const override { return CurrentTime; }
+			void SleepFor(const Duration_t sleepTime) override { CurrentTime += sleepTime; }
+		};
+
+		TEST_METHOD(TestAlignWakeup)
+		{
+			using namespace std::chrono_literals;
+			using TimePoint_t = imp::TimeSource::TimePoint_t;
+			const TimePoint_t onTick{ 30ms };
+			// zero or negative alignment leaves the deadline as it is
+			Assert::IsTrue(imp::AlignWakeup(onTick + 1ns, 0ns) == onTick + 1ns);
+			Assert::IsTrue(imp::AlignWakeup(onTick + 1ns, -10ms) == onTick + 1ns);
+			// a deadline on a tick stays, any later one rounds up to the next tick
+			Assert::IsTrue(imp::AlignWakeup(onTick, 10ms) == onTick);
+			Assert::IsTrue(imp::AlignWakeup(onTick + 1ns, 10ms) == onTick + 10ms);
+			Assert::IsTrue(imp::AlignWakeup(onTick + 9999us, 10ms) == onTick + 10ms);
+			Assert::IsTrue(imp::AlignWakeup(TimePoint_t{}, 10ms) == TimePoint_t{});
+			// nearby deadlines coalesce onto one tick, never earlier, and late by less than one period
+			for (auto deadline = onTick + 1us; deadline < onTick + 10ms; deadline += 997us)
+			{
+				const auto alignedDeadline = imp::AlignWakeup(deadline, 10ms);
+				Assert::IsTrue(alignedDeadline == onTick + 10ms);
+				Assert::IsTrue(alignedDeadline >= deadline && alignedDeadline - deadline < 10ms);
+			}
+			// ticks are multiples since the epoch, so the same period aligns the same in every thread
+			Assert::AreEqual(0ll, static_cast<long long>(imp::AlignWakeup(TimePoint_t{ 123456789ns }, 7ms).time_since_epoch() % 7ms / 1ns));
+		}
+
+		TEST_METHOD(TestCoalescingTimeSource)
+		{
+			using namespace std::chrono_literals;
+			imp::CoalescingTimeSource coalescingSource{ 20ms };
+			Assert::IsTrue(coalescingSource.GetAlignment() == 20ms);
+			for (int i = 0; i < 3; i++)
+			{
+				const auto sleepStart = coalescingSource.Now();
+				coalescingSource.SleepFor(1ms);
+				const auto sleepEnd = coalescingSource.Now();
+				// woken on (or just after) the tick following the requested time
+				Assert::IsTrue(sleepEnd >= imp::AlignWakeup(sleepStart + 1ms, 20ms));
+				Assert::IsTrue(sleepEnd - sleepStart >= 1ms);
+			}
+			// injected for the thread, then restored
+			ManualTimeSource manualSource{};
+			manualSource.CurrentTime = imp::TimeSource::TimePoint_t{ 5s };
+			{
+				imp::ScopedTimeSource scopedManual{ manualSource };
+				Assert::IsTrue(&imp::UnitTime::Current() == &manualSource);
+				imp::UnitTime::SleepFor(250ms);
+				Assert::IsTrue(imp::UnitTime::Now() == imp::TimeSource::TimePoint_t{ 5250ms });
+				// outside a work thread, the iteration time is the current time
+				Assert::IsTrue(imp::UnitTime::IterationNow() == imp::TimeSource::TimePoint_t{ 5250ms });
+				{
+					imp::ScopedTimeSource scopedCoalescing{ coalescingSource };
+					Assert::IsTrue(&imp::UnitTime::Current() == &coalescingSource);
+				}
+				Assert::IsTrue(&imp::UnitTime::Current() == &manualSource);
+			}
+			Assert::IsTrue(dynamic_cast<imp::SteadyTimeSource*>(&imp::UnitTime::Current()) != nullptr);
+		}
+
+		TEST_METHOD(TestUnitTimerOptions)
+		{
+			using namespace std::chrono_literals;
+			struct ObservedTimers
+			{
+				std::atomic<std::int64_t> AlignmentNs{ -1 };
+				std::atomic<long> TimerSlackNs{ -1 };
+			};
+			auto observed = std::make_shared<ObservedTimers>();
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack([observed]()
+				{
+					if (const auto* coalescingSource = dynamic_cast<const imp::CoalescingTimeSource*>(&imp::UnitTime::Current()); coalescingSource != nullptr)
+						observed->AlignmentNs = coalescingSource->GetAlignment().count();
+#if defined(__linux__)
+					observed->TimerSlackNs = ::prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+#endif
+					imp::UnitTime::SleepFor(1ms);
+				});
+			imp::DispatchOptions options{};
+			options.WakeupAlignment = 5ms;
+			options.TimerSlack = 200us;
+			imp::ThreadUnitPlusPlus tup{ tts, options };
+			std::this_thread::sleep_for(50ms);
+			tup.SetPauseValueOrdered(true);
+			tup.WaitForPauseCompleted();
+			// the unit's tasks sleep through a coalescing source, with the unit's timer slack
+			Assert::AreEqual(std::int64_t{ 5'000'000 }, observed->AlignmentNs.load());
+#if defined(__linux__)
+			Assert::AreEqual(200'000l, observed->TimerSlackNs.load());
+			Assert::IsTrue(imp::SetThreadTimerSlack(100us));
+			Assert::AreEqual(100'000, ::prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0));
+			Assert::IsFalse(imp::SetThreadTimerSlack(0ns));
+			imp::SetThreadTimerSlack(50us);
+#endif
+		}
+	};
+}
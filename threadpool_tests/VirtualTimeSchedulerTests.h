@@ -0,0 +1,149 @@
+#pragma once
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../immutable_thread_pool/ThreadConcepts.h"
+#include "../immutable_thread_pool/VirtualTimeScheduler.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace threadpooltests
+{
+	static_assert(imp::IsThreadUnit<imp::VirtualTimeScheduler::VirtualThreadUnit>);
+
+	TEST_CLASS(virtualtimeschedulertests)
+	{
+	public:
+
+		TEST_METHOD(TestHoursOfSleepingTasks)
+		{
+			using namespace std::chrono_literals;
+			imp::VirtualTimeScheduler scheduler{ 0us };
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack([]() { imp::UnitTime::SleepFor(1s); });
+			auto& unit = scheduler.AddUnit(tts);
+			auto& emptyUnit = scheduler.AddUnit();
+			const auto wallStart = std::chrono::steady_clock::now();
+			scheduler.RunFor(2h);
+			Assert::IsTrue(std::chrono::steady_clock::now() - wallStart < 10s, L"Virtual time did not advance instantly.");
+			Assert::AreEqual(std::uint64_t{ 7200 }, unit.GetTasksRun(), L"Sleeping task ran the wrong number of times.");
+			Assert::IsTrue(emptyUnit.GetLocalTime() >= scheduler.Now(), L"Empty unit did not wait out the period.");
+		}
+
+		TEST_METHOD(TestPauseTiming)
+		{
+			using namespace std::chrono_literals;
+			imp::VirtualTimeScheduler scheduler{ 0us };
+			std::vector<imp::VirtualTimeScheduler::TimePoint_t> runTimes;
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack([&runTimes]() { runTimes.emplace_back(imp::UnitTime::Now()); imp::UnitTime::SleepFor(100ms); });
+			tts.PushInfiniteTaskBack([]() { imp::UnitTime::SleepFor(400ms); });
+			auto& unit = scheduler.AddUnit(tts);
+			scheduler.RunFor(250ms);
+			// the ordered pause completes at the end of the iteration in progress (at 500ms)
+			unit.SetPauseValueOrdered(true);
+			unit.WaitForPauseCompleted();
+			Assert::IsTrue(unit.GetPauseCompletionStatus());
+			Assert::IsTrue(unit.GetLocalTime() == imp::VirtualTimeScheduler::TimePoint_t{ 500ms });
+			scheduler.RunFor(10s);
+			Assert::AreEqual(std::size_t{ 1 }, runTimes.size(), L"Task ran while paused.");
+			// resumes at the scheduler's current time
+			unit.SetPauseValueOrdered(false);
+			scheduler.RunFor(1ms);
+			Assert::AreEqual(std::size_t{ 2 }, runTimes.size());
+			Assert::IsTrue(runTimes.back() == scheduler.Now() - 1ms);
+		}
+
+		TEST_METHOD(TestIterationNow)
+		{
+			using namespace std::chrono_literals;
+			using TimePoint_t = imp::VirtualTimeScheduler::TimePoint_t;
+			imp::VirtualTimeScheduler scheduler{ 0us };
+			std::vector<TimePoint_t> iterationTimes;
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack([]() { imp::UnitTime::SleepFor(300ms); });
+			// the cached time is the start of the iteration, not the time after the first task's sleep
+			tts.PushInfiniteTaskBack([&iterationTimes]() { iterationTimes.emplace_back(imp::UnitTime::IterationNow()); });
+			scheduler.AddUnit(tts);
+			scheduler.RunFor(1250ms);
+			Assert::AreEqual(std::size_t{ 4 }, iterationTimes.size());
+			for (std::size_t i = 0; i < iterationTimes.size(); i++)
+				Assert::IsTrue(iterationTimes[i] == TimePoint_t{ 300ms * i }, L"Iteration time is not the iteration start time.");
+		}
+
+		TEST_METHOD(TestHighPriorityLane)
+		{
+			using namespace std::chrono_literals;
+			using TimePoint_t = imp::VirtualTimeScheduler::TimePoint_t;
+			imp::VirtualTimeScheduler scheduler{ 0us };
+			std::vector<TimePoint_t> highTaskTimes;
+			imp::ThreadTaskSource tts{};
+			for (int i = 0; i < 5; i++)
+				tts.PushInfiniteTaskBack([]() { imp::UnitTime::SleepFor(100ms); });
+			tts.PushHighPriorityTaskBack([&highTaskTimes]() { highTaskTimes.emplace_back(imp::UnitTime::Now()); });
+			scheduler.AddUnit(tts);
+			scheduler.RunFor(1s);
+			// the lane runs between every low priority task, so it waits one task (100ms), not an iteration (500ms)
+			Assert::IsTrue(highTaskTimes.size() >= 10);
+			for (std::size_t i = 1; i < highTaskTimes.size(); i++)
+				Assert::IsTrue(highTaskTimes[i] - highTaskTimes[i - 1] <= 100ms, L"High priority task waited longer than one task.");
+		}
+
+		TEST_METHOD(TestParkedUnitPause)
+		{
+			using namespace std::chrono_literals;
+			imp::VirtualTimeScheduler scheduler{ 0us };
+			imp::TaskSignal signal;
+			std::vector<imp::VirtualTimeScheduler::TimePoint_t> runTimes;
+			imp::ThreadTaskSource tts{};
+			tts.PushSignalledTaskBack(signal, [&runTimes]() { runTimes.emplace_back(imp::UnitTime::Now()); });
+			auto& unit = scheduler.AddUnit(tts);
+			// runs once at the start, then parks until signalled
+			scheduler.RunFor(1s);
+			Assert::AreEqual(std::size_t{ 1 }, runTimes.size());
+			// a pause request wakes the parked unit, which completes the pause at the current time
+			unit.SetPauseValueOrdered(true);
+			unit.WaitForPauseCompleted();
+			Assert::IsTrue(unit.GetPauseCompletionStatus(), L"Parked unit did not complete its ordered pause.");
+			Assert::IsTrue(unit.GetLocalTime() == scheduler.Now());
+			unit.SetPauseValueOrdered(false);
+			scheduler.RunFor(1s);
+			unit.SetPauseValueUnordered(true);
+			unit.WaitForPauseCompleted();
+			Assert::IsTrue(unit.GetPauseCompletionStatus(), L"Parked unit did not complete its unordered pause.");
+			unit.SetPauseValueUnordered(false);
+			Assert::AreEqual(std::size_t{ 1 }, runTimes.size(), L"Task ran without a signal.");
+			// a signal set by the controller runs the task at the current time
+			signal.Set();
+			scheduler.RunFor(1s);
+			Assert::AreEqual(std::size_t{ 2 }, runTimes.size());
+			Assert::IsTrue(runTimes.back() == scheduler.Now() - 1s);
+		}
+
+		TEST_METHOD(TestThrottleAndOneShotTasks)
+		{
+			using namespace std::chrono_literals;
+			using TimePoint_t = imp::VirtualTimeScheduler::TimePoint_t;
+			imp::VirtualTimeScheduler scheduler{ 1ms };
+			const auto throttle = std::make_shared<imp::UnitThrottle>(99ms);
+			throttle->SetLevel(imp::UnitThrottle::Level::Slow);
+			imp::ThreadTaskSource tts{};
+			tts.PushInfiniteTaskBack([]() {});
+			imp::DispatchOptions options{};
+			options.Throttle = throttle;
+			auto& unit = scheduler.AddUnit(tts, options);
+			// each iteration takes the task's 1ms and the throttle's 99ms delay, in virtual time
+			scheduler.RunFor(950ms);
+			Assert::AreEqual(std::uint64_t{ 10 }, unit.GetTasksRun());
+			// a one-shot task posted to the throttled unit runs at the throttle's next poll
+			TimePoint_t oneShotTime{};
+			Assert::IsTrue(unit.PostOneShotTask([&oneShotTime]() { oneShotTime = imp::UnitTime::Now(); }));
+			scheduler.RunFor(20ms);
+			Assert::IsTrue(oneShotTime > TimePoint_t{ 950ms } && oneShotTime <= TimePoint_t{ 950ms } + imp::UnitThrottle::PollSlice, L"One-shot task held up by the throttle.");
+			// lowering the level releases the unit at once, a task every 1ms
+			throttle->SetLevel(imp::UnitThrottle::Level::None);
+			const auto tasksRun = unit.GetTasksRun();
+			scheduler.RunFor(50ms);
+			Assert::IsTrue(unit.GetTasksRun() - tasksRun >= 50);
+		}
+	};
+}
@@ -0,0 +1,111 @@
+#pragma once
+// Minimal stand-in for the Microsoft CppUnitTest framework, so the tests build and run with g++ on Linux
+// (the unix-only tests are not compiled by the MSVC test project). Only the parts the tests use are provided.
+// Built by .github/workflows/linux-tests.yml, see TestRunner.cpp.
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace linuxtestrunner
+{
+	struct TestEntry
+	{
+		std::string Name;
+		std::function<void()> Run;
+	};
+	inline std::vector<TestEntry>& GetTests()
+	{
+		static std::vector<TestEntry> tests;
+		return tests;
+	}
+	struct TestRegistrar
+	{
+		TestRegistrar(const char* className, const char* methodName, void(*runFn)())
+		{
+			GetTests().emplace_back(TestEntry{ std::string{ className } + "::" + methodName, runFn });
+		}
+	};
+	template<typename Class_t, typename Name_t>
+	struct TestClass
+	{
+		using TestClass_t = Class_t;
+		static constexpr const char* TestClassName{ Name_t::Value };
+	};
+	// A failed assertion, with its message (if any).
+	struct AssertFailure : std::runtime_error
+	{
+		AssertFailure(const char* assertName, const wchar_t* message)
+			: std::runtime_error(std::string{ assertName } + (message != nullptr ? ": " + narrow(message) : std::string{}))
+		{
+		}
+		static std::string narrow(const wchar_t* message)
+		{
+			std::string narrowed;
+			for (; *message != L'\0'; message++)
+				narrowed.push_back(static_cast<char>(*message));
+			return narrowed;
+		}
+	};
+}
+
+#define TEST_CLASS(className) \
+	struct className##_name { static constexpr const char* Value{ #className }; }; \
+	struct className : ::linuxtestrunner::TestClass<className, className##_name>
+#define TEST_METHOD(methodName) \
+	static void run_##methodName() { TestClass_t testClass{}; testClass.methodName(); } \
+	inline static const ::linuxtestrunner::TestRegistrar register_##methodName{ TestClassName, #methodName, &run_##methodName }; \
+	void methodName()
+
+namespace Microsoft::VisualStudio::CppUnitTestFramework
+{
+	struct Assert
+	{
+		using AssertFailure = ::linuxtestrunner::AssertFailure;
+		static void IsTrue(const bool condition, const wchar_t* message = nullptr)
+		{
+			if (!condition)
+				throw AssertFailure{ "IsTrue", message };
+		}
+		static void IsFalse(const bool condition, const wchar_t* message = nullptr)
+		{
+			if (condition)
+				throw AssertFailure{ "IsFalse", message };
+		}
+		template<typename T>
+		static void IsNull(const T* pointer, const wchar_t* message = nullptr)
+		{
+			if (pointer != nullptr)
+				throw AssertFailure{ "IsNull", message };
+		}
+		template<typename T>
+		static void IsNotNull(const T* pointer, const wchar_t* message = nullptr)
+		{
+			if (pointer == nullptr)
+				throw AssertFailure{ "IsNotNull", message };
+		}
+		template<typename Expected_t, typename Actual_t>
+		static void AreEqual(const Expected_t& expected, const Actual_t& actual, const wchar_t* message = nullptr)
+		{
+			if (!(expected == actual))
+				throw AssertFailure{ "AreEqual", message };
+		}
+		template<typename Exception_t, typename Fn_t>
+		static void ExpectException(Fn_t fn, const wchar_t* message = nullptr)
+		{
+			try
+			{
+				fn();
+			}
+			catch (const Exception_t&)
+			{
+				return;
+			}
+			catch (...)
+			{
+			}
+			throw AssertFailure{ "ExpectException", message };
+		}
+	};
+}
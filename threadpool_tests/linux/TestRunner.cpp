@@ -0,0 +1,34 @@
+// Runs the tests with g++ on Linux, using the CppUnitTest stand-in in this directory.
+// Build (from the repository root, see .github/workflows/linux-tests.yml):
+// g++ -std=c++20 -O1 -pthread -Ithreadpool_tests/linux -Ithreadpool_tests -include pch.h threadpool_tests/linux/TestRunner.cpp -o threadpool_tests_linux -ldl
+// Usage: threadpool_tests_linux [name filter], runs the tests whose name contains the filter.
+#include "CppUnitTest.h"
+#include "threadpool_tests.cpp"
+#include <exception>
+#include <iostream>
+#include <string_view>
+
+int main(const int argc, char** argv)
+{
+	const std::string_view filter{ argc > 1 ? argv[1] : "" };
+	int testsRun = 0;
+	int testsFailed = 0;
+	for (const auto& test : linuxtestrunner::GetTests())
+	{
+		if (test.Name.find(filter) == std::string::npos)
+			continue;
+		testsRun++;
+		try
+		{
+			test.Run();
+			std::cout << "PASS " << test.Name << std::endl;
+		}
+		catch (const std::exception& failure)
+		{
+			testsFailed++;
+			std::cout << "FAIL " << test.Name << " " << failure.what() << std::endl;
+		}
+	}
+	std::cout << testsRun - testsFailed << " passed, " << testsFailed << " failed" << std::endl;
+	return testsFailed > 0 ? 1 : 0;
+}
@@ -1,6 +1,14 @@
 #include "pch.h"
 #include "CppUnitTest.h"
 #include "ThreadUnitTests.h"
+#include "VirtualTimeSchedulerTests.h"
+#include "KeyedTaskPlacementTests.h"
+#include "ProcessUnitHostTests.h"
+#include "PluginTaskTests.h"
+#include "OutputBatcherTests.h"
+#include "MappedRecordStreamTests.h"
+#include "TimerCoalescingTests.h"
+#include "PressureMonitorTests.h"
 #include "../immutable_thread_pool/ThreadUnitPlusPlus.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;